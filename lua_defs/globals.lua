@@ -27,6 +27,16 @@ world = nil
 
 ---@class PhysicsSystemAPI
 ---@field tree DynamicBBTree
+local PhysicsSystemAPI = {}
+
+--- Intersecting triangle pairs of two entities that both have a MeshCollider.
+--- Returns an empty table if either has none or the meshes don't touch.
+---@param a integer
+---@param b integer
+---@param contactPoints boolean? Also compute where each pair crosses
+---@param anyHit boolean? Stop at the first pair
+---@return TriangleContact[]
+function PhysicsSystemAPI.CollideMeshes(a, b, contactPoints, anyHit) end
 
 ---@type PhysicsSystemAPI
 PhysicsSystem = nil
@@ -117,3 +127,42 @@ function CreateSphere(cfg) end
 ---@param cfg LinesConfig
 ---@return integer entity
 function CreateLines(cfg) end
+
+---@class MeshLoadConfig
+---@field stl? boolean Parse as STL, default true for names ending in .stl
+---@field collider? boolean Load or build the static tree too, default true
+---@field spatialSplits? boolean Build the tree with spatial splits, default false
+---@field lods? integer Simplified levels to generate, each with half the triangles of the one before. The entity draws the one that fits its size on screen, default 0. Packed files with levels from MeshConverter --lods use those instead
+
+--- Starts loading a mesh from res/models/ on the worker threads and returns immediately
+--- Start every load first and create the entities after, so the files load in parallel
+---@param filename string
+---@param cfg? MeshLoadConfig
+---@return MeshLoad
+function LoadMesh(filename, cfg) end
+
+--- Waits for every mesh started with LoadMesh that hasn't been waited on yet
+function WaitForMeshes() end
+
+---@class MeshFileConfig : MeshConfig
+---@field mesh MeshLoad Required - handle returned by LoadMesh, waited on if it hasn't finished
+
+--- Uploads a loaded mesh and creates its entity, with a MeshCollider if the tree was loaded and a LODGroup if levels were
+--- Several entities can be created from one handle, they share the mesh's tree
+---@param cfg MeshFileConfig
+---@return integer entity
+function CreateMesh(cfg) end
+
+-- ============================================================
+-- Script callbacks (optional, define in the scene script)
+-- ============================================================
+
+---Called once for each pair of tree entities whose fat boxes started overlapping this frame
+---@param a integer entity, always less than b
+---@param b integer entity
+function OnOverlapBegin(a, b) end
+
+---Called once for each pair of tree entities whose fat boxes stopped overlapping this frame
+---@param a integer entity, always less than b
+---@param b integer entity
+function OnOverlapEnd(a, b) end
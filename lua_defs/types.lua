@@ -115,17 +115,91 @@ function Lines:PushBoundingBoxes(boxes) end
 -- Physics tree
 -- ============================================================
 
+---@class RayHit
+---@field entity integer
+---@field t number Distance along the ray to the entity's fat box
+---@field point vec3 Where the ray enters the entity's fat box
+---@field hit boolean
+
+---@class MeshRayHit
+---@field entity integer
+---@field triangle integer? Triangle index in the entity's mesh, nil if only the entity's fat box was hit
+---@field t number Distance along the ray to the hit
+---@field point vec3
+---@field normal vec3 World space triangle normal, zero for box hits
+---@field barycentric vec2 Weights of the triangle's second and third corners
+---@field hit boolean
+
+---@class TriangleContact
+---@field triangle integer Triangle index in the first entity's mesh
+---@field otherTriangle integer Triangle index in the second entity's mesh
+---@field point vec3 World space point where they cross, zero unless contact points were requested
+
+---@class MeshLoad
+---@field ready boolean True once the mesh finished loading. Without worker threads reading it finishes the load first
+---@field filename string
+local MeshLoad = {}
+
+--- Blocks until the mesh finished loading, running other queued work meanwhile
+function MeshLoad:Wait() end
+
 ---@class DynamicBBTree
+---@field fatMargin number Margin added to every side of a leaf's stored box
+---@field displacementMultiplier number Scales update displacement when enlarging a leaf's box
 local DynamicBBTree = {}
 
+--- Closest entity whose fat box the ray enters, with the distance and point where it enters.
 ---@param ray Ray
----@return integer entity, boolean hit
+---@return integer entity, boolean hit, number t, vec3 point
 function DynamicBBTree:QueryRay(ray) end
 
+--- Traces every ray in one call, much cheaper than calling QueryRay per ray.
+---@param rays Ray[]
+---@return RayHit[] hits Same order as rays
+function DynamicBBTree:QueryRays(rays) end
+
+--- Like QueryRay, but continues into the triangles of entities with a MeshCollider.
+--- Entities without one are hit at their fat box.
+---@param ray Ray
+---@return MeshRayHit
+function DynamicBBTree:RayCastMeshes(ray) end
+
+---@param ray Ray
+---@return BoundingBox[] boxes, boolean hit
+function DynamicBBTree:QueryRayCollisions(ray) end
+
+--- Calls fn for every entity whose fat box overlaps bbox. Return false from fn to stop.
+---@param bbox BoundingBox
+---@param fn fun(entity: integer): boolean?
+function DynamicBBTree:QueryAABB(bbox, fn) end
+
+--- Calls fn for every entity whose fat box the ray enters within maxT.
+--- Return a smaller maxT from fn to clip the ray, or 0 to stop.
+---@param ray Ray
+---@param maxT number
+---@param fn fun(entity: integer, t: number): number?
+function DynamicBBTree:RayCast(ray, maxT, fn) end
+
 ---@param entity integer
 ---@return BoundingBox
 function DynamicBBTree:GetBoundingBox(entity) end
 
+--- Enlarged box stored in the entity's leaf.
+---@param entity integer
+---@return BoundingBox
+function DynamicBBTree:GetFatBoundingBox(entity) end
+
+--- Leaves re-inserted since the engine last reset the counter (once per frame).
+---@return integer
+function DynamicBBTree:GetReinsertCount() end
+
+--- Rebuilds all internal nodes with binned SAH. Leaves and overlaps are unchanged.
+function DynamicBBTree:Rebuild() end
+
+--- Internal node surface area divided by root surface area. Lower is better.
+---@return number
+function DynamicBBTree:GetQualityMetric() end
+
 ---@param entity integer
 ---@param bbox BoundingBox
 function DynamicBBTree:InsertEntity(entity, bbox) end
@@ -133,9 +207,11 @@ function DynamicBBTree:InsertEntity(entity, bbox) end
 ---@param entity integer
 function DynamicBBTree:RemoveEntity(entity) end
 
----@overload fun(self: DynamicBBTree, entity: integer, pos: vec3)
+--- Returns true if the leaf was re-inserted, false if its fat box still contained the new box.
+---@overload fun(self: DynamicBBTree, entity: integer, pos: vec3): boolean
 ---@param entity integer
 ---@param bbox BoundingBox
+---@return boolean
 function DynamicBBTree:UpdateEntity(entity, bbox) end
 
 --- Insert entity using its pre-registered bounding box from the physics registry.
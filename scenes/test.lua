@@ -114,6 +114,19 @@ function OnUpdate(dt, input, camera)
     state.boxLines:PushBoundingBoxes(PhysicsSystem.tree:GetAllBoxes(false))
 end
 
+-- Overlap events from the physics tree
+function OnOverlapBegin(a, b)
+    if a == light or b == light then
+        Utils.Log("Light entered box of entity " .. tostring(a == light and b or a))
+    end
+end
+
+function OnOverlapEnd(a, b)
+    if a == light or b == light then
+        Utils.Log("Light left box of entity " .. tostring(a == light and b or a))
+    end
+end
+
 -- Mouse click handler
 function OnClick(input, camera)
     -- Generate ray from screen to world
@@ -134,6 +147,11 @@ function OnClick(input, camera)
 
     if hit then
         print("Hit entity: " .. tostring(entity))
+        -- Cubes carry a MeshCollider, so the exact triangle under the cursor is available too
+        local meshHit = PhysicsSystem.tree:RayCastMeshes(ray)
+        if meshHit.hit and meshHit.triangle then
+            print("Hit triangle: " .. tostring(meshHit.triangle) .. " of entity " .. tostring(meshHit.entity))
+        end
         state.selectedEntity = entity
         SelectedEntity = entity
     else
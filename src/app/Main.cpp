@@ -54,6 +54,9 @@ int main() {
 	try {
 		Utils::Timer timer("Setup");
 
+		// One worker pool for the whole run, mesh loading and physics all submit to it
+		world.StartWorkers(Utils::AUTO_THREAD_COUNT, false);
+
 		// Window creation
 		Core::WindowManager windowManager("OpenGL Window", 900, 900, true);
 		GLFWwindow *window = windowManager.GetWindow();
@@ -71,6 +74,7 @@ int main() {
 			Components::RenderInfo
 		>();
 		renderSystem->SetWindow(windowManager.GetWindow());
+		renderSystem->SetCamera(&cam);
 
 		// Create PhysicsSystem
 		auto physicsSystem = world.RegisterSystem<PhysicsSystem,
@@ -204,6 +208,11 @@ int main() {
 					LuaBindings::LuaCameraView::FromCamera(cam));
 			}
 
+			// Report overlaps caused by anything scripts moved this frame
+			physicsSystem->UpdateOverlaps();
+			luaRuntime.CallOnOverlap(physicsSystem->pairCache.GetBeginEvents(),
+			                         physicsSystem->pairCache.GetEndEvents());
+
 			// Sync entity selection from Lua
 			auto selectedOpt = luaRuntime.GetSelectedEntity();
 			entity = selectedOpt.value_or(Entity());
@@ -255,12 +264,17 @@ int main() {
 			}
 
 			std::string fpsString("FPS: " + std::to_string(static_cast<int>(fps)) + "\nMSPF: " + std::to_string(mspf));
+			std::string treeString("Tree re-inserts: " + std::to_string(tree.GetReinsertCount()));
+			tree.ResetReinsertCount();
+			treeString += "\nTree quality: " + std::to_string(tree.GetQualityMetric());
+			treeString += "\nOverlapping pairs: " + std::to_string(physicsSystem->pairCache.GetPairCount());
 
 			renderSystem->Update();
 			GUI.NewFrame();
 
 			GUI.StartWindow("Performance");
 			GUI.Text(fpsString.c_str());
+			GUI.Text(treeString.c_str());
 			GUI.EndWindow();
 
 			GUI.ShowConfigWindow();
@@ -280,6 +294,7 @@ int main() {
 
 		GL_CHECK();
 
+		luaRuntime.Shutdown();
 		world.Clean();
 		GUI.Clean();
 
@@ -0,0 +1,111 @@
+// Times closest hit ray queries on a dense DynamicBBTree: 50k random leaves, 20k near parallel rays through the volume
+// Compares QueryClosest against visiting every leaf the ray enters, which is what QueryRay cost before it pruned
+// Build with CMAKE_BUILD_TYPE=Release. The checksums sum the entities hit and have to match between variants
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "physics/DynamicTree.h"
+#include "utils/Logger.h"
+
+namespace
+{
+	constexpr int LEAF_COUNT = 50000;
+	constexpr int RAY_COUNT = 20000;
+	constexpr int RUN_COUNT = 3;
+
+	using Clock = std::chrono::steady_clock;
+
+	// Runs query over every ray RUN_COUNT times and prints the best time
+	template<typename Query>
+	void Measure(const char* name, const std::vector<Ray>& rays, const Query& query)
+	{
+		double best = 0.0;
+		uint64_t checksum = 0;
+		for (int run = 0; run < RUN_COUNT; run++)
+		{
+			checksum = 0;
+			const Clock::time_point start = Clock::now();
+			for (const Ray& ray : rays) checksum += query(ray);
+			const double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			best = run == 0 ? elapsed : std::min(best, elapsed);
+		}
+		std::printf("  %-32s %8.1f ms  (checksum %llu)\n", name, best, static_cast<unsigned long long>(checksum));
+	}
+
+	// Entity plus one, so a miss doesn't look like a hit on entity 0
+	uint64_t Checksum(const Entity entity, const bool hit)
+	{
+		return hit ? static_cast<uint64_t>(entity) + 1 : 0;
+	}
+}
+
+int main()
+{
+	LOG_INIT("DynamicTreeRayBenchmark.log");
+
+	std::mt19937 random(9);
+	auto uniform = [&random](const float min, const float max) { return std::uniform_real_distribution<float>(min, max)(random); };
+
+	Physics::DynamicBBTree tree(2 * LEAF_COUNT);
+	for (int e = 0; e < LEAF_COUNT; e++)
+	{
+		const glm::vec3 center(uniform(-100.0f, 100.0f), uniform(-100.0f, 100.0f), uniform(-100.0f, 100.0f));
+		const glm::vec3 extent(uniform(0.2f, 1.5f), uniform(0.2f, 1.5f), uniform(0.2f, 1.5f));
+		tree.InsertEntity(e, BoundingBox(center - extent, center + extent));
+	}
+
+	std::vector<Ray> rays;
+	for (int i = 0; i < RAY_COUNT; i++)
+	{
+		const glm::vec3 direction(uniform(-0.5f, 0.5f), uniform(-0.5f, 0.5f), 1.0f);
+		rays.emplace_back(glm::vec3(uniform(-120.0f, 120.0f), uniform(-120.0f, 120.0f), -130.0f), glm::normalize(direction));
+	}
+
+	std::printf("%d leaves, tree height %d, %d rays, best of %d runs\n", LEAF_COUNT, tree.mLinks[tree.rootIndex].height,
+	            RAY_COUNT, RUN_COUNT);
+
+	// Never clipping the ray visits every node it passes through, like QueryRay did before it pruned
+	Measure("every leaf the ray enters", rays, [&tree](const Ray& ray)
+	{
+		Physics::RayHit closest;
+		tree.RayCast(ray, [&closest](const Entity entity, const float t)
+		{
+			if (t < closest.t)
+			{
+				closest.entity = entity;
+				closest.t = t;
+				closest.hit = true;
+			}
+			return FLT_MAX;
+		});
+		return Checksum(closest.entity, closest.hit);
+	});
+	Measure("QueryClosest", rays, [&tree](const Ray& ray)
+	{
+		const Physics::RayHit hit = tree.QueryClosest(ray);
+		return Checksum(hit.entity, hit.hit);
+	});
+	Measure("QueryRay", rays, [&tree](const Ray& ray)
+	{
+		const std::pair<Entity, bool> hit = tree.QueryRay(ray);
+		return Checksum(hit.first, hit.second);
+	});
+
+	std::vector<Physics::RayHit> hits;
+	double best = 0.0;
+	uint64_t checksum = 0;
+	for (int run = 0; run < RUN_COUNT; run++)
+	{
+		const Clock::time_point start = Clock::now();
+		tree.QueryRays(rays, hits);
+		const double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		best = run == 0 ? elapsed : std::min(best, elapsed);
+	}
+	for (const Physics::RayHit& hit : hits) checksum += Checksum(hit.entity, hit.hit);
+	std::printf("  %-32s %8.1f ms  (checksum %llu)\n", "QueryRays, packets", best, static_cast<unsigned long long>(checksum));
+	return 0;
+}
@@ -0,0 +1,120 @@
+// Times DynamicBBTree under the churn PhysicsSystem puts it through: 10k cycles of removing and re-inserting one
+// entity, moving another and casting 10 rays. Build with CMAKE_BUILD_TYPE=Release, the numbers mean little otherwise
+// Reports the best of a few runs per phase, the hit count only has to match between builds being compared
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "physics/DynamicTree.h"
+#include "utils/Logger.h"
+
+namespace
+{
+	constexpr int ENTITY_COUNT = 500;
+	constexpr int CYCLE_COUNT = 10000;
+	constexpr int RAYS_PER_CYCLE = 10;
+	constexpr int RUN_COUNT = 3;
+
+	using Clock = std::chrono::steady_clock;
+
+	double Milliseconds(const Clock::time_point start, const Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	struct Scene
+	{
+		std::mt19937 random;
+
+		explicit Scene(const unsigned seed) : random(seed) {}
+
+		float Uniform(const float min, const float max)
+		{
+			return std::uniform_real_distribution<float>(min, max)(random);
+		}
+
+		BoundingBox RandomBox()
+		{
+			const glm::vec3 center(Uniform(-20.0f, 20.0f), Uniform(-20.0f, 20.0f), Uniform(-20.0f, 20.0f));
+			const glm::vec3 extent(Uniform(0.1f, 1.0f), Uniform(0.1f, 1.0f), Uniform(0.1f, 1.0f));
+			return BoundingBox(center - extent, center + extent);
+		}
+	};
+
+	struct Timings
+	{
+		double insertRemove = 0.0;
+		double update = 0.0;
+		double query = 0.0;
+		size_t hits = 0;
+	};
+
+	// Same seed every run, so every run and every build does exactly the same work
+	Timings Run()
+	{
+		Scene scene(7);
+		Physics::DynamicBBTree tree(1);
+		std::vector<BoundingBox> boxes(ENTITY_COUNT);
+		for (int e = 0; e < ENTITY_COUNT; e++)
+		{
+			boxes[e] = scene.RandomBox();
+			tree.InsertEntity(e, boxes[e]);
+		}
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < CYCLE_COUNT; i++)
+		{
+			const glm::vec3 direction(scene.Uniform(-0.3f, 0.3f), scene.Uniform(-0.3f, 0.3f), 1.0f);
+			rays.emplace_back(glm::vec3(scene.Uniform(-30.0f, 30.0f), scene.Uniform(-30.0f, 30.0f), -40.0f), glm::normalize(direction));
+		}
+
+		Timings timings;
+		for (int cycle = 0; cycle < CYCLE_COUNT; cycle++)
+		{
+			const Clock::time_point start = Clock::now();
+			const Entity replaced = scene.random() % ENTITY_COUNT;
+			tree.RemoveEntity(replaced);
+			boxes[replaced] = scene.RandomBox();
+			tree.InsertEntity(replaced, boxes[replaced]);
+
+			const Clock::time_point inserted = Clock::now();
+			const Entity moved = scene.random() % ENTITY_COUNT;
+			const glm::vec3 displacement(scene.Uniform(-3.0f, 3.0f), scene.Uniform(-3.0f, 3.0f), scene.Uniform(-3.0f, 3.0f));
+			boxes[moved].Translate(displacement);
+			tree.UpdateEntity(moved, boxes[moved], displacement);
+
+			const Clock::time_point updated = Clock::now();
+			for (int q = 0; q < RAYS_PER_CYCLE; q++)
+				timings.hits += tree.QueryRay(rays[(cycle * RAYS_PER_CYCLE + q) % rays.size()]).second;
+			const Clock::time_point queried = Clock::now();
+
+			timings.insertRemove += Milliseconds(start, inserted);
+			timings.update += Milliseconds(inserted, updated);
+			timings.query += Milliseconds(updated, queried);
+		}
+		return timings;
+	}
+}
+
+int main()
+{
+	LOG_INIT("DynamicTreeUpdateBenchmark.log");
+
+	Timings best = Run();
+	for (int run = 1; run < RUN_COUNT; run++)
+	{
+		const Timings timings = Run();
+		best.insertRemove = std::min(best.insertRemove, timings.insertRemove);
+		best.update = std::min(best.update, timings.update);
+		best.query = std::min(best.query, timings.query);
+	}
+
+	std::printf("%d entities, %d cycles, best of %d runs\n", ENTITY_COUNT, CYCLE_COUNT, RUN_COUNT);
+	std::printf("  remove + insert   %8.1f ms\n", best.insertRemove);
+	std::printf("  update            %8.1f ms\n", best.update);
+	std::printf("  %d ray queries    %8.1f ms\n", RAYS_PER_CYCLE, best.query);
+	std::printf("  total             %8.1f ms  (%zu hits)\n", best.insertRemove + best.update + best.query, best.hits);
+	return 0;
+}
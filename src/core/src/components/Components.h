@@ -3,4 +3,5 @@
 #include "Transform.h"
 #include "RenderInfo.h"
 #include "TextureInfo.h"
-#include "Rigidbody.h"
\ No newline at end of file
+#include "Rigidbody.h"
+#include "LODGroup.h"
\ No newline at end of file
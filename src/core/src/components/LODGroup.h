@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+
+namespace Components
+{
+	constexpr size_t MAX_LOD_LEVELS = 8;
+
+	struct LODLevel {
+		// Range of the entity's EBO, in indices
+		size_t indexOffset = 0;
+		size_t indexCount = 0;
+		// Drawn while the mesh covers at least this fraction of the viewport height, the last level should have 0
+		float minScreenSize = 0.0f;
+	};
+
+	// Levels of detail sharing one VAO, most detailed first. RenderSystem picks one per frame from the projected size
+	// of the bounding sphere
+	struct LODGroup {
+		std::array<LODLevel, MAX_LOD_LEVELS> levels{};
+		size_t levelCount = 0;
+
+		// Bounding sphere in object space
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 0.0f;
+
+		// How far past a threshold the size has to go before switching, as a fraction of it
+		// Keeps an object sitting right at a threshold from flickering between levels, 0 switches right at it
+		float hysteresis = 0.1f;
+		size_t currentLevel = 0;
+
+		size_t SelectLevel(const float screenSize) const
+		{
+			size_t level = 0;
+			while (level + 1 < levelCount)
+			{
+				// A level finer than the current one needs the size clearly above its threshold, the current and
+				// coarser ones are kept until it's clearly below
+				const float threshold = levels[level].minScreenSize * (level < currentLevel ? 1.0f + hysteresis : 1.0f - hysteresis);
+				if (screenSize >= threshold) break;
+				level++;
+			}
+			return level;
+		}
+	};
+}
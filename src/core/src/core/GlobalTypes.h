@@ -90,6 +90,33 @@ struct MeshData
 	std::vector<GLuint> indices;
 };
 
+/**
+ * @struct MeshView
+ * @brief Non-owning view of mesh data, for example straight into the pages of a memory mapped file.
+ * Only valid as long as whatever owns the data.
+ */
+struct MeshView
+{
+	const MeshPt* vertices = nullptr;
+	size_t vertexCount = 0;
+	const GLuint* indices = nullptr;
+	size_t indexCount = 0;
+
+	MeshView() = default;
+	MeshView(const MeshPt* vertices, const size_t vertexCount, const GLuint* indices, const size_t indexCount):
+		vertices(vertices), vertexCount(vertexCount), indices(indices), indexCount(indexCount) {}
+	MeshView(const MeshData& data):
+		vertices(data.vertices.data()), vertexCount(data.vertices.size()), indices(data.indices.data()), indexCount(data.indices.size()) {}
+
+	bool Empty() const { return vertexCount == 0 || indexCount == 0; }
+
+	// Owning copy, for code that needs vectors
+	MeshData ToMeshData() const
+	{
+		return MeshData{ std::vector<MeshPt>(vertices, vertices + vertexCount), std::vector<GLuint>(indices, indices + indexCount) };
+	}
+};
+
 /**
  * @struct ModelData
  * @brief The ModelData struct is used to store the data of a 3D model with texture coordinates.
@@ -3,12 +3,15 @@
 
 #include "core/ECS/ComponentManager.h"
 #include "core/ECS/SystemManager.h"
+#include "utils/TaskScheduler.h"
 
 class World
 {
 	std::unique_ptr<ComponentManager> mComponentManager;
 	std::unique_ptr<EntityManager> mEntityManager;
 	std::unique_ptr<SystemManager> mSystemManager;
+	// Worker pool shared by every subsystem, lives as long as the world
+	std::unique_ptr<Utils::TaskScheduler> mScheduler;
 
 public:
 	World()
@@ -16,6 +19,7 @@ public:
 		mComponentManager = std::make_unique<ComponentManager>();
 		mEntityManager = std::make_unique<EntityManager>();
 		mSystemManager = std::make_unique<SystemManager>();
+		mScheduler = std::make_unique<Utils::TaskScheduler>();
 	}
 
 	// Entity methods
@@ -97,8 +101,22 @@ public:
 		return mSystemManager->RegisterSystem<TSystem>(signature);
 	}
 
+	// Job system methods
+	// Starts the workers, should be called once from the main thread before anything is loaded
+	// Until then tasks run on whichever thread waits on them
+	void StartWorkers(size_t threadCount = Utils::AUTO_THREAD_COUNT, bool pinThreads = false) const
+	{
+		mScheduler->Start(threadCount, pinThreads);
+	}
+
+	Utils::TaskScheduler& GetScheduler() const
+	{
+		return *mScheduler;
+	}
+
 	void Clean() const
 	{
 		mSystemManager->CleanSystems();
+		mScheduler->Stop();
 	}
 };
\ No newline at end of file
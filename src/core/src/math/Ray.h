@@ -24,6 +24,8 @@ public:
     glm::vec3 GetPoint(float t) const { return origin + direction * t; }
 
     std::pair<float, bool> IsColliding(const BoundingBox& box) const;
+    // Only counts hits within [0, maxT], t is set to the entry distance (0 if the origin is inside)
+    bool IsColliding(const BoundingBox& box, float maxT, float& t) const;
 };
 
 inline std::pair<float, bool> Ray::IsColliding(const BoundingBox& box) const
@@ -59,3 +61,16 @@ inline std::pair<float, bool> Ray::IsColliding(const BoundingBox& box) const
     return std::make_pair(txmin, true);
 }
 
+inline bool Ray::IsColliding(const BoundingBox& box, const float maxT, float& t) const
+{
+    const glm::vec3 t1 = (box.min - origin) * invdir;
+    const glm::vec3 t2 = (box.max - origin) * invdir;
+    const glm::vec3 tNear = glm::min(t1, t2);
+    const glm::vec3 tFar = glm::max(t1, t2);
+
+    const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxT));
+
+    t = entry;
+    return entry <= exit;
+}
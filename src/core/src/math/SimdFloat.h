@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+
+#if defined(__AVX__)
+#define MATH_SIMD_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATH_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+// Small wrapper over a register of floats so packet code is written once
+// Maps to AVX (8 lanes) or SSE (4 lanes) depending on the compile target, with a plain array fallback
+namespace Math
+{
+#if defined(MATH_SIMD_AVX)
+    constexpr size_t SIMD_WIDTH = 8;
+
+    struct SimdFloat { __m256 v; };
+    struct SimdMask { __m256 v; };
+
+    inline SimdFloat SimdSet(const float value) { return { _mm256_set1_ps(value) }; }
+    inline SimdFloat SimdLoad(const float* values) { return { _mm256_loadu_ps(values) }; }
+    inline void SimdStore(float* out, const SimdFloat a) { _mm256_storeu_ps(out, a.v); }
+
+    inline SimdFloat operator+(const SimdFloat a, const SimdFloat b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline SimdFloat operator-(const SimdFloat a, const SimdFloat b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline SimdFloat operator*(const SimdFloat a, const SimdFloat b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline SimdFloat SimdMin(const SimdFloat a, const SimdFloat b) { return { _mm256_min_ps(a.v, b.v) }; }
+    inline SimdFloat SimdMax(const SimdFloat a, const SimdFloat b) { return { _mm256_max_ps(a.v, b.v) }; }
+
+    inline SimdMask operator<=(const SimdFloat a, const SimdFloat b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    inline SimdMask operator&(const SimdMask a, const SimdMask b) { return { _mm256_and_ps(a.v, b.v) }; }
+    // One bit per lane, lane 0 in the lowest bit
+    inline int SimdBits(const SimdMask a) { return _mm256_movemask_ps(a.v); }
+
+#elif defined(MATH_SIMD_SSE)
+    constexpr size_t SIMD_WIDTH = 4;
+
+    struct SimdFloat { __m128 v; };
+    struct SimdMask { __m128 v; };
+
+    inline SimdFloat SimdSet(const float value) { return { _mm_set1_ps(value) }; }
+    inline SimdFloat SimdLoad(const float* values) { return { _mm_loadu_ps(values) }; }
+    inline void SimdStore(float* out, const SimdFloat a) { _mm_storeu_ps(out, a.v); }
+
+    inline SimdFloat operator+(const SimdFloat a, const SimdFloat b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline SimdFloat operator-(const SimdFloat a, const SimdFloat b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline SimdFloat operator*(const SimdFloat a, const SimdFloat b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline SimdFloat SimdMin(const SimdFloat a, const SimdFloat b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline SimdFloat SimdMax(const SimdFloat a, const SimdFloat b) { return { _mm_max_ps(a.v, b.v) }; }
+
+    inline SimdMask operator<=(const SimdFloat a, const SimdFloat b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    inline SimdMask operator&(const SimdMask a, const SimdMask b) { return { _mm_and_ps(a.v, b.v) }; }
+    // One bit per lane, lane 0 in the lowest bit
+    inline int SimdBits(const SimdMask a) { return _mm_movemask_ps(a.v); }
+
+#else
+    constexpr size_t SIMD_WIDTH = 4;
+
+    struct SimdFloat { float v[SIMD_WIDTH]; };
+    struct SimdMask { int bits; };
+
+    inline SimdFloat SimdSet(const float value)
+    {
+        SimdFloat r;
+        for (size_t i = 0; i < SIMD_WIDTH; i++) r.v[i] = value;
+        return r;
+    }
+    inline SimdFloat SimdLoad(const float* values)
+    {
+        SimdFloat r;
+        for (size_t i = 0; i < SIMD_WIDTH; i++) r.v[i] = values[i];
+        return r;
+    }
+    inline void SimdStore(float* out, const SimdFloat a)
+    {
+        for (size_t i = 0; i < SIMD_WIDTH; i++) out[i] = a.v[i];
+    }
+
+    template<typename Op>
+    SimdFloat SimdApply(const SimdFloat a, const SimdFloat b, Op op)
+    {
+        SimdFloat r;
+        for (size_t i = 0; i < SIMD_WIDTH; i++) r.v[i] = op(a.v[i], b.v[i]);
+        return r;
+    }
+
+    inline SimdFloat operator+(const SimdFloat a, const SimdFloat b) { return SimdApply(a, b, [](float x, float y) { return x + y; }); }
+    inline SimdFloat operator-(const SimdFloat a, const SimdFloat b) { return SimdApply(a, b, [](float x, float y) { return x - y; }); }
+    inline SimdFloat operator*(const SimdFloat a, const SimdFloat b) { return SimdApply(a, b, [](float x, float y) { return x * y; }); }
+    // Same operand order as minps/maxps so NaN lanes behave identically
+    inline SimdFloat SimdMin(const SimdFloat a, const SimdFloat b) { return SimdApply(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    inline SimdFloat SimdMax(const SimdFloat a, const SimdFloat b) { return SimdApply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+
+    inline SimdMask operator<=(const SimdFloat a, const SimdFloat b)
+    {
+        int bits = 0;
+        for (size_t i = 0; i < SIMD_WIDTH; i++) bits |= (a.v[i] <= b.v[i]) << i;
+        return { bits };
+    }
+    inline SimdMask operator&(const SimdMask a, const SimdMask b) { return { a.bits & b.bits }; }
+    // One bit per lane, lane 0 in the lowest bit
+    inline int SimdBits(const SimdMask a) { return a.bits; }
+#endif
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include "MeshImport.h"
+#include "core/GlobalTypes.h"
+#include "physics/StaticTree.h"
+#include "utils/Logger.h"
+#include "utils/MappedFile.h"
+#include "utils/PathUtils.h"
+#include "utils/TaskScheduler.h"
+
+namespace Utils
+{
+	// Bumped whenever the layout of a cache file or the meshes the importers produce change
+	// The tree's own layout is versioned separately
+	constexpr uint32_t MESH_CACHE_VERSION = 2;
+	// Relative to the working directory, like every other resource
+	constexpr const char* MESH_CACHE_DIRECTORY = "/cache/meshes/";
+
+	struct CachedMesh
+	{
+		MeshData data;
+		std::shared_ptr<Physics::StaticTree> tree;
+		// Simplified copies of data, most detailed first. Only filled by MeshLoader, from the files MeshConverter --lods
+		// wrote next to a packed mesh or simplified when asked for, never cached
+		std::vector<MeshData> lods;
+	};
+
+	/*
+	Cache file format, one file per source file named after the hash of its contents:
+	char[4] magic "MSHC"
+	uint32 MESH_CACHE_VERSION
+	uint64 hash of the source file
+
+	uint64 # of vertices, followed by the MeshPt array
+	uint64 # of indices, followed by the index array
+
+	StaticTree::Serialize output
+	*/
+
+	// Loads a mesh and its static tree, skipping the parse and the build if the cache holds a file with the same
+	// contents that was built with the same options. Otherwise loads it normally and writes the cache
+	// Returns empty data and no tree if the source file can't be read
+	inline CachedMesh LoadMeshCached(const std::string& filepath, bool isStl, TaskScheduler& scheduler,
+	                                 const Physics::StaticTreeBuildOptions& options = {});
+
+	namespace Detail
+	{
+		constexpr char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+		inline std::string GetMeshCachePath(const uint64_t sourceHash)
+		{
+			std::ostringstream name;
+			name << std::hex << std::setw(16) << std::setfill('0') << sourceHash << ".mcache";
+			return GetResourcePath(MESH_CACHE_DIRECTORY, name.str());
+		}
+
+		template<typename T>
+		bool ReadCacheArray(const char*& data, const char* end, std::vector<T>& items)
+		{
+			uint64_t count;
+			if (static_cast<size_t>(end - data) < sizeof(count)) return false;
+			std::memcpy(&count, data, sizeof(count));
+			data += sizeof(count);
+			if (count > static_cast<size_t>(end - data) / sizeof(T)) return false;
+
+			items.resize(count);
+			std::memcpy(items.data(), data, count * sizeof(T));
+			data += count * sizeof(T);
+			return true;
+		}
+
+		template<typename T>
+		void WriteCacheArray(std::ostream& out, const std::vector<T>& items)
+		{
+			const uint64_t count = items.size();
+			out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+			out.write(reinterpret_cast<const char*>(items.data()), static_cast<std::streamsize>(count * sizeof(T)));
+		}
+
+		inline bool ReadMeshCache(const std::string& cachePath, const uint64_t sourceHash,
+		                          const Physics::StaticTreeBuildOptions& options, CachedMesh& mesh)
+		{
+			const MappedFile file(cachePath);
+			if (!file.IsOpen()) return false;
+
+			const char* data = file.Data();
+			const char* end = data + file.Size();
+
+			char magic[4];
+			uint32_t version;
+			uint64_t hash;
+			if (file.Size() < sizeof(magic) + sizeof(version) + sizeof(hash)) return false;
+			std::memcpy(magic, data, sizeof(magic));
+			std::memcpy(&version, data + sizeof(magic), sizeof(version));
+			std::memcpy(&hash, data + sizeof(magic) + sizeof(version), sizeof(hash));
+			data += sizeof(magic) + sizeof(version) + sizeof(hash);
+
+			if (std::memcmp(magic, MESH_CACHE_MAGIC, sizeof(magic)) != 0 || version != MESH_CACHE_VERSION || hash != sourceHash)
+				return false;
+
+			if (!ReadCacheArray(data, end, mesh.data.vertices) || !ReadCacheArray(data, end, mesh.data.indices))
+			{
+				LOG(LOG_WARNING) << "Mesh cache " << cachePath << " is truncated, rebuilding it.\n";
+				return false;
+			}
+
+			auto tree = std::make_shared<Physics::StaticTree>();
+			if (!tree->Deserialize(data, end)) return false;
+
+			if (!tree->WasBuiltWith(options)) return false;
+
+			mesh.tree = std::move(tree);
+			return true;
+		}
+
+		inline void WriteMeshCache(const std::string& cachePath, const uint64_t sourceHash, const CachedMesh& mesh)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+
+			// Written under a temporary name first so a crash never leaves a half written cache behind
+			// The name is per thread, two meshes with the same contents may be loading at once
+			std::ostringstream tempName;
+			tempName << cachePath << ".tmp" << std::this_thread::get_id();
+			const std::string tempPath = tempName.str();
+			{
+				std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+				if (!out)
+				{
+					LOG(LOG_WARNING) << "Can't write mesh cache " << cachePath << ".\n";
+					return;
+				}
+
+				out.write(MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+				out.write(reinterpret_cast<const char*>(&MESH_CACHE_VERSION), sizeof(MESH_CACHE_VERSION));
+				out.write(reinterpret_cast<const char*>(&sourceHash), sizeof(sourceHash));
+				WriteCacheArray(out, mesh.data.vertices);
+				WriteCacheArray(out, mesh.data.indices);
+				mesh.tree->Serialize(out);
+			}
+
+			std::filesystem::rename(tempPath, cachePath, error);
+			if (error)
+			{
+				LOG(LOG_WARNING) << "Can't write mesh cache " << cachePath << ": " << error.message() << "\n";
+				std::filesystem::remove(tempPath, error);
+			}
+		}
+	}
+
+	inline CachedMesh LoadMeshCached(const std::string& filepath, const bool isStl, TaskScheduler& scheduler,
+	                                 const Physics::StaticTreeBuildOptions& options)
+	{
+		CachedMesh mesh;
+
+		uint64_t sourceHash;
+		{
+			const MappedFile source(filepath);
+			if (!source.IsOpen())
+			{
+				LOG(LOG_ERROR) << "Can't read mesh file " << filepath << "\n";
+				return mesh;
+			}
+			sourceHash = HashBytes(source.Data(), source.Size());
+		}
+
+		const std::string cachePath = Detail::GetMeshCachePath(sourceHash);
+		if (Detail::ReadMeshCache(cachePath, sourceHash, options, mesh))
+		{
+			LOG(LOG_INFO) << "Loaded " << filepath << " and its static tree from the mesh cache.\n";
+			return mesh;
+		}
+
+		mesh = CachedMesh{};
+		mesh.data = isStl ? ReadSTL(filepath.c_str(), scheduler) : ReadPackedSTL(filepath.c_str());
+		if (mesh.data.indices.empty()) return mesh;
+
+		mesh.tree = std::make_shared<Physics::StaticTree>();
+		mesh.tree->CreateStaticTree(mesh.data.vertices, mesh.data.indices, scheduler, options);
+
+		Detail::WriteMeshCache(cachePath, sourceHash, mesh);
+		return mesh;
+	}
+}
@@ -1,123 +1,257 @@
 #pragma once
+#include <charconv>
+#include <cctype>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <string_view>
 
 #include <glm/vec3.hpp>
 #include <glm/geometric.hpp>
 #include <glm/gtx/hash.hpp>
+#include "MeshOptimize.h"
+#include "PackedMesh.h"
 #include "core/GlobalTypes.h"
+#include "utils/Logger.h"
+#include "utils/MappedFile.h"
+#include "utils/TaskScheduler.h"
 
 namespace Utils
 {
-    static MeshData ReadSTL(const char* filepath)
-    {
-        // STL File format: https://people.sc.fsu.edu/~jburkardt/data/stlb/stlb.html
-        std::vector<MeshPt> points;
-        std::vector<unsigned int> indices;
-
-        std::unordered_map<glm::vec3, unsigned int, std::hash<glm::vec3>> pointToIndex;
-
-        std::ifstream is(filepath, std::ios::binary);
-
-        // First 80 chars is the header (title)
-        is.seekg(80);
-
-        // Next is the number of triangles, which is an unsigned integer (4 bytes or 4 chars).  Buffer index is offset by 80 chars
-        unsigned int numTriangles;
-        is.read(reinterpret_cast<char*>(&numTriangles), sizeof(unsigned int));
-
-        unsigned int currentIndex = 0;
-
-        for (unsigned int t = 0; t < numTriangles; t++)
-        {
-            // Jump to triangle location
-            is.seekg(t * 50 + 84);
-
-            // Normal vector for entire triangle
-            glm::vec3 tempNormal;
-            is.read(reinterpret_cast<char*>(&tempNormal), sizeof(glm::vec3));
-
-            // 3 points per triangle
-            for (int p = 0; p < 3; p++)
-            {
-                glm::vec3 tempPos;
-                is.read(reinterpret_cast<char*>(&tempPos), sizeof(glm::vec3));
-
-                auto iterator = pointToIndex.find(tempPos);
-                if (iterator == pointToIndex.end())
-                {
-                    // If the current point is new
-                    pointToIndex.insert(std::make_pair(tempPos, currentIndex));
-                    points.emplace_back(MeshPt{ tempPos, tempNormal });
-                    indices.push_back(currentIndex);
-                    currentIndex++;
-                }
-                else
-                {
-                    indices.push_back(iterator->second);
-                    // Add normal to existing point normal
-                    points[iterator->second].normal = points[iterator->second].normal + tempNormal;
-                }
-            }
-        }
-        is.close();
-
-        for (auto& point : points)
-        {
-            point.normal = glm::normalize(point.normal);
-        }
-
-        return MeshData{ points, indices };
-    }
-
-	/*
-	Format:
-	# of vertexes, unsigned int - 4 bytes
-	# of indices, unsigned int - 4 bytes
-
-	For each vertex:
-		vec3 position, 3 floats with 4 bytes each
-		vec3 normal (normalized), 3 floats with 4 bytes each
-
-	For each index
-		unsigned int index, 4 bytes
-	*/
-	static MeshData ReadPackedSTL(const char* filepath)
+	namespace Detail
 	{
-		// Reading packed file
-		std::ifstream is(filepath, std::ios::out | std::ios::binary);
-		is.seekg(0);
-
-		// Get vertex amount
-		unsigned int vertexAmount;
-		is.read(reinterpret_cast<char*>(&vertexAmount), sizeof(unsigned int));
-
-		// Get index amount
-		unsigned int indexAmount;
-		is.read(reinterpret_cast<char*>(&indexAmount), sizeof(unsigned int));
-
-		// Read position and normal information
-		MeshPt tempPt{};
-		std::vector<MeshPt> vertices;
-		vertices.reserve(vertexAmount);
-		for (int i = 0; i < static_cast<int>(vertexAmount); i++)
+		// Welding splits the corners into this many shards by position, each shard dedups on its own task
+		constexpr size_t WELD_SHARD_COUNT = 64;
+		// Triangles per task when copying them out of the file
+		constexpr size_t STL_PARSE_GRAIN = 16384;
+
+		// Same for every float that compares equal, so -0 and 0 end up in the same shard like the map treats them
+		inline size_t GetWeldShard(const glm::vec3& position)
+		{
+			uint32_t bits[3];
+			const glm::vec3 normalized = position + glm::vec3(0.0f);
+			std::memcpy(bits, &normalized, sizeof(bits));
+			uint64_t hash = bits[0] * 0x9E3779B97F4A7C15ull ^ bits[1] * 0xC2B2AE3D27D4EB4Full ^ bits[2] * 0x165667B19E3779F9ull;
+			hash ^= hash >> 29;
+			return static_cast<size_t>(hash % WELD_SHARD_COUNT);
+		}
+
+		// Merges corners with the same position into one vertex whose normal sums the normals of its triangles
+		// Vertices come out in the order their position first appears and the sums are added in corner order, so the
+		// result doesn't depend on the number of workers
+		inline MeshData WeldCorners(const std::vector<glm::vec3>& corners, const std::vector<glm::vec3>& triangleNormals,
+		                            TaskScheduler& scheduler)
+		{
+			const size_t cornerCount = corners.size();
+			const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(scheduler.GetWorkerCount() * 4, cornerCount / STL_PARSE_GRAIN));
+			const size_t chunkSize = (cornerCount + chunkCount - 1) / chunkCount;
+
+			// Bucket the corners by shard, keeping them in corner order within each shard
+			std::vector<uint8_t> shardOf(cornerCount);
+			std::vector<size_t> chunkCounts(chunkCount * WELD_SHARD_COUNT, 0);
+			ParallelFor(scheduler, 0, chunkCount, 1, [&](const size_t chunk)
+			{
+				size_t* counts = &chunkCounts[chunk * WELD_SHARD_COUNT];
+				for (size_t i = chunk * chunkSize; i < std::min(cornerCount, (chunk + 1) * chunkSize); i++)
+				{
+					shardOf[i] = static_cast<uint8_t>(GetWeldShard(corners[i]));
+					counts[shardOf[i]]++;
+				}
+			});
+
+			std::vector<size_t> shardStart(WELD_SHARD_COUNT + 1, 0);
+			std::vector<size_t> chunkOffsets(chunkCount * WELD_SHARD_COUNT);
+			size_t offset = 0;
+			for (size_t shard = 0; shard < WELD_SHARD_COUNT; shard++)
+			{
+				shardStart[shard] = offset;
+				for (size_t chunk = 0; chunk < chunkCount; chunk++)
+				{
+					chunkOffsets[chunk * WELD_SHARD_COUNT + shard] = offset;
+					offset += chunkCounts[chunk * WELD_SHARD_COUNT + shard];
+				}
+			}
+			shardStart[WELD_SHARD_COUNT] = offset;
+
+			std::vector<uint32_t> shardCorners(cornerCount);
+			ParallelFor(scheduler, 0, chunkCount, 1, [&](const size_t chunk)
+			{
+				size_t* offsets = &chunkOffsets[chunk * WELD_SHARD_COUNT];
+				for (size_t i = chunk * chunkSize; i < std::min(cornerCount, (chunk + 1) * chunkSize); i++)
+					shardCorners[offsets[shardOf[i]]++] = static_cast<uint32_t>(i);
+			});
+
+			// Every corner points at the first corner with its position, which collects the normals
+			std::vector<uint32_t> firstCorner(cornerCount);
+			std::vector<glm::vec3> normalSums(cornerCount);
+			ParallelFor(scheduler, 0, WELD_SHARD_COUNT, 1, [&](const size_t shard)
+			{
+				std::unordered_map<glm::vec3, uint32_t, std::hash<glm::vec3>> pointToCorner;
+				pointToCorner.reserve(shardStart[shard + 1] - shardStart[shard]);
+				for (size_t i = shardStart[shard]; i < shardStart[shard + 1]; i++)
+				{
+					const uint32_t corner = shardCorners[i];
+					const auto [iterator, inserted] = pointToCorner.emplace(corners[corner], corner);
+					firstCorner[corner] = iterator->second;
+					if (inserted) normalSums[corner] = triangleNormals[corner / 3];
+					else normalSums[iterator->second] = normalSums[iterator->second] + triangleNormals[corner / 3];
+				}
+			});
+
+			std::vector<uint32_t> vertexIndex(cornerCount);
+			uint32_t vertexCount = 0;
+			for (size_t i = 0; i < cornerCount; i++)
+				if (firstCorner[i] == i) vertexIndex[i] = vertexCount++;
+
+			MeshData data;
+			data.vertices.resize(vertexCount);
+			data.indices.resize(cornerCount);
+			ParallelFor(scheduler, 0, cornerCount, STL_PARSE_GRAIN, [&](const size_t i)
+			{
+				data.indices[i] = vertexIndex[firstCorner[i]];
+				if (firstCorner[i] == i)
+					data.vertices[vertexIndex[i]] = MeshPt{ corners[i], glm::normalize(normalSums[i]) };
+			});
+			return data;
+		}
+
+		// Binary STL: 80 byte header, uint32 triangle count, then per triangle 12 floats and a uint16 attribute
+		inline bool ParseBinarySTL(const char* data, const size_t size, std::vector<glm::vec3>& corners,
+		                           std::vector<glm::vec3>& triangleNormals, TaskScheduler& scheduler)
 		{
-			is.read(reinterpret_cast<char*>(&tempPt.position), sizeof(glm::vec3));
-			is.read(reinterpret_cast<char*>(&tempPt.normal), sizeof(glm::vec3));
-			vertices.emplace_back(tempPt);
+			uint32_t triangleCount;
+			std::memcpy(&triangleCount, data + 80, sizeof(triangleCount));
+			if ((size - 84) / 50 < triangleCount) return false;
+
+			corners.resize(static_cast<size_t>(triangleCount) * 3);
+			triangleNormals.resize(triangleCount);
+			ParallelFor(scheduler, 0, (triangleCount + STL_PARSE_GRAIN - 1) / STL_PARSE_GRAIN, 1, [&](const size_t block)
+			{
+				const size_t end = std::min<size_t>(triangleCount, (block + 1) * STL_PARSE_GRAIN);
+				for (size_t t = block * STL_PARSE_GRAIN; t < end; t++)
+				{
+					const char* triangle = data + 84 + t * 50;
+					std::memcpy(&triangleNormals[t], triangle, sizeof(glm::vec3));
+					std::memcpy(&corners[t * 3], triangle + sizeof(glm::vec3), 3 * sizeof(glm::vec3));
+				}
+			});
+			return true;
 		}
 
-		// Read index information
-		unsigned int tempIndex;
-		std::vector<unsigned int> indices;
-		indices.reserve(indexAmount);
-		for (int i = 0; i < static_cast<int>(indexAmount); i++)
+		inline const char* SkipSpace(const char* p, const char* end)
 		{
-			is.read(reinterpret_cast<char*>(&tempIndex), sizeof(unsigned int));
-			indices.push_back(tempIndex);
+			while (p < end && std::isspace(static_cast<unsigned char>(*p))) ++p;
+			return p;
 		}
-		is.close();
 
-		return MeshData{ vertices, indices };
+		// Reads a whitespace separated word, returns false at the end of the file
+		inline bool ReadWord(const char*& p, const char* end, std::string_view& word)
+		{
+			p = SkipSpace(p, end);
+			const char* start = p;
+			while (p < end && !std::isspace(static_cast<unsigned char>(*p))) ++p;
+			word = std::string_view(start, static_cast<size_t>(p - start));
+			return !word.empty();
+		}
+
+		inline bool ReadVec3(const char*& p, const char* end, glm::vec3& value)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				p = SkipSpace(p, end);
+				if (p < end && *p == '+') ++p;
+				const auto [next, error] = std::from_chars(p, end, value[i]);
+				if (error != std::errc()) return false;
+				p = next;
+			}
+			return true;
+		}
+
+		// ASCII STL, streamed word by word: only "facet normal" and "vertex" lines carry data
+		// Facets with more than three vertices are fanned into triangles
+		inline bool ParseAsciiSTL(const char* data, const size_t size, std::vector<glm::vec3>& corners,
+		                          std::vector<glm::vec3>& triangleNormals)
+		{
+			const char* p = data;
+			const char* end = data + size;
+
+			glm::vec3 normal(0.0f);
+			glm::vec3 facet[3];
+			int facetVertices = 0;
+
+			std::string_view word;
+			while (ReadWord(p, end, word))
+			{
+				if (word == "facet")
+				{
+					if (!ReadWord(p, end, word) || word != "normal" || !ReadVec3(p, end, normal)) return false;
+					facetVertices = 0;
+				}
+				else if (word == "vertex")
+				{
+					glm::vec3 position;
+					if (!ReadVec3(p, end, position)) return false;
+					if (facetVertices < 3) facet[facetVertices] = position;
+					else facet[1] = facet[2], facet[2] = position;
+					facetVertices++;
+
+					if (facetVertices >= 3)
+					{
+						corners.insert(corners.end(), facet, facet + 3);
+						triangleNormals.push_back(normal);
+					}
+				}
+			}
+			return true;
+		}
+
+		// Binary files may start with "solid" too, a size matching the triangle count settles it
+		inline bool IsAsciiSTL(const char* data, const size_t size)
+		{
+			if (size < 5 || std::memcmp(data, "solid", 5) != 0) return false;
+			if (size < 84) return true;
+
+			uint32_t triangleCount;
+			std::memcpy(&triangleCount, data + 80, sizeof(triangleCount));
+			return size != 84 + static_cast<size_t>(triangleCount) * 50;
+		}
+	}
+
+	// Reads a binary or ASCII STL file and welds corners that share a position into one vertex
+	// The file is mapped instead of read, parsing and welding run on the scheduler
+	// The result is reordered for the vertex cache, STL triangle order is arbitrary
+	// Returns empty data if the file can't be read or is malformed
+	static MeshData ReadSTL(const char* filepath, TaskScheduler& scheduler)
+	{
+		// STL File format: https://people.sc.fsu.edu/~jburkardt/data/stlb/stlb.html
+		const MappedFile file(filepath);
+		if (!file.IsOpen())
+		{
+			LOG(LOG_ERROR) << "Can't read STL file " << filepath << "\n";
+			return {};
+		}
+
+		std::vector<glm::vec3> corners;
+		std::vector<glm::vec3> triangleNormals;
+		const bool parsed = Detail::IsAsciiSTL(file.Data(), file.Size()) ?
+			Detail::ParseAsciiSTL(file.Data(), file.Size(), corners, triangleNormals) :
+			file.Size() >= 84 && Detail::ParseBinarySTL(file.Data(), file.Size(), corners, triangleNormals, scheduler);
+		if (!parsed)
+		{
+			LOG(LOG_ERROR) << "Malformed STL file " << filepath << "\n";
+			return {};
+		}
+
+		MeshData data = Detail::WeldCorners(corners, triangleNormals, scheduler);
+		OptimizeMesh(data);
+		return data;
+	}
+
+	// Reads a packed mesh file, either format described in PackedMesh.h, into vectors with one copy per array
+	// Use PackedMesh directly to skip even that copy
+	static MeshData ReadPackedSTL(const char* filepath)
+	{
+		const PackedMesh mesh(filepath);
+		return mesh.GetView().ToMeshData();
 	}
 }
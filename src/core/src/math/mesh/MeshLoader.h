@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MeshCache.h"
+#include "MeshImport.h"
+#include "MeshSimplify.h"
+#include "utils/Logger.h"
+#include "utils/PathUtils.h"
+#include "utils/TaskScheduler.h"
+
+// Loads meshes on the task scheduler's workers
+// Reading, parsing, welding, building the static tree and simplifying all happen in a task, so any number of meshes load at the
+// same time. Whoever waits on a handle gets plain data back and does the GL upload on its own thread.
+namespace Utils
+{
+	struct MeshLoadOptions
+	{
+		bool isStl = false;
+		// Also loads or builds the static tree through the mesh cache
+		bool buildTree = false;
+		Physics::StaticTreeBuildOptions treeOptions;
+		// Simplified levels to generate below the full mesh, each with about half the triangles of the one before
+		// Packed files that have levels from MeshConverter --lods next to them use those instead
+		size_t lodCount = 0;
+	};
+
+	// Future for a mesh started by MeshLoader::Load, cheap to copy, every copy refers to the same load
+	class MeshLoadHandle
+	{
+	public:
+		MeshLoadHandle() = default;
+
+		bool IsValid() const { return mState != nullptr; }
+		// True once the load finished, Wait returns right away then
+		bool IsReady() const { return mState && mState->ready.load(std::memory_order_acquire); }
+
+		// Runs queued tasks on the calling thread until this load has finished, then returns its result
+		// A failed load returns empty data and no tree. Must not be called from inside a scheduler task that the
+		// load itself is waiting on
+		const CachedMesh& Wait() const;
+
+		const std::string& GetFilename() const { return mState->filename; }
+
+	private:
+		friend class MeshLoader;
+
+		struct State
+		{
+			State(std::string filename, TaskScheduler& scheduler) : filename(std::move(filename)), group(scheduler) {}
+
+			std::string filename;
+			std::atomic<bool> ready{ false };
+			// Only written by the task, only read after ready is set
+			CachedMesh mesh;
+			// Declared last so it is destroyed first, waiting for the task before the members it writes go away
+			TaskGroup group;
+		};
+
+		std::shared_ptr<State> mState;
+	};
+
+	class MeshLoader
+	{
+	public:
+		explicit MeshLoader(TaskScheduler& scheduler) : mScheduler(scheduler) {}
+
+		// Starts loading filename from res/models/ and returns immediately
+		MeshLoadHandle Load(const std::string& filename, const MeshLoadOptions& options = {});
+
+		// Waits for every load started since the last call, so a scene can start all of them and wait once
+		void WaitAll();
+
+		size_t GetPendingCount() const { return mPending.size(); }
+
+	private:
+		TaskScheduler& mScheduler;
+		std::vector<MeshLoadHandle> mPending;
+	};
+
+
+	inline const CachedMesh& MeshLoadHandle::Wait() const
+	{
+		if (!mState->ready.load(std::memory_order_acquire))
+			mState->group.Wait();
+		return mState->mesh;
+	}
+
+	inline MeshLoadHandle MeshLoader::Load(const std::string& filename, const MeshLoadOptions& options)
+	{
+		MeshLoadHandle handle;
+		handle.mState = std::make_shared<MeshLoadHandle::State>(filename, mScheduler);
+
+		// The task holds a raw pointer, the state can't go away before it finishes because its group waits on it
+		MeshLoadHandle::State* state = handle.mState.get();
+		state->group.Run([state, options, &scheduler = mScheduler]
+		{
+			const std::string filepath = GetResourcePath("/res/models/", state->filename);
+			try
+			{
+				if (options.buildTree)
+					state->mesh = LoadMeshCached(filepath, options.isStl, scheduler, options.treeOptions);
+				else
+					state->mesh.data = options.isStl ? ReadSTL(filepath.c_str(), scheduler) : ReadPackedSTL(filepath.c_str());
+
+				if (!options.isStl) state->mesh.lods = ReadPackedLODs(filepath);
+
+				if (state->mesh.lods.empty() && options.lodCount > 0 && !state->mesh.data.indices.empty())
+				{
+					state->mesh.lods = BuildLODChain(state->mesh.data, options.lodCount + 1);
+					// The chain starts with the full mesh, which is already in data
+					state->mesh.lods.erase(state->mesh.lods.begin());
+					for (MeshData& lod : state->mesh.lods) OptimizeMesh(lod);
+				}
+			}
+			catch (const std::exception& e)
+			{
+				LOG(LOG_ERROR) << "Failed to load mesh " << state->filename << ": " << e.what() << "\n";
+				state->mesh = CachedMesh{};
+			}
+
+			if (state->mesh.data.indices.empty() || state->mesh.data.vertices.empty())
+				LOG(LOG_ERROR) << "Failed to load mesh: " << state->filename << "\n";
+			else
+				LOG(LOG_INFO) << "Loaded mesh: " << state->filename << " with " << state->mesh.data.vertices.size() <<
+					" vertices and " << state->mesh.data.indices.size() << " indices\n";
+
+			state->ready.store(true, std::memory_order_release);
+		});
+
+		mPending.push_back(handle);
+		return handle;
+	}
+
+	inline void MeshLoader::WaitAll()
+	{
+		for (const MeshLoadHandle& handle : mPending)
+			handle.Wait();
+		mPending.clear();
+	}
+}
@@ -0,0 +1,337 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/vector_double3.hpp>
+#include "core/GlobalTypes.h"
+#include "utils/Logger.h"
+
+// Reorders meshes for the GPU without changing what they look like
+// Triangles go in the order Tipsify picks for the post transform vertex cache, vertices in the order the triangles first
+// use them, so both the cache and the vertex fetch see mostly consecutive data
+// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (2007)
+namespace Utils
+{
+	// Post transform cache size Tipsify plans for, about what current GPUs keep
+	constexpr size_t VERTEX_CACHE_SIZE = 16;
+
+	struct MeshOptimizeOptions
+	{
+		size_t cacheSize = VERTEX_CACHE_SIZE;
+		// Draws outward facing clusters of triangles first, so they hide the rest. Costs a little cache locality
+		bool reduceOverdraw = true;
+	};
+
+	// Average cache miss ratio, transformed vertices per triangle with a FIFO cache of cacheSize. 0.5 is the ideal for
+	// large closed meshes, 3 means every corner is transformed again
+	inline float CalculateACMR(const GLuint* indices, size_t indexCount, size_t vertexCount, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+	// Tipsify: returns the triangles of indices in cache friendly order. With clusterStarts set, also returns where
+	// the order had to jump to unrelated triangles, in indices, for OptimizeOverdraw
+	inline std::vector<GLuint> OptimizeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount,
+	                                               size_t cacheSize = VERTEX_CACHE_SIZE, std::vector<size_t>* clusterStarts = nullptr);
+
+	// Sorts the clusters from OptimizeVertexCache so the ones facing away from the mesh's center come first
+	inline void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<MeshPt>& vertices, const std::vector<size_t>& clusterStarts);
+
+	// Renumbers vertices in the order the indices first use them and drops unused ones
+	inline void OptimizeVertexFetch(MeshData& data);
+
+	// All of the above, logs the ACMR before and after
+	inline void OptimizeMesh(MeshData& data, const MeshOptimizeOptions& options = {});
+
+	// 12 byte vertex: positions as 16 bit fractions of the bounding box, normals in GL_INT_2_10_10_10_REV layout
+	struct QuantizedMeshPt
+	{
+		uint16_t position[3];
+		uint16_t padding;
+		uint32_t normal;
+	};
+
+	struct QuantizedMesh
+	{
+		std::vector<QuantizedMeshPt> vertices;
+		std::vector<GLuint> indices;
+		// position = offset + scale * quantized
+		glm::vec3 offset = glm::vec3(0.0f);
+		glm::vec3 scale = glm::vec3(0.0f);
+
+		MeshData ToMeshData() const;
+	};
+
+	// Packs a unit vector into 10 signed bits per component, w left at 0
+	inline uint32_t PackNormal(const glm::vec3& normal);
+	inline glm::vec3 UnpackNormal(uint32_t packed);
+
+	// Positions are off by at most half a step, 1/131070 of the box size, normals by about 1/1022
+	inline QuantizedMesh QuantizeMesh(const MeshView& mesh);
+
+
+	inline float CalculateACMR(const GLuint* indices, const size_t indexCount, const size_t vertexCount, const size_t cacheSize)
+	{
+		const size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) return 0.0f;
+
+		// A vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+		std::vector<size_t> loadedAt(vertexCount, 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < triangleCount * 3; i++)
+		{
+			const GLuint v = indices[i];
+			if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+				loadedAt[v] = ++misses;
+		}
+		return static_cast<float>(misses) / static_cast<float>(triangleCount);
+	}
+
+	inline std::vector<GLuint> OptimizeVertexCache(const GLuint* indices, const size_t indexCount, const size_t vertexCount,
+	                                               const size_t cacheSize, std::vector<size_t>* clusterStarts)
+	{
+		constexpr uint32_t NONE = UINT32_MAX;
+		const size_t triangleCount = indexCount / 3;
+
+		std::vector<GLuint> result;
+		result.reserve(triangleCount * 3);
+		if (clusterStarts) clusterStarts->assign(triangleCount > 0 ? 1 : 0, 0);
+		if (triangleCount == 0) return result;
+
+		// Triangles around every vertex, and how many of them are still to be emitted
+		std::vector<uint32_t> offsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) offsets[indices[i] + 1]++;
+		std::vector<uint32_t> live(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			live[v] = offsets[v + 1];
+			offsets[v + 1] += offsets[v];
+		}
+		std::vector<uint32_t> adjacency(triangleCount * 3);
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < triangleCount * 3; i++) adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// Time stamps count cache loads, a vertex is cached while fewer than cacheSize loads happened since its own
+		std::vector<uint32_t> cachedAt(vertexCount, 0);
+		uint32_t time = static_cast<uint32_t>(cacheSize) + 1;
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> deadEnds;
+		std::vector<uint32_t> candidates;
+		size_t scan = 0;
+
+		uint32_t fanning = indices[0];
+		while (fanning != NONE)
+		{
+			// Emits every remaining triangle around the fanning vertex
+			candidates.clear();
+			for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+			{
+				const uint32_t t = adjacency[a];
+				if (emitted[t]) continue;
+				emitted[t] = true;
+
+				for (int c = 0; c < 3; c++)
+				{
+					const GLuint v = indices[t * 3 + c];
+					result.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cachedAt[v] > cacheSize) cachedAt[v] = time++;
+				}
+			}
+
+			// Next fan: the candidate that stays in the cache the longest while its remaining triangles are emitted
+			fanning = NONE;
+			int64_t bestPriority = -1;
+			for (const uint32_t v : candidates)
+			{
+				if (live[v] == 0) continue;
+				int64_t priority = 0;
+				if (time - cachedAt[v] + 2 * live[v] <= cacheSize) priority = time - cachedAt[v];
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					fanning = v;
+				}
+			}
+			if (fanning != NONE) continue;
+
+			// Nothing useful left around here, back to the latest vertex with triangles left, else the next one in order
+			while (!deadEnds.empty() && fanning == NONE)
+			{
+				if (live[deadEnds.back()] > 0) fanning = deadEnds.back();
+				deadEnds.pop_back();
+			}
+			for (; scan < vertexCount && fanning == NONE; scan++)
+				if (live[scan] > 0) fanning = static_cast<uint32_t>(scan);
+
+			if (clusterStarts && fanning != NONE) clusterStarts->push_back(result.size());
+		}
+		return result;
+	}
+
+	inline void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<MeshPt>& vertices, const std::vector<size_t>& clusterStarts)
+	{
+		const size_t clusterCount = clusterStarts.size();
+		if (clusterCount < 2) return;
+
+		// Area weighted centroid of the whole mesh
+		glm::dvec3 meshCenter(0.0);
+		double meshArea = 0.0;
+		std::vector<glm::dvec3> clusterCenters(clusterCount, glm::dvec3(0.0));
+		std::vector<glm::dvec3> clusterNormals(clusterCount, glm::dvec3(0.0));
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			const size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : indices.size();
+			double clusterArea = 0.0;
+			for (size_t i = clusterStarts[c]; i < end; i += 3)
+			{
+				const glm::dvec3 p0 = vertices[indices[i]].position;
+				const glm::dvec3 p1 = vertices[indices[i + 1]].position;
+				const glm::dvec3 p2 = vertices[indices[i + 2]].position;
+				const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+				const double area = glm::length(cross) * 0.5;
+
+				clusterCenters[c] += (p0 + p1 + p2) * (area / 3.0);
+				clusterNormals[c] += cross;
+				clusterArea += area;
+			}
+			meshCenter += clusterCenters[c];
+			meshArea += clusterArea;
+			if (clusterArea > 0.0) clusterCenters[c] /= clusterArea;
+		}
+		if (meshArea <= 0.0) return;
+		meshCenter /= meshArea;
+
+		// Occlusion potential: how far out the cluster sits along its own normal, those are likely to cover the rest
+		std::vector<double> potential(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			const double length = glm::length(clusterNormals[c]);
+			potential[c] = length > 0.0 ? glm::dot(clusterCenters[c] - meshCenter, clusterNormals[c] / length) : 0.0;
+		}
+
+		std::vector<size_t> order(clusterCount);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&potential](const size_t a, const size_t b) { return potential[a] > potential[b]; });
+
+		std::vector<GLuint> sorted;
+		sorted.reserve(indices.size());
+		for (const size_t c : order)
+		{
+			const size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : indices.size();
+			sorted.insert(sorted.end(), indices.begin() + static_cast<std::ptrdiff_t>(clusterStarts[c]),
+			              indices.begin() + static_cast<std::ptrdiff_t>(end));
+		}
+		indices = std::move(sorted);
+	}
+
+	inline void OptimizeVertexFetch(MeshData& data)
+	{
+		constexpr GLuint UNUSED = UINT32_MAX;
+		std::vector<GLuint> remap(data.vertices.size(), UNUSED);
+		std::vector<MeshPt> vertices;
+		vertices.reserve(data.vertices.size());
+
+		for (GLuint& index : data.indices)
+		{
+			if (remap[index] == UNUSED)
+			{
+				remap[index] = static_cast<GLuint>(vertices.size());
+				vertices.push_back(data.vertices[index]);
+			}
+			index = remap[index];
+		}
+		data.vertices = std::move(vertices);
+	}
+
+	inline void OptimizeMesh(MeshData& data, const MeshOptimizeOptions& options)
+	{
+		const size_t triangleCount = data.indices.size() / 3;
+		if (triangleCount == 0) return;
+		data.indices.resize(triangleCount * 3);
+
+		const float before = CalculateACMR(data.indices.data(), data.indices.size(), data.vertices.size(), options.cacheSize);
+
+		std::vector<size_t> clusterStarts;
+		data.indices = OptimizeVertexCache(data.indices.data(), data.indices.size(), data.vertices.size(), options.cacheSize,
+		                                   options.reduceOverdraw ? &clusterStarts : nullptr);
+		if (options.reduceOverdraw) OptimizeOverdraw(data.indices, data.vertices, clusterStarts);
+		OptimizeVertexFetch(data);
+
+		const float after = CalculateACMR(data.indices.data(), data.indices.size(), data.vertices.size(), options.cacheSize);
+		LOG(LOG_INFO) << "Optimized mesh with " << triangleCount << " triangles, ACMR " << before << " -> " << after << "\n";
+	}
+
+	inline uint32_t PackNormal(const glm::vec3& normal)
+	{
+		auto component = [](const float value)
+		{
+			const auto quantized = static_cast<int32_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 511.0f));
+			return static_cast<uint32_t>(quantized) & 0x3FFu;
+		};
+		return component(normal.x) | component(normal.y) << 10 | component(normal.z) << 20;
+	}
+
+	inline glm::vec3 UnpackNormal(const uint32_t packed)
+	{
+		auto component = [packed](const int shift)
+		{
+			// Shifts the 10 bits to the top and back down to sign extend them
+			const int32_t value = static_cast<int32_t>(packed << (22 - shift)) >> 22;
+			return std::max(static_cast<float>(value) / 511.0f, -1.0f);
+		};
+		return glm::vec3(component(0), component(10), component(20));
+	}
+
+	inline QuantizedMesh QuantizeMesh(const MeshView& mesh)
+	{
+		QuantizedMesh quantized;
+		quantized.indices.assign(mesh.indices, mesh.indices + mesh.indexCount);
+		if (mesh.vertexCount == 0) return quantized;
+
+		glm::vec3 min = mesh.vertices[0].position;
+		glm::vec3 max = min;
+		for (size_t v = 0; v < mesh.vertexCount; v++)
+		{
+			min = glm::min(min, mesh.vertices[v].position);
+			max = glm::max(max, mesh.vertices[v].position);
+		}
+		quantized.offset = min;
+		quantized.scale = (max - min) / 65535.0f;
+
+		quantized.vertices.resize(mesh.vertexCount);
+		for (size_t v = 0; v < mesh.vertexCount; v++)
+		{
+			QuantizedMeshPt& point = quantized.vertices[v];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const float extent = max[axis] - min[axis];
+				const float fraction = extent > 0.0f ? (mesh.vertices[v].position[axis] - min[axis]) / extent : 0.0f;
+				point.position[axis] = static_cast<uint16_t>(std::round(std::clamp(fraction, 0.0f, 1.0f) * 65535.0f));
+			}
+			point.padding = 0;
+			point.normal = PackNormal(mesh.vertices[v].normal);
+		}
+		return quantized;
+	}
+
+	inline MeshData QuantizedMesh::ToMeshData() const
+	{
+		MeshData data;
+		data.indices = indices;
+		data.vertices.resize(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			const QuantizedMeshPt& point = vertices[v];
+			data.vertices[v].position = offset + scale * glm::vec3(point.position[0], point.position[1], point.position[2]);
+			data.vertices[v].normal = UnpackNormal(point.normal);
+		}
+		return data;
+	}
+}
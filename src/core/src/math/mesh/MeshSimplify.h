@@ -1,176 +1,553 @@
 #pragma once
-#include <filesystem>
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
 #include <queue>
-
+#include <vector>
 
 #include <glm/vec3.hpp>
 #include <glm/geometric.hpp>
-#include <glm/gtx/hash.hpp>
+#include <glm/ext/vector_double3.hpp>
 #include "core/GlobalTypes.h"
 #include "MeshProcessing.h"
 
-// https://users.csc.calpoly.edu/~zwood/teaching/csc570/final06/jseeba/
+// Quadric error simplification after Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics" (1997)
+// https://www.cs.cmu.edu/~garland/Papers/quadrics.pdf
+// Every vertex sums the planes of its triangles into a quadric, collapsing an edge costs the squared distance of the
+// new point to all the planes of both ends. The cheapest edge comes off a heap, stale entries are skipped when popped.
 namespace Utils
 {
-// 	inline MeshData DecimateMesh(const MeshData& inputData, size_t targetVertexCount)
-// 	{
-// 		const float threshold = 0;
-//
-// 		// Quadric for each triangle
-// 		// TODO: Make more storage efficient (quadric matrix is symmetrical along diagonal)
-// 		std::vector<glm::mat4> quadrics(inputData.indices.size() / 3);
-//
-// 		// Every two indices is a pair
-// 		std::vector<size_t> pairs(inputData.indices.size() * 2);
-//
-// 		// Calculate quadric for each triangle
-// 		// https://math.stackexchange.com/questions/2686606/equation-of-a-plane-passing-through-3-points
-// 		for (size_t i = 0; i < inputData.indices.size(); i += 3)
-// 		{
-// 			// Add all edges of the triangle to the pairs list (triIdxOffset is defined in MeshProcessing.h)
-// 			// TODO: Organize files better
-// 			for (size_t j = 0; j < 6; j++)
-// 				pairs[i * 2 + j] = inputData.indices[i + triIdxOffset[j]];
-//
-// 			// Every 3 indices is a triangle
-// 			glm::vec3 v1 = inputData.vertices[inputData.indices[i + 0]].position;
-// 			glm::vec3 v2 = inputData.vertices[inputData.indices[i + 1]].position;
-// 			glm::vec3 v3 = inputData.vertices[inputData.indices[i + 2]].position;
-//
-// 			// Get two edges of the triangle
-// 			glm::vec3 edge1 = v2 - v1;
-// 			glm::vec3 edge2 = v3 - v1;
-//
-// 			// Calculate triangle normal
-// 			glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
-//
-// 			// Calculate offset or "d" in plane equation using one of the vertices
-// 			float offset = -glm::dot(v1, normal);
-//
-// 			// Plane equation format is ax + by + cz + d where a^2 + b^2 + c^2 = 1
-// 			auto a = normal.x;
-// 			auto b = normal.y;
-// 			auto c = normal.z;
-// 			auto d = offset;
-//
-// 			// Based on plane equation, calculate quadric matrix for triangle
-// 			quadrics[i / 3] = glm::mat4
-// 			{
-// 				a * a, a * b, a * c, a * d,
-// 				a * b, b * b, b * c, b * d,
-// 				a * c, b * c, c * c, c * d,
-// 				a * d, b * d, c * d, d * d
-// 			};
-// 		}
-//
-// 		// Accumulate quadric for every vertice of all the quadrics of the triangles it is a part of
-// 		std::vector<glm::mat4> verticeQuadrics(inputData.vertices.size(), glm::mat4(0));
-// 		for (size_t i = 0; i < inputData.indices.size(); ++i)
-// 		{
-// 			// Add current triangle's quadric to each vertex's quadric accumulation
-// 			verticeQuadrics[inputData.indices[i]] += quadrics[i / 3];
-// 		}
-//
-// 		// Calculate error for each pair of vertices
-// 		typedef std::pair<float, size_t> errorPair;
-// 		std::priority_queue <errorPair, std::vector<errorPair>, std::greater<>> errors;
-// 		std::vector<glm::vec3> contractionPoints;
-// 		for (size_t i = 0; i < pairs.size(); i += 2)
-// 		{
-// 			glm::mat4 q = verticeQuadrics[pairs[i]];
-//
-// 			glm::mat4 temp =
-// 			{
-// 				q[0][0], q[0][1], q[0][2], q[0][3],
-// 				q[1][0], q[1][1], q[1][2], q[1][3],
-// 				q[2][0], q[2][1], q[2][2], q[2][3],
-// 				0, 0, 0, 1
-// 			};
-//
-// 			//assert(glm::determinant(temp) != 0);
-//
-// 			glm::vec3 contractionPoint = glm::vec4(0, 0, 0, 1) * glm::inverse(temp);
-// 			contractionPoints.push_back(contractionPoint);
-//
-// 			float error = glm::dot(glm::vec4(contractionPoint, 1.0f) * q, glm::vec4(contractionPoint, 1.0f)); // TODO: check algorithm
-// 			errors.push(std::make_pair(error, i));
-// 		}
-//
-// 		std::cout << errors.top().first << std::endl;
-//
-// 		auto outputData = inputData;
-//
-// 		// Remove vertices until target vertex count is reached
-// 		for (size_t i = 0; i < inputData.vertices.size() - targetVertexCount; ++i)
-// 		{
-// 			// Get the pair with the lowest error
-// 			auto pair = errors.top();
-// 			errors.pop();
-//
-// 			// Get the two vertices of the pair
-// 			auto v1 = inputData.vertices[pairs[pair.second]];
-// 			auto v2 = inputData.vertices[pairs[pair.second + 1]];
-//
-// 			// Calculate the contraction point
-// 			glm::vec3 contractionPoint = contractionPoints[pair.second / 2];
-//
-// 			// Calculate the new vertex
-// 			MeshPt newVertex;
-// 			newVertex.position = contractionPoint;
-// 			newVertex.normal = glm::normalize(v1.normal + v2.normal);
-//
-// 			// Add the new vertex to the mesh
-// 			outputData.vertices.push_back(newVertex);
-//
-// 			// Update the indices
-// 			for (size_t j = 0; j < outputData.indices.size(); ++j)
-// 			{
-// 				if (outputData.indices[j] == pairs[pair.second + 1])
-// 					outputData.indices[j] = outputData.vertices.size() - 1;
-// 			}
-//
-// 			// Update the quadrics
-// 			verticeQuadrics.push_back(verticeQuadrics[pairs[pair.second]] + verticeQuadrics[pairs[pair.second + 1]]);
-//
-// 			// Update the pairs
-// 			for (size_t j = 0; j < pairs.size(); j += 2)
-// 			{
-// 				if (pairs[j] == pairs[pair.second + 1])
-// 					pairs[j] = inputData.vertices.size() - 1;
-// 			}
-//
-// 			// Update the errors
-// 			for (size_t j = 0; j < pairs.size(); j += 2)
-// 			{
-// 				glm::mat4 q = verticeQuadrics[pairs[j]];
-//
-// 				glm::mat4 temp =
-// 				{
-// 					q[0][0], q[0][1], q[0][2], q[0][3],
-// 					q[1][0], q[1][1], q[1][2], q[1][3],
-// 					q[2][0], q[2][1], q[2][2], q[2][3],
-// 					0, 0, 0, 1
-// 				};
-//
-// 				glm::vec3 contractionPoint = glm::vec4(0, 0, 0, 1) * glm::inverse(temp);
-// 			}
-//
-//
-//
-// 			/*glm::mat4 q = verticeQuadrics[pairs[errors.top().second]] + verticeQuadrics[pairs[errors.top().second + 1]];
-// 			glm::mat4 temp =
-// 			{
-// 				q[0][0], q[0][1], q[0][2], q[0][3],
-// 				q[1][0], q[1][1], q[1][2], q[1][3],
-// 				q[2][0], q[2][1], q[2][2], q[2][3],
-// 				0, 0, 0, 1
-// 			};
-//
-// 			glm::vec3 v = glm::vec4(0, 0, 0, 1) * glm::inverse(temp);
-//
-// 			std::cout << glm::to_string(v) << std::endl;*/
-// 		}
-// 	}
-}
\ No newline at end of file
+	struct SimplifyOptions
+	{
+		// Weight of the planes that hold open borders in place, relative to the triangles' own planes. 0 lets them shrink
+		float borderWeight = 100.0f;
+		// Collapses that would turn any triangle's normal further than this (cosine of the angle) are skipped
+		float minNormalDot = 0.2f;
+	};
+
+	// Collapses edges until at most targetTriangleCount triangles are left, or no collapse keeps the mesh valid
+	// Expects welded vertices, corners that only share a position count as separate vertices and tear apart
+	inline MeshData DecimateMesh(const MeshData& inputData, size_t targetTriangleCount, const SimplifyOptions& options = {});
+
+	// Coarser levels aren't worth a draw call of their own, BuildLODChain stops before going below this
+	constexpr size_t MIN_LOD_TRIANGLES = 8;
+
+	// Levels of detail from full detail down, each with about reduction times the triangles of the one before
+	// Index 0 is the input. Stops early once a level can't be reduced any further or would drop below MIN_LOD_TRIANGLES
+	inline std::vector<MeshData> BuildLODChain(const MeshData& inputData, size_t levelCount, float reduction = 0.5f,
+	                                           const SimplifyOptions& options = {});
+
+	namespace Detail
+	{
+		// Symmetric 4x4 matrix of a sum of planes, only the upper triangle is stored
+		// Doubles, because the error is a difference of large terms and floats lose it on big meshes
+		struct Quadric
+		{
+			double a2 = 0, ab = 0, ac = 0, ad = 0;
+			double b2 = 0, bc = 0, bd = 0;
+			double c2 = 0, cd = 0;
+			double d2 = 0;
+
+			// Plane n.p + d = 0 with unit normal n
+			static Quadric FromPlane(const glm::dvec3& n, const double d, const double weight)
+			{
+				Quadric q;
+				q.a2 = weight * n.x * n.x; q.ab = weight * n.x * n.y; q.ac = weight * n.x * n.z; q.ad = weight * n.x * d;
+				q.b2 = weight * n.y * n.y; q.bc = weight * n.y * n.z; q.bd = weight * n.y * d;
+				q.c2 = weight * n.z * n.z; q.cd = weight * n.z * d;
+				q.d2 = weight * d * d;
+				return q;
+			}
+
+			Quadric& operator+=(const Quadric& other)
+			{
+				a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+				b2 += other.b2; bc += other.bc; bd += other.bd;
+				c2 += other.c2; cd += other.cd;
+				d2 += other.d2;
+				return *this;
+			}
+
+			Quadric operator+(const Quadric& other) const
+			{
+				Quadric sum = *this;
+				return sum += other;
+			}
+
+			// Weighted sum of squared distances from p to the planes
+			double Evaluate(const glm::dvec3& p) const
+			{
+				return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x +
+				       b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y +
+				       c2 * p.z * p.z + 2 * cd * p.z + d2;
+			}
+
+			// Point with the smallest error, false if the planes don't pin one down (flat or straight surroundings)
+			bool Minimize(glm::dvec3& p) const
+			{
+				// Cramer's rule on the upper 3x3 block
+				const double c00 = b2 * c2 - bc * bc;
+				const double c01 = ac * bc - ab * c2;
+				const double c02 = ab * bc - ac * b2;
+				const double det = a2 * c00 + ab * c01 + ac * c02;
+
+				const double scale = std::max({ a2, b2, c2 });
+				if (std::abs(det) <= 1e-12 * scale * scale * scale) return false;
+
+				const double c11 = a2 * c2 - ac * ac;
+				const double c12 = ab * ac - a2 * bc;
+				const double c22 = a2 * b2 - ab * ab;
+				p = -glm::dvec3(c00 * ad + c01 * bd + c02 * cd,
+				                c01 * ad + c11 * bd + c12 * cd,
+				                c02 * ad + c12 * bd + c22 * cd) / det;
+				return true;
+			}
+		};
+
+		class QuadricSimplifier
+		{
+		public:
+			QuadricSimplifier(const MeshData& inputData, const SimplifyOptions& options);
+
+			// Collapses edges until at most targetTriangleCount triangles are left
+			// Returns false if it ran out of valid collapses first. Can be called again with a lower target
+			bool Simplify(size_t targetTriangleCount);
+
+			size_t GetTriangleCount() const { return mLiveTriangles; }
+			// Largest error of any collapse so far
+			double GetMaxError() const { return mMaxError; }
+
+			// Current mesh with only the vertices still in use, normals recomputed from the remaining triangles
+			MeshData Extract() const;
+
+		private:
+			// Heap entry, stale once either vertex changed after it was pushed
+			struct Candidate
+			{
+				double error;
+				uint32_t keep, remove;
+				uint32_t keepVersion, removeVersion;
+				glm::vec3 position;
+
+				bool operator>(const Candidate& other) const { return error > other.error; }
+			};
+
+			SimplifyOptions mOptions;
+			std::vector<glm::vec3> mPositions;
+			std::vector<Quadric> mQuadrics;
+			std::vector<uint32_t> mVersions;
+			std::vector<bool> mRemoved;
+			// Triangles around each vertex, may still list triangles that have collapsed since
+			std::vector<std::vector<uint32_t>> mVertexTriangles;
+
+			std::vector<uint32_t> mIndices;
+			std::vector<bool> mTriangleRemoved;
+			size_t mLiveTriangles = 0;
+			double mMaxError = 0;
+
+			std::priority_queue<Candidate, std::vector<Candidate>, std::greater<>> mHeap;
+
+			// Scratch for Collapse, kept to avoid allocating per collapse
+			std::vector<uint32_t> mKeepNeighbors, mRemoveNeighbors;
+
+			void SplitPinchedVertices();
+			Candidate MakeCandidate(uint32_t a, uint32_t b) const;
+			bool Collapse(const Candidate& candidate);
+			bool IsLinkValid(uint32_t keep, uint32_t remove);
+			bool KeepsOrientation(uint32_t vertex, uint32_t other, const glm::vec3& position) const;
+			void CollectNeighbors(uint32_t vertex, std::vector<uint32_t>& neighbors) const;
+			void PruneTriangles(uint32_t vertex);
+
+			bool HasVertex(const uint32_t triangle, const uint32_t vertex) const
+			{
+				return mIndices[triangle * 3] == vertex || mIndices[triangle * 3 + 1] == vertex || mIndices[triangle * 3 + 2] == vertex;
+			}
+		};
+
+		inline QuadricSimplifier::QuadricSimplifier(const MeshData& inputData, const SimplifyOptions& options) :
+			mOptions(options), mIndices(inputData.indices)
+		{
+			const size_t vertexCount = inputData.vertices.size();
+			const size_t triangleCount = mIndices.size() / 3;
+			mIndices.resize(triangleCount * 3);
+
+			mPositions.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++) mPositions[i] = inputData.vertices[i].position;
+			mVertexTriangles.resize(vertexCount);
+			mTriangleRemoved.assign(triangleCount, false);
+			mLiveTriangles = triangleCount;
+
+			// Triangles that repeat a corner have no edges worth collapsing and would confuse the adjacency
+			for (uint32_t t = 0; t < triangleCount; t++)
+			{
+				const uint32_t* corners = &mIndices[t * 3];
+				if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+				{
+					mTriangleRemoved[t] = true;
+					mLiveTriangles--;
+					continue;
+				}
+				for (int c = 0; c < 3; c++) mVertexTriangles[corners[c]].push_back(t);
+			}
+			SplitPinchedVertices();
+			mQuadrics.resize(mPositions.size());
+			mVersions.assign(mPositions.size(), 0);
+			mRemoved.assign(mPositions.size(), false);
+
+			// Each triangle's plane goes to its corners, weighted by area so tiny triangles don't dominate
+			std::vector<uint64_t> edges;
+			edges.reserve(triangleCount * 3);
+			for (uint32_t t = 0; t < triangleCount; t++)
+			{
+				if (mTriangleRemoved[t]) continue;
+				const glm::dvec3 p0 = mPositions[mIndices[t * 3]];
+				const glm::dvec3 p1 = mPositions[mIndices[t * 3 + 1]];
+				const glm::dvec3 p2 = mPositions[mIndices[t * 3 + 2]];
+				const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+				const double length = glm::length(cross);
+
+				if (length > 0)
+				{
+					const glm::dvec3 normal = cross / length;
+					const Quadric q = Quadric::FromPlane(normal, -glm::dot(normal, p0), length * 0.5);
+					for (int c = 0; c < 3; c++) mQuadrics[mIndices[t * 3 + c]] += q;
+				}
+
+				for (int c = 0; c < 3; c++)
+				{
+					const uint32_t a = mIndices[t * 3 + triIdxOffset[c * 2]];
+					const uint32_t b = mIndices[t * 3 + triIdxOffset[c * 2 + 1]];
+					edges.push_back(static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b));
+				}
+			}
+
+			// Edges with a single triangle are open borders, a plane standing on the edge keeps them from drifting
+			std::sort(edges.begin(), edges.end());
+			for (size_t i = 0; i < edges.size();)
+			{
+				size_t end = i + 1;
+				while (end < edges.size() && edges[end] == edges[i]) end++;
+
+				const auto a = static_cast<uint32_t>(edges[i] >> 32);
+				const auto b = static_cast<uint32_t>(edges[i]);
+				if (end - i == 1 && mOptions.borderWeight > 0)
+				{
+					for (const uint32_t t : mVertexTriangles[a])
+					{
+						if (!HasVertex(t, b)) continue;
+
+						const glm::dvec3 p0 = mPositions[mIndices[t * 3]];
+						const glm::dvec3 faceCross = glm::cross(glm::dvec3(mPositions[mIndices[t * 3 + 1]]) - p0,
+						                                        glm::dvec3(mPositions[mIndices[t * 3 + 2]]) - p0);
+						const glm::dvec3 edge = glm::dvec3(mPositions[b]) - glm::dvec3(mPositions[a]);
+						const glm::dvec3 normal = glm::cross(edge, faceCross);
+						const double length = glm::length(normal);
+						if (length <= 0) break;
+
+						const glm::dvec3 unit = normal / length;
+						const Quadric q = Quadric::FromPlane(unit, -glm::dot(unit, glm::dvec3(mPositions[a])),
+						                                     mOptions.borderWeight * glm::dot(edge, edge));
+						mQuadrics[a] += q;
+						mQuadrics[b] += q;
+						break;
+					}
+				}
+				i = end;
+			}
+
+			// Heapifying all edges at once is linear, pushing them one by one isn't
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+			std::vector<Candidate> candidates;
+			candidates.reserve(edges.size());
+			for (const uint64_t edge : edges)
+				candidates.push_back(MakeCandidate(static_cast<uint32_t>(edge >> 32), static_cast<uint32_t>(edge)));
+			mHeap = decltype(mHeap)(std::greater<>(), std::move(candidates));
+		}
+
+		// Welding STL corners glues shells that only touch at a point into one vertex with several separate fans
+		// The link condition would refuse almost every collapse near such a vertex, so each extra fan gets its own copy
+		inline void QuadricSimplifier::SplitPinchedVertices()
+		{
+			std::vector<std::pair<uint32_t, uint32_t>> corners;
+			std::vector<uint32_t> fans, copies, kept;
+			const auto originalCount = static_cast<uint32_t>(mPositions.size());
+			for (uint32_t vertex = 0; vertex < originalCount; vertex++)
+			{
+				const size_t count = mVertexTriangles[vertex].size();
+				if (count < 2) continue;
+
+				// Triangles around the vertex that share another corner are in the same fan
+				corners.clear();
+				for (uint32_t i = 0; i < count; i++)
+				{
+					const uint32_t t = mVertexTriangles[vertex][i];
+					for (int c = 0; c < 3; c++)
+						if (mIndices[t * 3 + c] != vertex) corners.emplace_back(mIndices[t * 3 + c], i);
+				}
+				std::sort(corners.begin(), corners.end());
+
+				fans.resize(count);
+				for (uint32_t i = 0; i < count; i++) fans[i] = i;
+				auto find = [&fans](uint32_t i) { while (fans[i] != i) i = fans[i] = fans[fans[i]]; return i; };
+				for (size_t i = 1; i < corners.size(); i++)
+					if (corners[i].first == corners[i - 1].first)
+						fans[find(corners[i].second)] = find(corners[i - 1].second);
+
+				// The first fan keeps the vertex, every other fan moves to a copy
+				const uint32_t firstFan = find(0);
+				copies.assign(count, UINT32_MAX);
+				kept.clear();
+				for (uint32_t i = 0; i < count; i++)
+				{
+					const uint32_t t = mVertexTriangles[vertex][i];
+					const uint32_t fan = find(i);
+					if (fan == firstFan)
+					{
+						kept.push_back(t);
+						continue;
+					}
+
+					if (copies[fan] == UINT32_MAX)
+					{
+						copies[fan] = static_cast<uint32_t>(mPositions.size());
+						mPositions.push_back(mPositions[vertex]);
+						mVertexTriangles.emplace_back();
+					}
+					for (int c = 0; c < 3; c++)
+						if (mIndices[t * 3 + c] == vertex) mIndices[t * 3 + c] = copies[fan];
+					mVertexTriangles[copies[fan]].push_back(t);
+				}
+				mVertexTriangles[vertex].assign(kept.begin(), kept.end());
+			}
+		}
+
+		inline QuadricSimplifier::Candidate QuadricSimplifier::MakeCandidate(const uint32_t a, const uint32_t b) const
+		{
+			const Quadric q = mQuadrics[a] + mQuadrics[b];
+			const glm::dvec3 pa = mPositions[a];
+			const glm::dvec3 pb = mPositions[b];
+
+			// The optimum is only trusted close to the edge, far off it means the system is barely solvable
+			glm::dvec3 position;
+			double error;
+			const double edgeLength = glm::length(pb - pa);
+			if (q.Minimize(position) && glm::length(position - (pa + pb) * 0.5) <= edgeLength * 2)
+				error = q.Evaluate(position);
+			else
+			{
+				const glm::dvec3 points[3] = { pa, pb, (pa + pb) * 0.5 };
+				position = points[0];
+				error = q.Evaluate(points[0]);
+				for (int i = 1; i < 3; i++)
+				{
+					const double e = q.Evaluate(points[i]);
+					if (e < error) { error = e; position = points[i]; }
+				}
+			}
+
+			return Candidate{ std::max(error, 0.0), a, b, mVersions[a], mVersions[b], glm::vec3(position) };
+		}
+
+		inline bool QuadricSimplifier::Simplify(const size_t targetTriangleCount)
+		{
+			while (mLiveTriangles > targetTriangleCount)
+			{
+				if (mHeap.empty()) return false;
+
+				const Candidate candidate = mHeap.top();
+				mHeap.pop();
+
+				if (mRemoved[candidate.keep] || mRemoved[candidate.remove] ||
+				    mVersions[candidate.keep] != candidate.keepVersion || mVersions[candidate.remove] != candidate.removeVersion)
+					continue;
+
+				if (Collapse(candidate))
+					mMaxError = std::max(mMaxError, candidate.error);
+			}
+			return true;
+		}
+
+		inline void QuadricSimplifier::PruneTriangles(const uint32_t vertex)
+		{
+			auto& triangles = mVertexTriangles[vertex];
+			triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+			                               [this](const uint32_t t) { return static_cast<bool>(mTriangleRemoved[t]); }),
+			                triangles.end());
+		}
+
+		inline void QuadricSimplifier::CollectNeighbors(const uint32_t vertex, std::vector<uint32_t>& neighbors) const
+		{
+			neighbors.clear();
+			for (const uint32_t t : mVertexTriangles[vertex])
+				for (int c = 0; c < 3; c++)
+					if (mIndices[t * 3 + c] != vertex) neighbors.push_back(mIndices[t * 3 + c]);
+			std::sort(neighbors.begin(), neighbors.end());
+			neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		}
+
+		// Link condition: the two ends may only share the neighbours across their common triangles,
+		// anything else would pinch the surface into a non-manifold edge
+		inline bool QuadricSimplifier::IsLinkValid(const uint32_t keep, const uint32_t remove)
+		{
+			CollectNeighbors(keep, mKeepNeighbors);
+			CollectNeighbors(remove, mRemoveNeighbors);
+
+			size_t shared = 0;
+			for (const uint32_t t : mVertexTriangles[keep])
+				if (HasVertex(t, remove)) shared++;
+			if (shared == 0) return false;
+
+			size_t common = 0;
+			auto a = mKeepNeighbors.begin();
+			auto b = mRemoveNeighbors.begin();
+			while (a != mKeepNeighbors.end() && b != mRemoveNeighbors.end())
+			{
+				if (*a < *b) ++a;
+				else if (*b < *a) ++b;
+				else { common++; ++a; ++b; }
+			}
+			return common == shared;
+		}
+
+		// Every triangle around vertex that survives the collapse has to keep facing roughly the same way
+		inline bool QuadricSimplifier::KeepsOrientation(const uint32_t vertex, const uint32_t other, const glm::vec3& position) const
+		{
+			for (const uint32_t t : mVertexTriangles[vertex])
+			{
+				if (HasVertex(t, other)) continue;
+
+				glm::vec3 corners[3];
+				glm::vec3 moved[3];
+				for (int c = 0; c < 3; c++)
+				{
+					corners[c] = mPositions[mIndices[t * 3 + c]];
+					moved[c] = mIndices[t * 3 + c] == vertex ? position : corners[c];
+				}
+
+				const glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+				const glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				const float lengths = glm::length(before) * glm::length(after);
+				if (lengths <= 0.0f || glm::dot(before, after) < mOptions.minNormalDot * lengths) return false;
+			}
+			return true;
+		}
+
+		inline bool QuadricSimplifier::Collapse(const Candidate& candidate)
+		{
+			const uint32_t keep = candidate.keep;
+			const uint32_t remove = candidate.remove;
+
+			PruneTriangles(keep);
+			PruneTriangles(remove);
+
+			if (!IsLinkValid(keep, remove)) return false;
+			if (!KeepsOrientation(keep, remove, candidate.position) || !KeepsOrientation(remove, keep, candidate.position))
+				return false;
+
+			// Triangles on the edge disappear, the rest of remove's triangles move over to keep
+			auto& keepTriangles = mVertexTriangles[keep];
+			for (const uint32_t t : mVertexTriangles[remove])
+			{
+				if (HasVertex(t, keep))
+				{
+					mTriangleRemoved[t] = true;
+					mLiveTriangles--;
+					continue;
+				}
+				for (int c = 0; c < 3; c++)
+					if (mIndices[t * 3 + c] == remove) mIndices[t * 3 + c] = keep;
+				keepTriangles.push_back(t);
+			}
+			mVertexTriangles[remove].clear();
+			mVertexTriangles[remove].shrink_to_fit();
+			PruneTriangles(keep);
+
+			mRemoved[remove] = true;
+			mPositions[keep] = candidate.position;
+			mQuadrics[keep] += mQuadrics[remove];
+			mVersions[keep]++;
+
+			// Every edge around keep changed cost
+			CollectNeighbors(keep, mKeepNeighbors);
+			for (const uint32_t neighbor : mKeepNeighbors)
+				mHeap.push(MakeCandidate(keep, neighbor));
+			return true;
+		}
+
+		inline MeshData QuadricSimplifier::Extract() const
+		{
+			constexpr uint32_t UNUSED = UINT32_MAX;
+			std::vector<uint32_t> remap(mPositions.size(), UNUSED);
+
+			MeshData data;
+			data.indices.reserve(mLiveTriangles * 3);
+			for (size_t t = 0; t < mTriangleRemoved.size(); t++)
+			{
+				if (mTriangleRemoved[t]) continue;
+				for (int c = 0; c < 3; c++)
+				{
+					const uint32_t vertex = mIndices[t * 3 + c];
+					if (remap[vertex] == UNUSED)
+					{
+						remap[vertex] = static_cast<uint32_t>(data.vertices.size());
+						data.vertices.push_back(MeshPt{ mPositions[vertex], glm::vec3(0.0f) });
+					}
+					data.indices.push_back(remap[vertex]);
+				}
+			}
+
+			// Same convention as the importers: the sum of the unit normals of a vertex's triangles
+			for (size_t i = 0; i < data.indices.size(); i += 3)
+			{
+				MeshPt& v0 = data.vertices[data.indices[i]];
+				MeshPt& v1 = data.vertices[data.indices[i + 1]];
+				MeshPt& v2 = data.vertices[data.indices[i + 2]];
+				const glm::vec3 cross = glm::cross(v1.position - v0.position, v2.position - v0.position);
+				const float length = glm::length(cross);
+				if (length <= 0.0f) continue;
+
+				const glm::vec3 normal = cross / length;
+				v0.normal += normal;
+				v1.normal += normal;
+				v2.normal += normal;
+			}
+			for (MeshPt& vertex : data.vertices)
+			{
+				const float length = glm::length(vertex.normal);
+				if (length > 0.0f) vertex.normal /= length;
+			}
+			return data;
+		}
+	}
+
+	inline MeshData DecimateMesh(const MeshData& inputData, const size_t targetTriangleCount, const SimplifyOptions& options)
+	{
+		Detail::QuadricSimplifier simplifier(inputData, options);
+		simplifier.Simplify(targetTriangleCount);
+		return simplifier.Extract();
+	}
+
+	inline std::vector<MeshData> BuildLODChain(const MeshData& inputData, const size_t levelCount, const float reduction,
+	                                           const SimplifyOptions& options)
+	{
+		std::vector<MeshData> levels;
+		if (levelCount == 0) return levels;
+		levels.push_back(inputData);
+
+		// One run of collapses, copied out at every target, each level simplifies the one before
+		Detail::QuadricSimplifier simplifier(inputData, options);
+		while (levels.size() < levelCount)
+		{
+			const size_t previous = simplifier.GetTriangleCount();
+			const auto target = static_cast<size_t>(static_cast<float>(previous) * reduction);
+			if (target < MIN_LOD_TRIANGLES) break;
+
+			simplifier.Simplify(target);
+			if (simplifier.GetTriangleCount() >= previous) break;
+
+			MeshData level = simplifier.Extract();
+			if (level.indices.empty()) break;
+			levels.push_back(std::move(level));
+		}
+		return levels;
+	}
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "components/LODGroup.h"
+#include "core/GlobalTypes.h"
+#include "physics/StaticTree.h"
+#include "utils/Logger.h"
+#include "utils/MappedFile.h"
+
+namespace Utils
+{
+	// Bumped whenever the layout of a packed mesh file changes
+	constexpr uint32_t PACKED_MESH_VERSION = 1;
+	// Every block starts on this boundary, so the mapped arrays are aligned for any vector load
+	constexpr size_t PACKED_MESH_ALIGNMENT = 64;
+
+	/*
+	Packed mesh format, little endian, blocks at PACKED_MESH_ALIGNMENT boundaries from the start of the file:
+	PackedMeshHeader
+	MeshPt[vertexCount] at vertexOffset
+	uint32[indexCount] at indexOffset
+	StaticTree::Serialize output at treeOffset, only if treeSize isn't 0
+
+	Files without the magic are read in the old unversioned layout:
+	uint32 # of vertices, uint32 # of indices, MeshPt array, index array
+	*/
+	struct PackedMeshHeader
+	{
+		char magic[4] = { 'P', 'M', 'S', 'H' };
+		uint32_t version = PACKED_MESH_VERSION;
+		uint64_t vertexCount = 0;
+		uint64_t vertexOffset = 0;
+		uint64_t indexCount = 0;
+		uint64_t indexOffset = 0;
+		uint64_t treeSize = 0;
+		uint64_t treeOffset = 0;
+	};
+
+	// Mesh file mapped into memory, the view points straight into the mapped pages
+	// Nothing is read until it's touched, so opening costs the same for any mesh size
+	class PackedMesh
+	{
+	public:
+		PackedMesh() = default;
+		// Check IsOpen, a missing or malformed file leaves the mesh closed
+		explicit PackedMesh(const std::string& path);
+
+		bool IsOpen() const { return mFile.IsOpen(); }
+		const MeshView& GetView() const { return mView; }
+
+		bool HasTree() const { return mTreeSize != 0; }
+		// Deserializes the tree block, null if there is none or it was written with other options or an older layout
+		std::shared_ptr<Physics::StaticTree> LoadTree(const Physics::StaticTreeBuildOptions& options = {}) const;
+
+	private:
+		MappedFile mFile;
+		MeshView mView;
+		const char* mTree = nullptr;
+		size_t mTreeSize = 0;
+
+		bool ReadHeader(const std::string& path);
+		bool ReadLegacyHeader(const std::string& path);
+	};
+
+	// Writes mesh in the packed format, with the tree block if tree isn't null. Returns false if the file can't be written
+	inline bool WritePackedMesh(const std::string& path, const MeshView& mesh, const Physics::StaticTree* tree = nullptr);
+
+	// Path of the level of detail MeshConverter --lods writes next to path, mesh.dat gets mesh_lod1.dat and on
+	inline std::string GetPackedLODPath(const std::string& path, size_t level);
+	// Reads the levels next to path in order until one is missing, most detailed first. Empty if there are none
+	inline std::vector<MeshData> ReadPackedLODs(const std::string& path);
+
+
+	inline PackedMesh::PackedMesh(const std::string& path) : mFile(path)
+	{
+		if (!mFile.IsOpen())
+		{
+			LOG(LOG_ERROR) << "Can't read mesh file " << path << "\n";
+			return;
+		}
+
+		const bool valid = mFile.Size() >= sizeof(PackedMeshHeader::magic) &&
+		                   std::memcmp(mFile.Data(), PackedMeshHeader().magic, sizeof(PackedMeshHeader::magic)) == 0 ?
+		                   ReadHeader(path) : ReadLegacyHeader(path);
+
+		// Indices past the vertices would send the GPU and the tree build out of bounds
+		bool inRange = true;
+		for (size_t i = 0; valid && inRange && i < mView.indexCount; i++)
+			inRange = mView.indices[i] < mView.vertexCount;
+		if (!inRange)
+			LOG(LOG_ERROR) << "Mesh file " << path << " has an index past its " << mView.vertexCount << " vertices.\n";
+
+		if (!valid || !inRange)
+		{
+			mFile.Close();
+			mView = {};
+			mTree = nullptr;
+			mTreeSize = 0;
+		}
+	}
+
+	inline bool PackedMesh::ReadHeader(const std::string& path)
+	{
+		PackedMeshHeader header;
+		if (mFile.Size() < sizeof(header))
+		{
+			LOG(LOG_ERROR) << "Mesh file " << path << " is truncated.\n";
+			return false;
+		}
+		std::memcpy(&header, mFile.Data(), sizeof(header));
+
+		if (header.version != PACKED_MESH_VERSION)
+		{
+			LOG(LOG_ERROR) << "Mesh file " << path << " has version " << header.version << ", expected " << PACKED_MESH_VERSION << ".\n";
+			return false;
+		}
+
+		auto fits = [size = mFile.Size()](const uint64_t offset, const uint64_t count, const size_t elementSize)
+		{
+			return offset % PACKED_MESH_ALIGNMENT == 0 && offset <= size && count <= (size - offset) / elementSize;
+		};
+		if (!fits(header.vertexOffset, header.vertexCount, sizeof(MeshPt)) ||
+		    !fits(header.indexOffset, header.indexCount, sizeof(GLuint)) ||
+		    !fits(header.treeOffset, header.treeSize, 1))
+		{
+			LOG(LOG_ERROR) << "Mesh file " << path << " is truncated.\n";
+			return false;
+		}
+
+		mView = MeshView(reinterpret_cast<const MeshPt*>(mFile.Data() + header.vertexOffset), header.vertexCount,
+		                 reinterpret_cast<const GLuint*>(mFile.Data() + header.indexOffset), header.indexCount);
+		mTree = mFile.Data() + header.treeOffset;
+		mTreeSize = header.treeSize;
+		return true;
+	}
+
+	inline bool PackedMesh::ReadLegacyHeader(const std::string& path)
+	{
+		uint32_t counts[2];
+		if (mFile.Size() < sizeof(counts))
+		{
+			LOG(LOG_ERROR) << "Mesh file " << path << " is truncated.\n";
+			return false;
+		}
+		std::memcpy(counts, mFile.Data(), sizeof(counts));
+
+		const size_t vertexBytes = static_cast<size_t>(counts[0]) * sizeof(MeshPt);
+		const size_t indexBytes = static_cast<size_t>(counts[1]) * sizeof(GLuint);
+		if (mFile.Size() - sizeof(counts) < vertexBytes || mFile.Size() - sizeof(counts) - vertexBytes < indexBytes)
+		{
+			LOG(LOG_ERROR) << "Mesh file " << path << " is truncated.\n";
+			return false;
+		}
+
+		// Mappings are page aligned, so both arrays still land on 4 byte boundaries
+		const char* vertices = mFile.Data() + sizeof(counts);
+		mView = MeshView(reinterpret_cast<const MeshPt*>(vertices), counts[0],
+		                 reinterpret_cast<const GLuint*>(vertices + vertexBytes), counts[1]);
+		return true;
+	}
+
+	inline std::shared_ptr<Physics::StaticTree> PackedMesh::LoadTree(const Physics::StaticTreeBuildOptions& options) const
+	{
+		if (!HasTree()) return nullptr;
+
+		auto tree = std::make_shared<Physics::StaticTree>();
+		const char* data = mTree;
+		if (!tree->Deserialize(data, mTree + mTreeSize)) return nullptr;
+
+		if (!tree->WasBuiltWith(options)) return nullptr;
+		return tree;
+	}
+
+	inline bool WritePackedMesh(const std::string& path, const MeshView& mesh, const Physics::StaticTree* tree)
+	{
+		auto align = [](const uint64_t offset) { return (offset + PACKED_MESH_ALIGNMENT - 1) / PACKED_MESH_ALIGNMENT * PACKED_MESH_ALIGNMENT; };
+
+		std::string treeBlob;
+		if (tree)
+		{
+			std::ostringstream out(std::ios::binary);
+			tree->Serialize(out);
+			treeBlob = out.str();
+		}
+
+		PackedMeshHeader header;
+		header.vertexCount = mesh.vertexCount;
+		header.vertexOffset = align(sizeof(header));
+		header.indexCount = mesh.indexCount;
+		header.indexOffset = align(header.vertexOffset + mesh.vertexCount * sizeof(MeshPt));
+		header.treeSize = treeBlob.size();
+		header.treeOffset = tree ? align(header.indexOffset + mesh.indexCount * sizeof(GLuint)) : 0;
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			LOG(LOG_ERROR) << "Can't write mesh file " << path << "\n";
+			return false;
+		}
+
+		auto writeAt = [&out](const uint64_t offset, const void* data, const size_t size)
+		{
+			static constexpr char padding[PACKED_MESH_ALIGNMENT] = {};
+			out.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(out.tellp())));
+			out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		};
+		writeAt(0, &header, sizeof(header));
+		writeAt(header.vertexOffset, mesh.vertices, mesh.vertexCount * sizeof(MeshPt));
+		writeAt(header.indexOffset, mesh.indices, mesh.indexCount * sizeof(GLuint));
+		if (tree) writeAt(header.treeOffset, treeBlob.data(), treeBlob.size());
+
+		return static_cast<bool>(out);
+	}
+
+	inline std::string GetPackedLODPath(const std::string& path, const size_t level)
+	{
+		const bool hasExtension = path.size() >= 4 && path.compare(path.size() - 4, 4, ".dat") == 0;
+		const std::string stem = hasExtension ? path.substr(0, path.size() - 4) : path;
+		return stem + "_lod" + std::to_string(level) + ".dat";
+	}
+
+	inline std::vector<MeshData> ReadPackedLODs(const std::string& path)
+	{
+		std::vector<MeshData> levels;
+		std::error_code error;
+		for (size_t level = 1; level < Components::MAX_LOD_LEVELS; level++)
+		{
+			const std::string lodPath = GetPackedLODPath(path, level);
+			if (!std::filesystem::exists(lodPath, error)) break;
+
+			// A broken level would leave a gap in the chain, so it ends there
+			const PackedMesh lod(lodPath);
+			if (!lod.IsOpen() || lod.GetView().Empty()) break;
+			levels.push_back(lod.GetView().ToMeshData());
+		}
+		return levels;
+	}
+}
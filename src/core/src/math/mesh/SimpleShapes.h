@@ -1,4 +1,7 @@
 #pragma once
+#include <algorithm>
+#include <iterator>
+
 #include "core/GlobalTypes.h"
 
 namespace Utils
@@ -40,13 +43,23 @@ namespace Utils
 			4, 5, 6, // Top
 			4, 6, 7
 		};
+		// Corners are only shared within a face, the faces need their own normals for flat shading
 		std::vector<MeshPt> points;
 		std::vector<GLuint> indices;
-		size_t count = 0;
-		for (int i = 0; i < boxIndices.size(); i++)
+		for (size_t face = 0; face < boxIndices.size() / 6; face++)
 		{
-			points.push_back(MeshPt{boxVertices[boxIndices[i]], boxNormals[i / 6] * (reverseNormals ? 1.0f : -1.0f)});
-			indices.push_back(i);
+			GLuint faceCorners[8];
+			std::fill(std::begin(faceCorners), std::end(faceCorners), UINT32_MAX);
+			for (size_t i = face * 6; i < face * 6 + 6; i++)
+			{
+				GLuint& corner = faceCorners[boxIndices[i]];
+				if (corner == UINT32_MAX)
+				{
+					corner = static_cast<GLuint>(points.size());
+					points.push_back(MeshPt{boxVertices[boxIndices[i]], boxNormals[face] * (reverseNormals ? 1.0f : -1.0f)});
+				}
+				indices.push_back(corner);
+			}
 		}
 
 		return MeshData{ points, indices };
@@ -8,8 +8,6 @@ public:
 	glm::vec3 min{};
 	glm::vec3 max{};
 
-	float surfaceArea{};
-
 	BoundingBox();
 	BoundingBox(const glm::vec3 min, const glm::vec3 max);
 
@@ -18,6 +16,12 @@ public:
 	void IncludePoint(glm::vec3 point);
 
 	void MoveCenter(glm::vec3 center);
+	void Translate(glm::vec3 offset);
+
+	// Grows the box by margin on every side
+	void Expand(float margin);
+	// Stretches the box along displacement, keeping the opposite faces in place
+	void Extend(glm::vec3 displacement);
 
 	void ApplyMat(const glm::mat4& mat);
 
@@ -28,7 +32,10 @@ public:
 
 	glm::vec3 GetBound(bool min) const;
 	bool IsColliding(const BoundingBox& other) const;
-	void UpdateSurfaceArea();
+	// Returns true if other lies completely inside this box
+	bool Contains(const BoundingBox& other) const;
+	// Computed on demand so the box stays two vec3s
+	float SurfaceArea() const;
 };
 
 inline BoundingBox::BoundingBox()
@@ -38,7 +45,6 @@ inline BoundingBox::BoundingBox()
 
 inline BoundingBox::BoundingBox(const glm::vec3 min, const glm::vec3 max): min(min), max(max)
 {
-	UpdateSurfaceArea();
 }
 
 inline bool BoundingBox::IsColliding(const BoundingBox& other) const
@@ -51,13 +57,22 @@ inline bool BoundingBox::IsColliding(const BoundingBox& other) const
 		max.z >= other.min.z;
 }
 
+inline bool BoundingBox::Contains(const BoundingBox& other) const
+{
+	return min.x <= other.min.x &&
+		min.y <= other.min.y &&
+		min.z <= other.min.z &&
+		max.x >= other.max.x &&
+		max.y >= other.max.y &&
+		max.z >= other.max.z;
+}
+
 inline void BoundingBox::Merge(const BoundingBox& box1, const BoundingBox& box2)
 {
 	for (unsigned int d = 0; d < 3; d++) {
 		min[d] = std::min(box1.min[d], box2.min[d]);
 		max[d] = std::max(box1.max[d], box2.max[d]);
 	}
-	UpdateSurfaceArea();
 }
 
 inline void BoundingBox::Merge(const BoundingBox& other)
@@ -66,7 +81,6 @@ inline void BoundingBox::Merge(const BoundingBox& other)
 		min[d] = std::min(min[d], other.min[d]);
 		max[d] = std::max(max[d], other.max[d]);
 	}
-	UpdateSurfaceArea();
 }
 
 inline void BoundingBox::IncludePoint(const glm::vec3 point)
@@ -83,6 +97,26 @@ inline void BoundingBox::MoveCenter(glm::vec3 center) {
 	max = center + halfExtents;
 }
 
+inline void BoundingBox::Translate(const glm::vec3 offset)
+{
+	min += offset;
+	max += offset;
+}
+
+inline void BoundingBox::Expand(const float margin)
+{
+	min -= glm::vec3(margin);
+	max += glm::vec3(margin);
+}
+
+inline void BoundingBox::Extend(const glm::vec3 displacement)
+{
+	for (unsigned int d = 0; d < 3; d++) {
+		if (displacement[d] < 0.0f) min[d] += displacement[d];
+		else max[d] += displacement[d];
+	}
+}
+
 inline void BoundingBox::ApplyMat(const glm::mat4& mat)
 {
 	min = mat * glm::vec4(min, 1.0);
@@ -98,7 +132,6 @@ inline void BoundingBox::Reset()
 {
 	max = glm::vec3(0.0f);
 	min = glm::vec3(0.0f);
-	surfaceArea = 0.0f;
 }
 
 inline glm::vec3 BoundingBox::GetBound(bool min) const
@@ -110,12 +143,13 @@ inline void BoundingBox::SetToLimit()
 {
 	max = glm::vec3(-FLT_MAX);
 	min = glm::vec3(FLT_MAX);
-	surfaceArea = 0.0f;
 }
 
-inline void BoundingBox::UpdateSurfaceArea()
+inline float BoundingBox::SurfaceArea() const
 {
-	surfaceArea = (max.x-min.x)*(max.y-min.y) + (max.y-min.y)*(max.z-min.z) + (max.x-min.x)*(max.z-min.z);
+	// Empty boxes (min > max) have no area
+	if (min.x > max.x) return 0.0f;
+	return (max.x-min.x)*(max.y-min.y) + (max.y-min.y)*(max.z-min.z) + (max.x-min.x)*(max.z-min.z);
 }
 
 
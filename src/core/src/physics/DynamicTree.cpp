@@ -3,14 +3,22 @@
 #include "utils/Logger.h"
 #include "utils/Exceptions.h"
 #include "../core/GlobalTypes.h"
+#include "../math/SimdFloat.h"
+
+#include <algorithm>
 
 namespace Physics
 {
-    DynamicBBTree::DynamicBBTree(const size_t initialCapacity)
+    DynamicBBTree::DynamicBBTree(const uint32_t initialCapacity)
     {
         rootIndex = NULL_NODE;
         nodeCount = 0;
         nodeCapacity = 0;
+        mFreeList = NULL_NODE;
+
+        entityToNodeIdx.resize(MAX_ENTITIES, NULL_NODE);
+        entityBoxes.resize(MAX_ENTITIES);
+        entityMoved.resize(MAX_ENTITIES, false);
 
         ExpandCapacity(initialCapacity);
     }
@@ -18,116 +26,119 @@ namespace Physics
 
     void DynamicBBTree::InsertEntity(Entity entity, BoundingBox box)
     {
-        size_t newNodeIndex = AllocateNode();
-
-        mNodes[newNodeIndex].box = box;
-        mNodes[newNodeIndex].height = 0;
-
+        if (entity >= entityToNodeIdx.size())
         {
-            auto inserted = nodeIdxToEntityMap.emplace(newNodeIndex, entity);
-            if (!inserted.second)
-            {
-                LOG(LOG_ERROR) << "Dynamic Tree: Insertion to node idx to entity map failed.\n";
-                return;
-            }
+            entityToNodeIdx.resize(static_cast<size_t>(entity) + 1, NULL_NODE);
+            entityBoxes.resize(static_cast<size_t>(entity) + 1);
+            entityMoved.resize(static_cast<size_t>(entity) + 1, false);
         }
+        if (entityToNodeIdx[entity] != NULL_NODE)
         {
-            auto inserted = entityToNodeIdxMap.emplace(entity, newNodeIndex);
-            if (!inserted.second)
-            {
-                LOG(LOG_ERROR) << "Dynamic Tree: Insertion to entity to node idx map failed\n";
-                return;
-            }
+            LOG(LOG_ERROR) << "Dynamic Tree: Entity " << entity << " is already in the tree.\n";
+            return;
         }
 
+        uint32_t newNodeIndex = AllocateNode();
+
+        mNodes[newNodeIndex].box = FattenBox(box, glm::vec3(0.0f));
+        mLinks[newNodeIndex].height = 0;
+        mNodes[newNodeIndex].entity = entity;
+
+        entityToNodeIdx[entity] = newNodeIndex;
+        entityBoxes[entity] = box;
+
         InsertLeaf(newNodeIndex);
+        BufferMove(entity);
     }
 
 
     void DynamicBBTree::RemoveEntity(const Entity entity)
     {
-        const auto enIterator = entityToNodeIdxMap.find(entity);
-        if (enIterator == entityToNodeIdxMap.end()) {
-            throw PhysicsException("Trying to remove entity not in map");
-        }
+        uint32_t node = GetLeafIndex(entity);
+        entityToNodeIdx[entity] = NULL_NODE;
 
-        const auto neIterator = nodeIdxToEntityMap.find(enIterator->second);
-        if (neIterator == nodeIdxToEntityMap.end()) {
-            throw PhysicsException("Trying to remove node not in map");
-        }
+        RemoveLeaf(node);
+        FreeNode(node);
+        BufferMove(entity);
+    }
 
-        size_t node = enIterator->second;
 
-        entityToNodeIdxMap.erase(enIterator);
-        nodeIdxToEntityMap.erase(neIterator);
+    bool DynamicBBTree::UpdateEntity(Entity entity, BoundingBox box, glm::vec3 displacement)
+    {
+        uint32_t node = GetLeafIndex(entity);
+
+        entityBoxes[entity] = box;
 
-        if (node == rootIndex)
+        const BoundingBox fatBox = FattenBox(box, displacement);
+        const BoundingBox& treeBox = mNodes[node].box;
+        if (treeBox.Contains(box))
         {
-            FreeNode(node);
-            rootIndex = NULL_NODE;
-            return;
+            // Still re-insert if the stored box is far bigger than needed, otherwise a body that
+            // stopped moving would keep its enlarged box forever
+            BoundingBox hugeBox = fatBox;
+            hugeBox.Expand(4.0f * fatMargin);
+            if (hugeBox.Contains(treeBox)) return false;
         }
 
-        size_t oldParent = mNodes[node].parent;
-        size_t sibling = GetSibling(node);
+        RemoveLeaf(node);
+        mNodes[node].box = fatBox;
+        InsertLeaf(node);
+        BufferMove(entity);
 
-        if (oldParent != rootIndex) // If oldParent isn't root
-        {
-            // Make oldParent's parent reference sibling as child
-            size_t grandfather = mNodes[oldParent].parent;
-            if (mNodes[grandfather].left == oldParent) mNodes[grandfather].left = sibling;
-            else mNodes[grandfather].right = sibling;
+        reinsertCount++;
+        return true;
+    }
 
-            // Set sibling to oldParent's parent
-            mNodes[sibling].parent = grandfather;
-        }
-        else // If oldParent is root
-        {
-            // Make sibling the root
-            rootIndex = sibling;
-            mNodes[sibling].parent = NULL_NODE;
-        }
+    bool DynamicBBTree::UpdateEntity(Entity entity, glm::vec3 newCenter)
+    {
+        BoundingBox box = GetBoundingBox(entity);
+        const glm::vec3 displacement = newCenter - (box.min + box.max) * 0.5f;
+        box.Translate(displacement);
+        return UpdateEntity(entity, box, displacement);
+    }
 
-        FreeNode(oldParent);
-        FreeNode(node);
+
+    bool DynamicBBTree::Contains(const Entity entity) const
+    {
+        return entity < entityToNodeIdx.size() && entityToNodeIdx[entity] != NULL_NODE;
     }
 
 
-    void DynamicBBTree::UpdateEntity(Entity entity, BoundingBox box)
+    void DynamicBBTree::ClearMoveBuffer()
     {
-        RemoveEntity(entity);
-        InsertEntity(entity, box);
+        for (const Entity entity : mMoveBuffer)
+            entityMoved[entity] = false;
+        mMoveBuffer.clear();
     }
 
-    void DynamicBBTree::UpdateEntity(Entity entity, glm::vec3 newCenter)
+
+    void DynamicBBTree::BufferMove(const Entity entity)
     {
-        BoundingBox oldBox = GetBoundingBox(entity);
-        oldBox.MoveCenter(newCenter);
-        RemoveEntity(entity);
-        InsertEntity(entity, oldBox);
+        if (entityMoved[entity]) return;
+
+        entityMoved[entity] = true;
+        mMoveBuffer.push_back(entity);
     }
 
 
-    size_t DynamicBBTree::AllocateNode()
+    BoundingBox DynamicBBTree::FattenBox(const BoundingBox& box, const glm::vec3 displacement) const
     {
-        size_t nodeIndex;
+        BoundingBox fatBox = box;
+        fatBox.Expand(fatMargin);
+        fatBox.Extend(displacement * displacementMultiplier);
+        return fatBox;
+    }
+
 
-        // If there are no holes, either resize capacity or set nodeIndex to next free node.
-        if (nodeCount == nodeCapacity)
+    uint32_t DynamicBBTree::AllocateNode()
+    {
+        // If there are no free nodes, grow the node vector
+        if (mFreeList == NULL_NODE)
             ExpandCapacity(nodeCapacity * 2);
 
-        // If nodes array not big enough, resize
-        if (mFreeList.empty())
-        {
-            nodeIndex = nodeCount;
-        }
-        else
-        {
-            // If there are "holes" in the mNodes vector caused by removing nodes, fill it.
-            // Pulls node off of free list
-            nodeIndex = mFreeList.top();
-            mFreeList.pop();
-        }
+        // Pull node off of free list
+        uint32_t nodeIndex = mFreeList;
+        mFreeList = mLinks[nodeIndex].parent;
 
         // Set all data members to NULL_NODE
         ResetNodeData(nodeIndex);
@@ -139,46 +150,47 @@ namespace Physics
     }
 
 
-    void DynamicBBTree::FreeNode(const size_t nodeIndex)
+    void DynamicBBTree::FreeNode(const uint32_t nodeIndex)
     {
         // Reset data
         ResetNodeData(nodeIndex);
 
         // Add node to freeList
-        mFreeList.push(nodeIndex);
+        mLinks[nodeIndex].parent = mFreeList;
+        mFreeList = nodeIndex;
 
         nodeCount--;
     }
 
 
-    void DynamicBBTree::InsertLeaf(const size_t leafIndex)
+    void DynamicBBTree::InsertLeaf(const uint32_t leafIndex)
     {
         if (rootIndex == NULL_NODE)
         {
             // Makes root node
             rootIndex = leafIndex;
-            mNodes[leafIndex].parent = NULL_NODE;
+            mLinks[leafIndex].parent = NULL_NODE;
             return;
         }
 
         // Find best sibling
-        size_t sibling = FindBestSibling(leafIndex);
+        uint32_t sibling = FindBestSibling(leafIndex);
 
         // Create new parent
-        size_t oldParent = mNodes[sibling].parent;
-        size_t newParent = AllocateNode();
+        uint32_t oldParent = mLinks[sibling].parent;
+        uint32_t newParent = AllocateNode();
 
         // Initialize new parent
-        mNodes[newParent].parent = oldParent;
+        mLinks[newParent].parent = oldParent;
         mNodes[newParent].box.Merge(mNodes[leafIndex].box, mNodes[sibling].box);
-        mNodes[newParent].height = mNodes[sibling].height + 1;
+        mLinks[newParent].height = mLinks[sibling].height + 1;
 
         mNodes[newParent].left = sibling;
         mNodes[newParent].right = leafIndex;
 
         // Set sibling and leaf to point to new parent
-        mNodes[sibling].parent = newParent;
-        mNodes[leafIndex].parent = newParent;
+        mLinks[sibling].parent = newParent;
+        mLinks[leafIndex].parent = newParent;
 
         // The sibling was not the root.
         if (oldParent != NULL_NODE)
@@ -192,39 +204,207 @@ namespace Physics
             rootIndex = newParent;
         }
 
+        RefitAncestors(mLinks[leafIndex].parent);
+    }
+
+
+    void DynamicBBTree::RemoveLeaf(const uint32_t leafIndex)
+    {
+        if (leafIndex == rootIndex)
+        {
+            rootIndex = NULL_NODE;
+            return;
+        }
+
+        uint32_t oldParent = mLinks[leafIndex].parent;
+        uint32_t sibling = GetSibling(leafIndex);
+
+        if (oldParent != rootIndex) // If oldParent isn't root
+        {
+            // Make oldParent's parent reference sibling as child
+            uint32_t grandfather = mLinks[oldParent].parent;
+            if (mNodes[grandfather].left == oldParent) mNodes[grandfather].left = sibling;
+            else mNodes[grandfather].right = sibling;
+
+            // Set sibling to oldParent's parent
+            mLinks[sibling].parent = grandfather;
+            FreeNode(oldParent);
+
+            RefitAncestors(grandfather);
+        }
+        else // If oldParent is root
+        {
+            // Make sibling the root
+            rootIndex = sibling;
+            mLinks[sibling].parent = NULL_NODE;
+            FreeNode(oldParent);
+        }
+
+        mLinks[leafIndex].parent = NULL_NODE;
+    }
+
+
+    void DynamicBBTree::RefitAncestors(const uint32_t nodeIndex)
+    {
         // Walk back up tree refitting boxes
-        size_t iter = mNodes[leafIndex].parent;
+        uint32_t iter = nodeIndex;
         while (iter != NULL_NODE)
         {
             iter = Balance(iter);
+            RotateNodes(iter);
 
-            size_t left = mNodes[iter].left;
-            size_t right = mNodes[iter].right;
-
+            uint32_t left = mNodes[iter].left;
+            uint32_t right = mNodes[iter].right;
 
-            mNodes[iter].height = std::max(mNodes[left].height, mNodes[right].height);
+            mLinks[iter].height = 1 + std::max(mLinks[left].height, mLinks[right].height);
             mNodes[iter].box.Merge(mNodes[left].box, mNodes[right].box);
 
-            iter = mNodes[iter].parent;
+            iter = mLinks[iter].parent;
+        }
+    }
+
+
+    void DynamicBBTree::Rebuild()
+    {
+        if (rootIndex == NULL_NODE || IsLeaf(rootIndex)) return;
+
+        // Keep the leaves in place so entityToNodeIdx stays valid, only internal nodes are rebuilt
+        std::vector<RebuildLeaf> leaves;
+        leaves.reserve((nodeCount + 1) / 2);
+        for (uint32_t i = 0; i < nodeCapacity; i++)
+        {
+            if (mLinks[i].height == FREE_NODE_HEIGHT) continue;
+
+            if (IsLeaf(i))
+            {
+                const BoundingBox& box = mNodes[i].box;
+                leaves.push_back({ i, (box.min + box.max) * 0.5f });
+            }
+            else
+            {
+                FreeNode(i);
+            }
+        }
+
+        rootIndex = BuildSubtree(leaves, 0, static_cast<uint32_t>(leaves.size()));
+        mLinks[rootIndex].parent = NULL_NODE;
+    }
+
+
+    float DynamicBBTree::GetQualityMetric() const
+    {
+        if (rootIndex == NULL_NODE || IsLeaf(rootIndex)) return 0.0f;
+
+        const float rootArea = mNodes[rootIndex].box.SurfaceArea();
+        if (rootArea <= 0.0f) return 0.0f;
+
+        // Internal nodes are the only ones with a positive height
+        float internalArea = 0.0f;
+        for (uint32_t i = 0; i < nodeCapacity; i++)
+        {
+            if (mLinks[i].height > 0)
+                internalArea += mNodes[i].box.SurfaceArea();
         }
+        return internalArea / rootArea;
     }
 
 
-    Entity DynamicBBTree::GetObject(size_t nodeIndex) const
+    uint32_t DynamicBBTree::BuildSubtree(std::vector<RebuildLeaf>& leaves, const uint32_t first, const uint32_t count)
     {
-        const auto iterator = nodeIdxToEntityMap.find(nodeIndex);
-        if (iterator == nodeIdxToEntityMap.end()) {
-            throw PhysicsException("Trying to get node not in map");
+        if (count == 1) return leaves[first].node;
+
+        BoundingBox centroidBox;
+        for (uint32_t i = first; i < first + count; i++)
+            centroidBox.IncludePoint(leaves[i].centroid);
+
+        // Binned SAH over all three axes, same as the static tree builder
+        float bestCost = FLT_MAX;
+        uint8_t bestAxis = 0;
+        uint32_t bestBin = 0;
+        for (uint8_t axis = 0; axis < 3; axis++)
+        {
+            const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+            if (extent <= 0.0f) continue;
+
+            struct Bin { BoundingBox bounds; uint32_t count = 0; };
+            Bin bins[REBUILD_BINS] = {};
+
+            const float scale = static_cast<float>(REBUILD_BINS) / extent;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const uint32_t binIdx = std::min(REBUILD_BINS - 1,
+                    static_cast<uint32_t>((leaves[i].centroid[axis] - centroidBox.min[axis]) * scale));
+                bins[binIdx].count++;
+                bins[binIdx].bounds.Merge(mNodes[leaves[i].node].box);
+            }
+
+            // Sweep from the right to get the cost of everything past each plane
+            float rightArea[REBUILD_BINS - 1];
+            uint32_t rightCount[REBUILD_BINS - 1];
+            BoundingBox rightBox;
+            uint32_t rightSum = 0;
+            for (uint32_t i = REBUILD_BINS - 1; i > 0; i--)
+            {
+                rightSum += bins[i].count;
+                rightBox.Merge(bins[i].bounds);
+                rightCount[i - 1] = rightSum;
+                rightArea[i - 1] = rightBox.SurfaceArea();
+            }
+
+            BoundingBox leftBox;
+            uint32_t leftSum = 0;
+            for (uint32_t i = 0; i < REBUILD_BINS - 1; i++)
+            {
+                leftSum += bins[i].count;
+                leftBox.Merge(bins[i].bounds);
+                if (leftSum == 0 || rightCount[i] == 0) continue;
+
+                const float cost = static_cast<float>(leftSum) * leftBox.SurfaceArea() +
+                    static_cast<float>(rightCount[i]) * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = i;
+                }
+            }
+        }
+
+        uint32_t leftCount = count / 2;
+        if (bestCost < FLT_MAX)
+        {
+            // Recompute the bin the same way so leaves on the plane land on the same side as when binned
+            const float scale = static_cast<float>(REBUILD_BINS) / (centroidBox.max[bestAxis] - centroidBox.min[bestAxis]);
+            const auto middle = std::partition(leaves.begin() + first, leaves.begin() + first + count,
+                [&](const RebuildLeaf& leaf)
+                {
+                    const uint32_t binIdx = std::min(REBUILD_BINS - 1,
+                        static_cast<uint32_t>((leaf.centroid[bestAxis] - centroidBox.min[bestAxis]) * scale));
+                    return binIdx <= bestBin;
+                });
+            leftCount = static_cast<uint32_t>(middle - (leaves.begin() + first));
         }
+        // Otherwise all centroids coincide and any split is as good as another
 
-        return iterator->second;
+        const uint32_t left = BuildSubtree(leaves, first, leftCount);
+        const uint32_t right = BuildSubtree(leaves, first + leftCount, count - leftCount);
+
+        const uint32_t node = AllocateNode();
+        mNodes[node].left = left;
+        mNodes[node].right = right;
+        mNodes[node].box.Merge(mNodes[left].box, mNodes[right].box);
+        mLinks[node].height = 1 + std::max(mLinks[left].height, mLinks[right].height);
+        mLinks[left].parent = node;
+        mLinks[right].parent = node;
+
+        return node;
     }
 
 
-    size_t DynamicBBTree::GetSibling(size_t nodeIndex)
+    uint32_t DynamicBBTree::GetSibling(uint32_t nodeIndex)
     {
-        const auto& parentNode = mNodes[mNodes[nodeIndex].parent];
-        size_t sibling;
+        const auto& parentNode = mNodes[mLinks[nodeIndex].parent];
+        uint32_t sibling;
         if (parentNode.left == nodeIndex) sibling = parentNode.right;
         else
         {
@@ -237,21 +417,21 @@ namespace Physics
     }
 
 
-    size_t DynamicBBTree::FindBestSibling(size_t leafIndex) const
+    uint32_t DynamicBBTree::FindBestSibling(uint32_t leafIndex) const
     {
-        size_t sibling = rootIndex;
+        uint32_t sibling = rootIndex;
         BoundingBox leafBox = mNodes[leafIndex].box;
         while (!IsLeaf(sibling))
         {
             // Surface area of sibling box
-            float surfaceArea = mNodes[sibling].box.surfaceArea;
+            float surfaceArea = mNodes[sibling].box.SurfaceArea();
 
             // Create combined bounding box from inserted box and proposed sibling
             BoundingBox combinedBox;
             combinedBox.Merge(leafBox, mNodes[sibling].box);
 
             // Surface area of combined box
-            float combinedSurfaceArea = combinedBox.surfaceArea;
+            float combinedSurfaceArea = combinedBox.SurfaceArea();
 
             // Cost of creating parent and leaf
             float cost = 2.0f * combinedSurfaceArea;
@@ -260,8 +440,8 @@ namespace Physics
             float inheritedCost = 2.0f * (combinedSurfaceArea - surfaceArea);
 
             // Get indexes of sibling's children bounding boxes
-            size_t left = mNodes[sibling].left;
-            size_t right = mNodes[sibling].right;
+            uint32_t left = mNodes[sibling].left;
+            uint32_t right = mNodes[sibling].right;
 
             // Cost of descending to the left.
             float costLeft;
@@ -269,14 +449,14 @@ namespace Physics
             {
                 BoundingBox aabb;
                 aabb.Merge(leafBox, mNodes[left].box);
-                costLeft = aabb.surfaceArea + inheritedCost;
+                costLeft = aabb.SurfaceArea() + inheritedCost;
             }
             else
             {
                 BoundingBox aabb;
                 aabb.Merge(leafBox, mNodes[left].box);
-                float oldArea = mNodes[left].box.surfaceArea;
-                float newArea = aabb.surfaceArea;
+                float oldArea = mNodes[left].box.SurfaceArea();
+                float newArea = aabb.SurfaceArea();
                 costLeft = (newArea - oldArea) + inheritedCost;
             }
 
@@ -286,14 +466,14 @@ namespace Physics
             {
                 BoundingBox aabb;
                 aabb.Merge(leafBox, mNodes[right].box);
-                costRight = aabb.surfaceArea + inheritedCost;
+                costRight = aabb.SurfaceArea() + inheritedCost;
             }
             else
             {
                 BoundingBox aabb;
                 aabb.Merge(leafBox, mNodes[right].box);
-                float oldArea = mNodes[right].box.surfaceArea;
-                float newArea = aabb.surfaceArea;
+                float oldArea = mNodes[right].box.SurfaceArea();
+                float newArea = aabb.SurfaceArea();
                 costRight = (newArea - oldArea) + inheritedCost;
             }
 
@@ -308,196 +488,411 @@ namespace Physics
     }
 
 
-    std::vector<Entity> DynamicBBTree::ComputeCollisionPairs()
+    std::vector<EntityPair> DynamicBBTree::ComputeCollisionPairs() const
     {
-        std::vector<Entity> output;
-        std::stack<std::pair<size_t, size_t>> stack;
+        std::vector<EntityPair> output;
+        if (rootIndex == NULL_NODE) return output;
+
+        CollidePairs({ rootIndex, rootIndex }, output);
 
-        if (nodeCount <= 1) return output;
+        std::sort(output.begin(), output.end());
+        output.erase(std::unique(output.begin(), output.end()), output.end());
+        return output;
+    }
 
-        stack.emplace(mNodes[rootIndex].left, mNodes[rootIndex].right);
 
-        while (!stack.empty())
+    std::vector<EntityPair> DynamicBBTree::ComputeCollisionPairs(Utils::TaskScheduler& scheduler) const
+    {
+        const size_t workerCount = scheduler.GetWorkerCount();
+
+        // Not worth waking the workers for small trees
+        if (workerCount == 1 || nodeCount < PARALLEL_PAIR_MIN_NODES)
+            return ComputeCollisionPairs();
+
+        const std::vector<NodePair> tasks = SplitPairTasks(workerCount * 4);
+
+        // One buffer per task so no two tasks ever write to the same vector
+        std::vector<std::vector<EntityPair>> buffers(tasks.size());
+        Utils::ParallelFor(scheduler, 0, tasks.size(), 1, [this, &tasks, &buffers](const size_t t)
         {
-            size_t n1_idx = stack.top().first;
-            size_t n2_idx = stack.top().second;
+            CollidePairs(tasks[t], buffers[t]);
+        });
+
+        size_t pairCount = 0;
+        for (const auto& buffer : buffers) pairCount += buffer.size();
+
+        std::vector<EntityPair> output;
+        output.reserve(pairCount);
+        for (const auto& buffer : buffers) output.insert(output.end(), buffer.begin(), buffer.end());
+
+        // Sorting makes the result independent of which worker found which pair
+        std::sort(output.begin(), output.end());
+        output.erase(std::unique(output.begin(), output.end()), output.end());
+        return output;
+    }
+
 
-            const auto& n1 = mNodes[n1_idx];
-            const auto& n2 = mNodes[n2_idx];
-            stack.pop();
+    std::vector<DynamicBBTree::NodePair> DynamicBBTree::SplitPairTasks(const size_t targetCount) const
+    {
+        std::vector<NodePair> tasks{ { rootIndex, rootIndex } };
+        std::vector<NodePair> next;
 
-            if (IsInternal(n1_idx) && IsInternal(n2_idx))
+        // Expand breadth-first until there are enough independent tasks to share between workers
+        bool expanded = true;
+        while (expanded && tasks.size() < targetCount)
+        {
+            expanded = false;
+            next.clear();
+            for (const auto& [a, b] : tasks)
             {
-                stack.emplace(n1.left, n1.right);
-                stack.emplace(n2.left, n2.right);
+                const auto& n1 = mNodes[a];
+                const auto& n2 = mNodes[b];
 
-                if (n1.box.IsColliding(n2.box))
+                if (a == b)
                 {
-                    stack.emplace(n1.left, n2.left);
-                    stack.emplace(n1.left, n2.right);
-                    stack.emplace(n1.right, n2.left);
-                    stack.emplace(n1.right, n2.right);
+                    // Pairs within a leaf's subtree don't exist
+                    if (IsLeaf(a)) continue;
+
+                    next.push_back({ n1.left, n1.left });
+                    next.push_back({ n1.right, n1.right });
+                    next.push_back({ n1.left, n1.right });
+                    expanded = true;
                 }
-            }
-            else if (IsInternal(n1_idx))
-            {
-                stack.emplace(n1.left, n1.right);
-                if (n1.box.IsColliding(n2.box))
+                else if (!n1.box.IsColliding(n2.box))
                 {
-                    stack.emplace(n1.left, n2_idx);
-                    stack.emplace(n1.right, n2_idx);
+                    continue;
                 }
-            }
-            else if (IsInternal(n2_idx))
-            {
-                stack.emplace(n2.left, n2.right);
-                if (n1.box.IsColliding(n2.box))
+                else if (IsLeaf(a) && IsLeaf(b))
+                {
+                    next.push_back({ a, b });
+                }
+                else
                 {
-                    stack.emplace(n1_idx, n2.left);
-                    stack.emplace(n1_idx, n2.right);
+                    // Descend into the larger internal node
+                    if (IsLeaf(b) || (IsInternal(a) && n1.box.SurfaceArea() >= n2.box.SurfaceArea()))
+                    {
+                        next.push_back({ n1.left, b });
+                        next.push_back({ n1.right, b });
+                    }
+                    else
+                    {
+                        next.push_back({ a, n2.left });
+                        next.push_back({ a, n2.right });
+                    }
+                    expanded = true;
                 }
             }
-            else if (n1.box.IsColliding(n2.box))
+            std::swap(tasks, next);
+        }
+        return tasks;
+    }
+
+
+    void DynamicBBTree::CollidePairs(const NodePair task, std::vector<EntityPair>& output) const
+    {
+        // A pair of the same node stands for every pair inside that node's subtree
+        // Self pairs push three entries per level, so this needs more room than a single node stack
+        Utils::InlineStack<NodePair, 2 * TRAVERSAL_STACK_SIZE> stack;
+        stack.Push(task);
+
+        while (!stack.Empty())
+        {
+            const auto [a, b] = stack.Pop();
+
+            const auto& n1 = mNodes[a];
+            const auto& n2 = mNodes[b];
+
+            if (a == b)
+            {
+                if (IsLeaf(a)) continue;
+
+                stack.Push({ n1.left, n1.left });
+                stack.Push({ n1.right, n1.right });
+                stack.Push({ n1.left, n1.right });
+            }
+            else if (!n1.box.IsColliding(n2.box))
             {
-                output.emplace_back(GetObject(n1_idx));
-                output.emplace_back(GetObject(n2_idx));
+                continue;
+            }
+            else if (IsLeaf(a) && IsLeaf(b))
+            {
+                output.emplace_back(std::min(n1.entity, n2.entity), std::max(n1.entity, n2.entity));
+            }
+            else if (IsLeaf(b) || (IsInternal(a) && n1.box.SurfaceArea() >= n2.box.SurfaceArea()))
+            {
+                stack.Push({ n1.left, b });
+                stack.Push({ n1.right, b });
+            }
+            else
+            {
+                stack.Push({ a, n2.left });
+                stack.Push({ a, n2.right });
             }
         }
-        return output;
     }
 
-    std::pair<std::vector<BoundingBox>, bool> DynamicBBTree::QueryRayCollisions(const Ray ray) const
-    {
-        std::stack<size_t> stack;
-        std::vector<BoundingBox> boxes;
 
-        float tmin = FLT_MAX;
-        Entity bestEntity = UINT_MAX;
+    bool DynamicBBTree::QueryRayCollisions(const Ray& ray, std::vector<BoundingBox>& boxes) const
+    {
+        if (rootIndex == NULL_NODE) return false;
 
-        stack.push(rootIndex);
+        bool hit = false;
 
-        while (!stack.empty())
+        Utils::InlineStack<uint32_t, TRAVERSAL_STACK_SIZE> stack;
+        stack.Push(rootIndex);
+        while (!stack.Empty())
         {
-            size_t nodeIndex = stack.top();
-            stack.pop();
-
-            if (nodeIndex == NULL_NODE) continue;
+            const uint32_t nodeIndex = stack.Pop();
 
             const auto& node = mNodes[nodeIndex];
-            auto [t, colliding] = ray.IsColliding(node.box);
+            float t;
+            if (!ray.IsColliding(node.box, FLT_MAX, t)) continue;
 
-            if (!colliding) continue;
             boxes.push_back(node.box);
-            if (!IsLeaf(nodeIndex))
+            if (IsLeaf(nodeIndex))
             {
-                stack.push(node.left);
-                stack.push(node.right);
+                hit = true;
             }
             else
             {
-                if (t < tmin)
+                stack.Push(node.left);
+                stack.Push(node.right);
+            }
+        }
+        return hit;
+    }
+
+
+    std::pair<Entity, bool> DynamicBBTree::QueryRay(const Ray& ray) const
+    {
+        const RayHit hit = QueryClosest(ray);
+        return std::make_pair(hit.entity, hit.hit);
+    }
+
+
+    RayHit DynamicBBTree::QueryClosest(const Ray& ray, const float maxT) const
+    {
+        RayHit best;
+        best.t = maxT;
+
+        float rootT;
+        if (rootIndex == NULL_NODE || !ray.IsColliding(mNodes[rootIndex].box, maxT, rootT)) return best;
+
+        // Nodes are pushed with their entry distance so ones behind a closer hit can be skipped when popped
+        Utils::InlineStack<std::pair<uint32_t, float>, TRAVERSAL_STACK_SIZE> stack;
+        stack.Push({ rootIndex, rootT });
+        while (!stack.Empty())
+        {
+            const auto [nodeIndex, entryT] = stack.Pop();
+            if (entryT > best.t) continue;
+
+            const Node& node = mNodes[nodeIndex];
+            if (IsLeaf(nodeIndex))
+            {
+                // Entry distance is the hit distance for a leaf
+                best.entity = node.entity;
+                best.t = entryT;
+                best.hit = true;
+                continue;
+            }
+
+            float leftT, rightT;
+            const bool hitLeft = ray.IsColliding(mNodes[node.left].box, best.t, leftT);
+            const bool hitRight = ray.IsColliding(mNodes[node.right].box, best.t, rightT);
+
+            // Push the farther child first so the nearer one is visited next
+            if (hitLeft && hitRight)
+            {
+                if (leftT <= rightT)
                 {
-                    bestEntity = GetObject(nodeIndex);
-                    tmin = t;
+                    stack.Push({ node.right, rightT });
+                    stack.Push({ node.left, leftT });
+                }
+                else
+                {
+                    stack.Push({ node.left, leftT });
+                    stack.Push({ node.right, rightT });
                 }
             }
+            else if (hitLeft) stack.Push({ node.left, leftT });
+            else if (hitRight) stack.Push({ node.right, rightT });
         }
-        return std::make_pair(boxes, bestEntity != UINT_MAX);
+
+        if (best.hit) best.point = ray.GetPoint(best.t);
+        return best;
     }
-    std::pair<Entity, bool> DynamicBBTree::QueryRay(const Ray ray) const
+
+
+    void DynamicBBTree::QueryRays(const std::vector<Ray>& rays, std::vector<RayHit>& hits) const
     {
-        std::stack<size_t> stack;
+        hits.assign(rays.size(), RayHit{});
+        if (rootIndex == NULL_NODE || rays.empty()) return;
 
-        float tmin = FLT_MAX;
-        Entity bestEntity = UINT_MAX;
+        // Counting sort by direction octant, rays heading the same way visit the tree in a similar order
+        auto octant = [](const Ray& ray) { return ray.sign[0] | ray.sign[1] << 1 | ray.sign[2] << 2; };
 
-        stack.push(rootIndex);
+        uint32_t octantStart[9] = {};
+        for (const Ray& ray : rays)
+            octantStart[octant(ray) + 1]++;
+        for (int i = 1; i < 9; i++)
+            octantStart[i] += octantStart[i - 1];
 
-        while (!stack.empty())
-        {
-            size_t nodeIndex = stack.top();
-            stack.pop();
+        std::vector<uint32_t> order(rays.size());
+        for (uint32_t i = 0; i < rays.size(); i++)
+            order[octantStart[octant(rays[i])]++] = i;
 
-            if (nodeIndex == NULL_NODE) continue;
+        for (size_t first = 0; first < order.size(); first += Math::SIMD_WIDTH)
+            TraceRayPacket(rays, order.data() + first, std::min(Math::SIMD_WIDTH, order.size() - first), hits);
 
-            const auto& node = mNodes[nodeIndex];
-            auto [t, colliding] = ray.IsColliding(node.box);
+        for (size_t i = 0; i < rays.size(); i++)
+        {
+            if (hits[i].hit) hits[i].point = rays[i].GetPoint(hits[i].t);
+        }
+    }
 
-            if (!colliding) continue;
 
-            if (!IsLeaf(nodeIndex))
+    void DynamicBBTree::TraceRayPacket(const std::vector<Ray>& rays, const uint32_t* indices, const size_t count,
+        std::vector<RayHit>& hits) const
+    {
+        using namespace Math;
+
+        // Transpose the packet into one register per component
+        alignas(32) float lanes[7][SIMD_WIDTH];
+        float* maxT = lanes[6];
+        for (size_t lane = 0; lane < SIMD_WIDTH; lane++)
+        {
+            if (lane < count)
             {
-                stack.push(node.left);
-                stack.push(node.right);
+                const Ray& ray = rays[indices[lane]];
+                for (int d = 0; d < 3; d++)
+                {
+                    lanes[d][lane] = ray.origin[d];
+                    lanes[3 + d][lane] = ray.invdir[d];
+                }
+                maxT[lane] = FLT_MAX;
             }
             else
             {
-                if (t < tmin)
+                // Unused lanes get an empty interval so they never hit anything
+                for (int d = 0; d < 3; d++)
                 {
-                    bestEntity = GetObject(nodeIndex);
-                    tmin = t;
+                    lanes[d][lane] = 0.0f;
+                    lanes[3 + d][lane] = 1.0f;
                 }
+                maxT[lane] = -1.0f;
+            }
+        }
+
+        const SimdFloat originX = SimdLoad(lanes[0]), originY = SimdLoad(lanes[1]), originZ = SimdLoad(lanes[2]);
+        const SimdFloat invDirX = SimdLoad(lanes[3]), invDirY = SimdLoad(lanes[4]), invDirZ = SimdLoad(lanes[5]);
+        const SimdFloat zero = SimdSet(0.0f);
+        SimdFloat packetMaxT = SimdLoad(maxT);
+
+        alignas(32) float entries[SIMD_WIDTH];
+
+        Utils::InlineStack<uint32_t, TRAVERSAL_STACK_SIZE> stack;
+        stack.Push(rootIndex);
+        while (!stack.Empty())
+        {
+            const uint32_t nodeIndex = stack.Pop();
+            const Node& node = mNodes[nodeIndex];
+
+            // Slab test for every lane at once, same as Ray::IsColliding(box, maxT, t)
+            const SimdFloat t1X = (SimdSet(node.box.min.x) - originX) * invDirX;
+            const SimdFloat t2X = (SimdSet(node.box.max.x) - originX) * invDirX;
+            const SimdFloat t1Y = (SimdSet(node.box.min.y) - originY) * invDirY;
+            const SimdFloat t2Y = (SimdSet(node.box.max.y) - originY) * invDirY;
+            const SimdFloat t1Z = (SimdSet(node.box.min.z) - originZ) * invDirZ;
+            const SimdFloat t2Z = (SimdSet(node.box.max.z) - originZ) * invDirZ;
+
+            const SimdFloat entry = SimdMax(SimdMax(SimdMin(t1X, t2X), SimdMin(t1Y, t2Y)), SimdMax(SimdMin(t1Z, t2Z), zero));
+            const SimdFloat exit = SimdMin(SimdMin(SimdMax(t1X, t2X), SimdMax(t1Y, t2Y)), SimdMin(SimdMax(t1Z, t2Z), packetMaxT));
+
+            int hitLanes = SimdBits(entry <= exit);
+            if (hitLanes == 0) continue;
+
+            if (!IsLeaf(nodeIndex))
+            {
+                stack.Push(node.left);
+                stack.Push(node.right);
+                continue;
+            }
+
+            // Each lane clips its own maxT to the closest hit so far
+            SimdStore(entries, entry);
+            for (size_t lane = 0; hitLanes != 0; lane++, hitLanes >>= 1)
+            {
+                if (!(hitLanes & 1)) continue;
+
+                RayHit& hit = hits[indices[lane]];
+                hit.entity = node.entity;
+                hit.t = entries[lane];
+                hit.hit = true;
+                maxT[lane] = entries[lane];
             }
+            packetMaxT = SimdLoad(maxT);
         }
-        if (bestEntity != UINT_MAX) return std::make_pair(bestEntity, true);
-        return std::make_pair(Entity(), false);
     }
 
 
-    void DynamicBBTree::ExpandCapacity(const size_t newNodeCapacity)
+    void DynamicBBTree::ExpandCapacity(const uint32_t newNodeCapacity)
     {
         if (newNodeCapacity <= nodeCapacity) {
             throw PhysicsException("New capacity must be greater than current capacity");
         }
 
-        nodeCapacity = newNodeCapacity;
+        // Resize node vectors
+        mNodes.resize(newNodeCapacity);
+        mLinks.resize(newNodeCapacity);
+
+        // Link the new nodes into the free list
+        for (uint32_t i = newNodeCapacity; i-- > nodeCapacity;)
+        {
+            ResetNodeData(i);
+            mLinks[i].parent = mFreeList;
+            mFreeList = i;
+        }
 
-        // Resize nodes vector
-        mNodes.resize(nodeCapacity);
+        nodeCapacity = newNodeCapacity;
     }
 
 
-    bool DynamicBBTree::IsLeaf(const size_t index) const
+    bool DynamicBBTree::IsLeaf(const uint32_t index) const
     {
-        if (mNodes[index].left == NULL_NODE && mNodes[index].right == NULL_NODE) {
-            if (mNodes[index].height != 0) {
-                throw PhysicsException("Leaf node has non-zero height");
-            }
-        }
-        return mNodes[index].left == NULL_NODE && mNodes[index].right == NULL_NODE;
+        return mNodes[index].right == NULL_NODE;
     }
 
 
-    bool DynamicBBTree::IsInternal(size_t nodeIndex) const
+    bool DynamicBBTree::IsInternal(uint32_t nodeIndex) const
     {
         return !IsLeaf(nodeIndex);
     }
 
 
-    size_t DynamicBBTree::Balance(const size_t node)
+    uint32_t DynamicBBTree::Balance(const uint32_t node)
     {
         // If node is a leaf or height = 0
         if (IsLeaf(node))
             return node;
 
-        size_t left = mNodes[node].left;
-        size_t right = mNodes[node].right;
+        uint32_t left = mNodes[node].left;
+        uint32_t right = mNodes[node].right;
 
-        int currentBalance = static_cast<int>(mNodes[right].height - mNodes[left].height);
+        int currentBalance = static_cast<int>(mLinks[right].height - mLinks[left].height);
 
         // Rotate right branch up.
         if (currentBalance > 1)
         {
             // Store these for later
-            size_t rightLeft = mNodes[right].left;
-            size_t rightRight = mNodes[right].right;
+            uint32_t rightLeft = mNodes[right].left;
+            uint32_t rightRight = mNodes[right].right;
 
             // Swap node and its right-hand child.
             mNodes[right].left = node;
-            mNodes[right].parent = mNodes[node].parent;
-            mNodes[node].parent = right;
+            mLinks[right].parent = mLinks[node].parent;
+            mLinks[node].parent = right;
 
-            size_t nodeOldParent = mNodes[right].parent;
+            uint32_t nodeOldParent = mLinks[right].parent;
 
             // Make node's old parent point to its right-hand child.
             if (nodeOldParent != NULL_NODE)
@@ -511,31 +906,31 @@ namespace Physics
             else rootIndex = right;
 
             // Rotate.
-            if (mNodes[rightLeft].height > mNodes[rightRight].height)
+            if (mLinks[rightLeft].height > mLinks[rightRight].height)
             {
                 mNodes[right].right = rightLeft;
                 mNodes[node].right = rightRight;
 
-                mNodes[rightRight].parent = node;
+                mLinks[rightRight].parent = node;
 
                 mNodes[node].box.Merge(mNodes[left].box, mNodes[rightRight].box);
                 mNodes[right].box.Merge(mNodes[node].box, mNodes[rightLeft].box);
 
-                mNodes[node].height = std::max(mNodes[left].height, mNodes[rightRight].height);
-                mNodes[right].height = std::max(mNodes[node].height, mNodes[rightLeft].height);
+                mLinks[node].height = 1 + std::max(mLinks[left].height, mLinks[rightRight].height);
+                mLinks[right].height = 1 + std::max(mLinks[node].height, mLinks[rightLeft].height);
             }
             else
             {
                 mNodes[right].right = rightRight;
                 mNodes[node].right = rightLeft;
 
-                mNodes[rightLeft].parent = node;
+                mLinks[rightLeft].parent = node;
 
                 mNodes[node].box.Merge(mNodes[left].box, mNodes[rightLeft].box);
                 mNodes[right].box.Merge(mNodes[node].box, mNodes[rightRight].box);
 
-                mNodes[node].height = std::max(mNodes[left].height, mNodes[rightLeft].height);
-                mNodes[right].height = std::max(mNodes[node].height, mNodes[rightRight].height);
+                mLinks[node].height = 1 + std::max(mLinks[left].height, mLinks[rightLeft].height);
+                mLinks[right].height = 1 + std::max(mLinks[node].height, mLinks[rightRight].height);
             }
             return right;
         }
@@ -543,8 +938,8 @@ namespace Physics
         // Rotate left branch up.
         if (currentBalance < -1)
         {
-            size_t leftLeft = mNodes[left].left;
-            size_t leftRight = mNodes[left].right;
+            uint32_t leftLeft = mNodes[left].left;
+            uint32_t leftRight = mNodes[left].right;
 
             if (leftLeft >= nodeCapacity) {
                 throw PhysicsException("Left-left node index exceeds capacity");
@@ -555,45 +950,45 @@ namespace Physics
 
             // Swap node and its left-hand child.
             mNodes[left].left = node;
-            mNodes[left].parent = mNodes[node].parent;
-            mNodes[node].parent = left;
+            mLinks[left].parent = mLinks[node].parent;
+            mLinks[node].parent = left;
 
             // The node's old parent should now point to its left-hand child.
-            if (mNodes[left].parent != NULL_NODE)
+            if (mLinks[left].parent != NULL_NODE)
             {
-                if (mNodes[mNodes[left].parent].left == node) mNodes[mNodes[left].parent].left = left;
+                if (mNodes[mLinks[left].parent].left == node) mNodes[mLinks[left].parent].left = left;
                 else
                 {
-                    if (mNodes[mNodes[left].parent].right != node) {
+                    if (mNodes[mLinks[left].parent].right != node) {
                         throw PhysicsException("Tree structure inconsistency during rotation");
                     }
-                    mNodes[mNodes[left].parent].right = left;
+                    mNodes[mLinks[left].parent].right = left;
                 }
             }
             else rootIndex = left;
 
             // Rotate.
-            if (mNodes[leftLeft].height > mNodes[leftRight].height)
+            if (mLinks[leftLeft].height > mLinks[leftRight].height)
             {
                 mNodes[left].right = leftLeft;
                 mNodes[node].left = leftRight;
-                mNodes[leftRight].parent = node;
+                mLinks[leftRight].parent = node;
                 mNodes[node].box.Merge(mNodes[right].box, mNodes[leftRight].box);
                 mNodes[left].box.Merge(mNodes[node].box, mNodes[leftLeft].box);
 
-                mNodes[node].height = std::max(mNodes[right].height, mNodes[leftRight].height);
-                mNodes[left].height = std::max(mNodes[node].height, mNodes[leftLeft].height);
+                mLinks[node].height = 1 + std::max(mLinks[right].height, mLinks[leftRight].height);
+                mLinks[left].height = 1 + std::max(mLinks[node].height, mLinks[leftLeft].height);
             }
             else
             {
                 mNodes[left].right = leftRight;
                 mNodes[node].left = leftLeft;
-                mNodes[leftLeft].parent = node;
+                mLinks[leftLeft].parent = node;
                 mNodes[node].box.Merge(mNodes[right].box, mNodes[leftLeft].box);
                 mNodes[left].box.Merge(mNodes[node].box, mNodes[leftRight].box);
 
-                mNodes[node].height = std::max(mNodes[right].height, mNodes[leftLeft].height);
-                mNodes[left].height = std::max(mNodes[node].height, mNodes[leftRight].height);
+                mLinks[node].height = 1 + std::max(mLinks[right].height, mLinks[leftLeft].height);
+                mLinks[left].height = 1 + std::max(mLinks[node].height, mLinks[leftRight].height);
             }
 
             return left;
@@ -603,45 +998,113 @@ namespace Physics
     }
 
 
+    void DynamicBBTree::RotateNodes(const uint32_t nodeIndex)
+    {
+        if (IsLeaf(nodeIndex)) return;
+
+        const uint32_t left = mNodes[nodeIndex].left;
+        const uint32_t right = mNodes[nodeIndex].right;
+
+        // Candidate rotations swap one child with one of its sibling's children
+        // The node's own box doesn't change, only the box of the child that receives the swapped node
+        uint32_t bestUp = NULL_NODE, bestDown = NULL_NODE, bestParent = NULL_NODE;
+        float bestGain = 0.0f;
+
+        auto consider = [&](const uint32_t down, const uint32_t parent)
+        {
+            if (IsLeaf(parent)) return;
+
+            for (const uint32_t up : { mNodes[parent].left, mNodes[parent].right })
+            {
+                const uint32_t kept = up == mNodes[parent].left ? mNodes[parent].right : mNodes[parent].left;
+
+                // Only rotate if both levels stay height balanced, so traversal depth stays bounded
+                const int keptHeight = mLinks[kept].height;
+                const int downHeight = mLinks[down].height;
+                const int newParentHeight = 1 + std::max(keptHeight, downHeight);
+                if (std::abs(keptHeight - downHeight) > 1) continue;
+                if (std::abs(mLinks[up].height - newParentHeight) > 1) continue;
+
+                BoundingBox newBox;
+                newBox.Merge(mNodes[down].box, mNodes[kept].box);
+                const float gain = mNodes[parent].box.SurfaceArea() - newBox.SurfaceArea();
+                if (gain > bestGain)
+                {
+                    bestGain = gain;
+                    bestUp = up;
+                    bestDown = down;
+                    bestParent = parent;
+                }
+            }
+        };
+        consider(left, right);
+        consider(right, left);
+
+        if (bestUp == NULL_NODE) return;
+
+        // Swap bestDown (a child of nodeIndex) with bestUp (a grandchild under bestParent)
+        if (mNodes[nodeIndex].left == bestDown) mNodes[nodeIndex].left = bestUp;
+        else mNodes[nodeIndex].right = bestUp;
+
+        if (mNodes[bestParent].left == bestUp) mNodes[bestParent].left = bestDown;
+        else mNodes[bestParent].right = bestDown;
+
+        mLinks[bestUp].parent = nodeIndex;
+        mLinks[bestDown].parent = bestParent;
+
+        const uint32_t parentLeft = mNodes[bestParent].left;
+        const uint32_t parentRight = mNodes[bestParent].right;
+        mNodes[bestParent].box.Merge(mNodes[parentLeft].box, mNodes[parentRight].box);
+        mLinks[bestParent].height = 1 + std::max(mLinks[parentLeft].height, mLinks[parentRight].height);
+    }
+
+
     BoundingBox DynamicBBTree::GetBoundingBox(const Entity object) const {
-        const auto enIterator = entityToNodeIdxMap.find(object);
-        if (enIterator == entityToNodeIdxMap.end())
+        if (object >= entityToNodeIdx.size() || entityToNodeIdx[object] == NULL_NODE)
         {
-            LOG(LOG_ERROR) << "Dynamic Tree: Trying to get entity " << object << " not in map.\n";
+            LOG(LOG_ERROR) << "Dynamic Tree: Trying to get entity " << object << " not in tree.\n";
             return BoundingBox{};
         }
-        return mNodes[enIterator->second].box;
+        return entityBoxes[object];
+    }
+
+    BoundingBox DynamicBBTree::GetFatBoundingBox(const Entity object) const {
+        if (object >= entityToNodeIdx.size() || entityToNodeIdx[object] == NULL_NODE)
+        {
+            LOG(LOG_ERROR) << "Dynamic Tree: Trying to get entity " << object << " not in tree.\n";
+            return BoundingBox{};
+        }
+        return mNodes[entityToNodeIdx[object]].box;
     }
 
     std::vector<BoundingBox> DynamicBBTree::GetAllBoxes(const bool onlyLeaf) const
     {
         std::vector<BoundingBox> output;
-        for (size_t i = 0; i < nodeCount; i++)
+        for (uint32_t i = 0; i < nodeCapacity; i++)
         {
-            if ((!onlyLeaf || IsLeaf(i)) && mNodes[i].height != NULL_NODE)
+            // Skip free nodes
+            if (mLinks[i].height == FREE_NODE_HEIGHT) continue;
+            if (!onlyLeaf || IsLeaf(i))
                 output.emplace_back(mNodes[i].box);
         }
         return output;
     }
 
-    DynamicBBTree::Node& DynamicBBTree::GetNode(Entity entity)
+    uint32_t DynamicBBTree::GetLeafIndex(const Entity entity) const
     {
-        const auto enIterator = entityToNodeIdxMap.find(entity);
-        if (enIterator == entityToNodeIdxMap.end())
-        {
-            LOG(LOG_ERROR) << "Dynamic Tree: Trying to find entity not in map\n";
-            return mNodes[NULL_NODE];
+        if (entity >= entityToNodeIdx.size() || entityToNodeIdx[entity] == NULL_NODE) {
+            throw PhysicsException("Trying to access entity not in tree");
         }
-        return mNodes[enIterator->second];
+        return entityToNodeIdx[entity];
     }
 
 
-    void DynamicBBTree::ResetNodeData(const size_t nodeIndex)
+    void DynamicBBTree::ResetNodeData(const uint32_t nodeIndex)
     {
         mNodes[nodeIndex].box = BoundingBox{};
-        mNodes[nodeIndex].parent = NULL_NODE;
+        mLinks[nodeIndex].parent = NULL_NODE;
         mNodes[nodeIndex].left = NULL_NODE;
         mNodes[nodeIndex].right = NULL_NODE;
-        mNodes[nodeIndex].height = NULL_NODE;
+        mLinks[nodeIndex].height = FREE_NODE_HEIGHT;
     }
 }
@@ -1,86 +1,293 @@
 #pragma once
 #include "math/Ray.h"
+#include "../utils/TaskScheduler.h"
+#include "../utils/InlineStack.h"
+
+#include <type_traits>
 
 
 namespace Physics {
-	constexpr size_t NULL_NODE = 0xffffffff;
+	constexpr uint32_t NULL_NODE = 0xffffffff;
+	constexpr int16_t FREE_NODE_HEIGHT = -1;
+	// Bins per axis used when rebuilding the tree with binned SAH
+	constexpr uint32_t REBUILD_BINS = 16;
+	// Entries kept inline by traversal stacks, far more than a balanced tree of MAX_ENTITIES leaves needs
+	constexpr size_t TRAVERSAL_STACK_SIZE = 64;
+	// Trees with fewer nodes compute collision pairs on the calling thread
+	constexpr uint32_t PARALLEL_PAIR_MIN_NODES = 256;
+
+	// Ordered so that first < second
+	using EntityPair = std::pair<Entity, Entity>;
+
+	// Result of a ray query against the leaves' fat boxes
+	struct RayHit
+	{
+		Entity entity = Entity();
+		// Distance along the ray to where it enters the entity's fat box
+		float t = FLT_MAX;
+		// Point where the ray enters the entity's fat box
+		glm::vec3 point = glm::vec3(0.0f);
+		bool hit = false;
+	};
 
 	// Algorithm adapted from Box2D's dynamic tree
 	class DynamicBBTree
 	{
-		struct Node
+		// Everything a query touches, packed into half a cache line
+		struct alignas(32) Node
 		{
 			BoundingBox box;
-			size_t height, parent, left, right;
+			// Leaves have no children, so they store their entity in place of the left child
+			union
+			{
+				uint32_t left;
+				Entity entity;
+			};
+			// NULL_NODE for leaves
+			uint32_t right;
+		};
+		static_assert(sizeof(Node) == 32, "DynamicBBTree::Node should fit in 32 bytes");
+
+		// Only needed when the tree is restructured, so kept out of the query path
+		struct NodeLinks
+		{
+			// Free nodes use parent to link to the next free node
+			uint32_t parent;
+			// 0 for leaves, FREE_NODE_HEIGHT for free nodes
+			int16_t height;
 		};
 
 	public:
 		std::vector<Node> mNodes;
+		// Parallel to mNodes
+		std::vector<NodeLinks> mLinks;
 
-		size_t nodeCapacity, nodeCount, rootIndex;
+		uint32_t nodeCapacity, nodeCount, rootIndex;
 
-		// Queried to get entity
-		std::unordered_map<size_t, Entity> nodeIdxToEntityMap;
-		// Queried to get node
-		std::unordered_map<Entity, size_t> entityToNodeIdxMap;
+		// Leaves store a "fat" box so small movements don't require re-inserting the leaf
+		// Margin added to every side of a leaf's box
+		float fatMargin = 0.1f;
+		// Scales an update's displacement to predict where the entity is heading
+		float displacementMultiplier = 4.0f;
 
-		// Stack of free nodes
-		std::stack<size_t> mFreeList;
+		// Indexed by entity to get its leaf node, NULL_NODE if the entity isn't in the tree
+		std::vector<uint32_t> entityToNodeIdx;
+		// Indexed by entity to get its tight (non-enlarged) box
+		std::vector<BoundingBox> entityBoxes;
 
-		explicit DynamicBBTree(size_t initialCapacity = 1);
+		// Index of the first free node, the rest are linked through their parent index
+		uint32_t mFreeList;
+
+		explicit DynamicBBTree(uint32_t initialCapacity = 1);
 
 		void InsertEntity(Entity entity, BoundingBox box);
 		void RemoveEntity(Entity entity);
-		void UpdateEntity(Entity entity, BoundingBox box);
-		void UpdateEntity(Entity entity, glm::vec3 transform);
+		// Returns true if the leaf had to be re-inserted, false if its fat box still contains the new box
+		bool UpdateEntity(Entity entity, BoundingBox box, glm::vec3 displacement = glm::vec3(0.0f));
+		bool UpdateEntity(Entity entity, glm::vec3 newCenter);
+
+		// Rebuilds every internal node top-down with binned SAH over the current leaves
+		// Leaves keep their indices and fat boxes, so entity lookups and overlaps are unaffected
+		void Rebuild();
+		// Total surface area of the internal nodes divided by the root's, lower is better
+		// Incremental updates make this creep up; compare against the value after a Rebuild to decide when to rebuild again
+		float GetQualityMetric() const;
 
-		// Uses TreeQuery to compute all box pairs
-		std::vector<Entity> ComputeCollisionPairs();
-		std::pair<std::vector<BoundingBox>, bool> QueryRayCollisions(Ray ray) const;
-		std::pair<Entity, bool> QueryRay(Ray ray) const;
+		// Amount of leaves re-inserted by UpdateEntity since the last reset
+		size_t GetReinsertCount() const { return reinsertCount; }
+		void ResetReinsertCount() { reinsertCount = 0; }
 
-		// Returns reference to object's bounding box
+		// Returns true if the entity has a leaf in the tree
+		bool Contains(Entity entity) const;
+
+		// Entities inserted, removed or re-inserted since the last ClearMoveBuffer, each listed once
+		// Only these can have gained or lost overlaps, since every other leaf kept its fat box
+		const std::vector<Entity>& GetMoveBuffer() const { return mMoveBuffer; }
+		void ClearMoveBuffer();
+
+		// Calls callback(entity) for every leaf whose fat box overlaps box
+		// The callback may return a bool, returning false stops the query
+		template<typename Callback>
+		void QueryAABB(const BoundingBox& box, Callback&& callback) const;
+		// Calls callback(entity, t) for every leaf whose fat box the ray enters within [0, maxT], t being the entry distance
+		// Nearer children are visited first, so clipping to each hit prunes most of the tree
+		// The callback returns the new maxT: 0 stops the query, a smaller value clips the ray for the rest of the traversal
+		template<typename Callback>
+		void RayCast(const Ray& ray, Callback&& callback, float maxT = FLT_MAX) const;
+
+		// Returns every pair of entities whose leaf boxes overlap, sorted and without duplicates
+		std::vector<EntityPair> ComputeCollisionPairs() const;
+		// Same result, with the traversal split into independent subtree pairs run on the scheduler
+		std::vector<EntityPair> ComputeCollisionPairs(Utils::TaskScheduler& scheduler) const;
+		// Appends the box of every node the ray passes through, returns true if any leaf was hit
+		bool QueryRayCollisions(const Ray& ray, std::vector<BoundingBox>& boxes) const;
+		// Returns the entity whose fat box the ray enters first
+		std::pair<Entity, bool> QueryRay(const Ray& ray) const;
+		// Closest hit within [0, maxT], visiting the nearer child first and skipping anything past the best hit
+		RayHit QueryClosest(const Ray& ray, float maxT = FLT_MAX) const;
+		// Same as QueryRay for every ray, hits[i] belongs to rays[i]
+		// Rays are grouped by direction octant and traced in SIMD_WIDTH wide packets
+		void QueryRays(const std::vector<Ray>& rays, std::vector<RayHit>& hits) const;
+
+		// Returns the object's tight bounding box
 		BoundingBox GetBoundingBox(Entity object) const;
+		// Returns the enlarged bounding box stored in the object's leaf
+		BoundingBox GetFatBoundingBox(Entity object) const;
 
 		// Returns a vector of all active bounding boxes
 		// Bool decides whether non-leaf boxes are added
 		std::vector<BoundingBox> GetAllBoxes(const bool onlyLeaf) const;
 
 	private:
-		Node& GetNode(Entity entity);
+		// Two nodes whose subtrees are tested against each other, or one node tested against itself
+		using NodePair = std::pair<uint32_t, uint32_t>;
+
+		struct RebuildLeaf
+		{
+			uint32_t node;
+			glm::vec3 centroid;
+		};
+
+		size_t reinsertCount = 0;
+
+		std::vector<Entity> mMoveBuffer;
+		// Indexed by entity, true if it is already in mMoveBuffer
+		std::vector<bool> entityMoved;
+
+		// Adds the entity to the move buffer if it isn't already there
+		void BufferMove(Entity entity);
+
+		// Splits the self-collision traversal into at least targetCount independent tasks where possible
+		std::vector<NodePair> SplitPairTasks(size_t targetCount) const;
+		// Appends all overlapping leaf pairs under task to output
+		void CollidePairs(NodePair task, std::vector<EntityPair>& output) const;
+
+		// Traces up to SIMD_WIDTH rays, given by indices into rays, through the tree together
+		void TraceRayPacket(const std::vector<Ray>& rays, const uint32_t* indices, size_t count, std::vector<RayHit>& hits) const;
+
+		// Returns the leaf node index of the entity, throws if it isn't in the tree
+		uint32_t GetLeafIndex(Entity entity) const;
+
+		// Returns the box stored in a leaf for the given tight box
+		BoundingBox FattenBox(const BoundingBox& box, glm::vec3 displacement) const;
 		
 		// Allocates a space for a new node
 		// Returns the index position of the allocated node
-		size_t AllocateNode();
+		uint32_t AllocateNode();
 		// Frees a space for a new node
-		void FreeNode(size_t nodeIndex);
+		void FreeNode(uint32_t nodeIndex);
 
 		// Expand capacity
-		void ExpandCapacity(size_t newNodeCapacity);
+		void ExpandCapacity(uint32_t newNodeCapacity);
 
 		// Inserts an allocated node into the tree
-		void InsertLeaf(size_t leafIndex);
+		void InsertLeaf(uint32_t leafIndex);
+		// Detaches a leaf from the tree without freeing it
+		void RemoveLeaf(uint32_t leafIndex);
+		// Balances, rotates and refits every node from nodeIndex up to the root
+		void RefitAncestors(uint32_t nodeIndex);
 
-		// Returns object given node index
-		Entity GetObject(size_t nodeIndex) const;
+		// Builds a subtree over leaves[first, first + count) and returns its root
+		uint32_t BuildSubtree(std::vector<RebuildLeaf>& leaves, uint32_t first, uint32_t count);
 
 		// Gets sibling of node
-		size_t GetSibling(size_t nodeIndex);
+		uint32_t GetSibling(uint32_t nodeIndex);
 
 		// Returns the index of the best sibling
-		size_t FindBestSibling(size_t leafIndex) const;
+		uint32_t FindBestSibling(uint32_t leafIndex) const;
 
 		// Balance
-		size_t Balance(size_t node);
+		uint32_t Balance(uint32_t node);
+		// Swaps a child with a grandchild on the other side if that shrinks the surface area
+		void RotateNodes(uint32_t nodeIndex);
 
 		// Returns true if the node at the given index is a leaf node
-		bool IsLeaf(size_t index) const;
+		bool IsLeaf(uint32_t index) const;
 
 		// Returns true if not a leaf node
-		bool IsInternal(size_t nodeIndex) const;
+		bool IsInternal(uint32_t nodeIndex) const;
 
 		// Resets the data in the node
-		void ResetNodeData(size_t nodeIndex);
+		void ResetNodeData(uint32_t nodeIndex);
 	};
+
+	template<typename Callback>
+	void DynamicBBTree::QueryAABB(const BoundingBox& box, Callback&& callback) const
+	{
+		if (rootIndex == NULL_NODE) return;
+
+		Utils::InlineStack<uint32_t, TRAVERSAL_STACK_SIZE> stack;
+		stack.Push(rootIndex);
+		while (!stack.Empty())
+		{
+			const uint32_t index = stack.Pop();
+
+			const Node& node = mNodes[index];
+			if (!node.box.IsColliding(box)) continue;
+
+			if (IsLeaf(index))
+			{
+				if constexpr (std::is_same_v<std::invoke_result_t<Callback&, Entity>, bool>)
+				{
+					if (!callback(node.entity)) return;
+				}
+				else
+				{
+					callback(node.entity);
+				}
+			}
+			else
+			{
+				stack.Push(node.left);
+				stack.Push(node.right);
+			}
+		}
+	}
+
+	template<typename Callback>
+	void DynamicBBTree::RayCast(const Ray& ray, Callback&& callback, float maxT) const
+	{
+		float rootT;
+		if (rootIndex == NULL_NODE || !ray.IsColliding(mNodes[rootIndex].box, maxT, rootT)) return;
+
+		// Nodes are pushed with their entry distance so ones past a clipped maxT can be skipped when popped
+		Utils::InlineStack<std::pair<uint32_t, float>, TRAVERSAL_STACK_SIZE> stack;
+		stack.Push({ rootIndex, rootT });
+		while (!stack.Empty())
+		{
+			const auto [index, entryT] = stack.Pop();
+			if (entryT > maxT) continue;
+
+			const Node& node = mNodes[index];
+			if (IsLeaf(index))
+			{
+				const float newMaxT = callback(node.entity, entryT);
+				if (newMaxT <= 0.0f) return;
+				maxT = std::min(maxT, newMaxT);
+				continue;
+			}
+
+			float leftT, rightT;
+			const bool hitLeft = ray.IsColliding(mNodes[node.left].box, maxT, leftT);
+			const bool hitRight = ray.IsColliding(mNodes[node.right].box, maxT, rightT);
+
+			// Push the farther child first so leaves are reached roughly front to back
+			if (hitLeft && hitRight)
+			{
+				if (leftT <= rightT)
+				{
+					stack.Push({ node.right, rightT });
+					stack.Push({ node.left, leftT });
+				}
+				else
+				{
+					stack.Push({ node.left, leftT });
+					stack.Push({ node.right, rightT });
+				}
+			}
+			else if (hitLeft) stack.Push({ node.left, leftT });
+			else if (hitRight) stack.Push({ node.right, rightT });
+		}
+	}
 }
 
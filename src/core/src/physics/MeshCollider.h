@@ -1,9 +1,12 @@
 #pragma once
 #include "../components/Collider.h"
+#include "StaticTree.h"
+
 namespace Components
 {
 	struct MeshCollider: Collider
 	{
-		
+		// Built in the mesh's object space and shared by every entity using the same mesh
+		std::shared_ptr<const Physics::StaticTree> tree;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "MeshCollider.h"
+
+#include "../components/Transform.h"
+#include "../core/World.h"
+
+namespace Physics
+{
+	// Narrowphase for a broadphase pair of entities that both have a MeshCollider
+	// Appends the intersecting triangle pairs to contacts, triangle belonging to a and otherTriangle to b
+	// Returns false without touching contacts if either entity has no MeshCollider or the meshes don't touch
+	inline bool CollideMeshes(World& world, const Entity a, const Entity b, std::vector<TriangleContact>& contacts,
+	                          const OverlapOptions& options = {})
+	{
+		const ComponentType colliderType = world.GetComponentType<Components::MeshCollider>();
+		if (!world.GetEntitySignature(a).test(colliderType) || !world.GetEntitySignature(b).test(colliderType)) return false;
+
+		const auto& colliderA = world.GetComponent<Components::MeshCollider>(a);
+		const auto& colliderB = world.GetComponent<Components::MeshCollider>(b);
+		if (!colliderA.tree || !colliderB.tree) return false;
+
+		Components::Transform transformA = world.GetComponent<Components::Transform>(a);
+		Components::Transform transformB = world.GetComponent<Components::Transform>(b);
+		transformA.CalculateModelMat();
+		transformB.CalculateModelMat();
+
+		return colliderA.tree->QueryOverlap(transformA.modelMat, *colliderB.tree, transformB.modelMat, contacts, options);
+	}
+}
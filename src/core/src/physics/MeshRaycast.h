@@ -0,0 +1,76 @@
+#pragma once
+#include "DynamicTree.h"
+#include "MeshCollider.h"
+
+#include "../components/Transform.h"
+#include "../core/World.h"
+
+namespace Physics
+{
+	constexpr size_t NO_TRIANGLE = SIZE_MAX;
+
+	struct MeshRayHit
+	{
+		Entity entity = Entity();
+		// Triangle in the entity's mesh, NO_TRIANGLE if the entity has no MeshCollider and its fat box was hit instead
+		size_t triangle = NO_TRIANGLE;
+		float t = FLT_MAX;
+		glm::vec3 point = glm::vec3(0.0f);
+		// World space unit normal of the hit triangle, zero for box hits
+		glm::vec3 normal = glm::vec3(0.0f);
+		// Weights of the triangle's second and third corners
+		glm::vec2 barycentric = glm::vec2(0.0f);
+		bool hit = false;
+	};
+
+	// Two-level ray cast: the dynamic tree finds candidate entities front to back, then entities with a
+	// MeshCollider have the ray moved into their object space and traced against their triangles
+	// Entities without a MeshCollider are hit where the ray enters their fat box
+	inline MeshRayHit RayCastMeshes(const DynamicBBTree& tree, World& world, const Ray& ray, const float maxT = FLT_MAX)
+	{
+		MeshRayHit best;
+		best.t = maxT;
+
+		const ComponentType colliderType = world.GetComponentType<Components::MeshCollider>();
+
+		tree.RayCast(ray, [&](const Entity entity, const float boxT)
+		{
+			if (!world.GetEntitySignature(entity).test(colliderType))
+			{
+				best = MeshRayHit{};
+				best.entity = entity;
+				best.t = boxT;
+				best.hit = true;
+				return boxT;
+			}
+
+			const auto& collider = world.GetComponent<Components::MeshCollider>(entity);
+			if (!collider.tree) return best.t;
+
+			Components::Transform transform = world.GetComponent<Components::Transform>(entity);
+			transform.CalculateModelMat();
+
+			// Direction is left unnormalized so t measures the same distance in both spaces
+			const glm::mat4 worldToObject = glm::inverse(transform.modelMat);
+			const Ray localRay(glm::vec3(worldToObject * glm::vec4(ray.origin, 1.0f)),
+			                   glm::vec3(worldToObject * glm::vec4(ray.direction, 0.0f)));
+
+			TriangleHit triangleHit;
+			if (!collider.tree->QueryRay(localRay, triangleHit, best.t)) return best.t;
+
+			// Normals transform with the inverse transpose so non-uniform scale keeps them perpendicular
+			const glm::mat3 normalMat = glm::transpose(glm::mat3(worldToObject));
+
+			best.entity = entity;
+			best.triangle = triangleHit.triangle;
+			best.t = triangleHit.t;
+			best.normal = glm::normalize(normalMat * triangleHit.normal);
+			best.barycentric = triangleHit.barycentric;
+			best.hit = true;
+			return best.t;
+		}, maxT);
+
+		if (best.hit) best.point = ray.GetPoint(best.t);
+		return best;
+	}
+}
@@ -0,0 +1,184 @@
+#include "PairCache.h"
+
+#include "../core/GlobalTypes.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace Physics
+{
+    PairCache::PairCache()
+    {
+        mOverlaps.resize(MAX_ENTITIES);
+    }
+
+
+    void PairCache::Update(DynamicBBTree& tree)
+    {
+        mBeginEvents.clear();
+        mEndEvents.clear();
+
+        if (ShouldFullUpdate(tree))
+            FullUpdate(tree.ComputeCollisionPairs());
+        else
+            IncrementalUpdate(tree);
+
+        tree.ClearMoveBuffer();
+    }
+
+
+    void PairCache::Update(DynamicBBTree& tree, Utils::TaskScheduler& scheduler)
+    {
+        mBeginEvents.clear();
+        mEndEvents.clear();
+
+        if (ShouldFullUpdate(tree))
+            FullUpdate(tree.ComputeCollisionPairs(scheduler));
+        else
+            IncrementalUpdate(tree);
+
+        tree.ClearMoveBuffer();
+    }
+
+
+    void PairCache::Clear()
+    {
+        for (auto& overlaps : mOverlaps)
+            overlaps.clear();
+        mBeginEvents.clear();
+        mEndEvents.clear();
+        pairCount = 0;
+    }
+
+
+    std::vector<EntityPair> PairCache::GetPairs() const
+    {
+        std::vector<EntityPair> pairs;
+        pairs.reserve(pairCount);
+
+        for (Entity entity = 0; entity < mOverlaps.size(); entity++)
+        {
+            // Each pair is stored under both entities, only take it from the smaller one
+            const auto& overlaps = mOverlaps[entity];
+            for (auto it = std::upper_bound(overlaps.begin(), overlaps.end(), entity); it != overlaps.end(); ++it)
+                pairs.emplace_back(entity, *it);
+        }
+        return pairs;
+    }
+
+
+    const std::vector<Entity>& PairCache::GetOverlaps(const Entity entity) const
+    {
+        static const std::vector<Entity> none;
+        return entity < mOverlaps.size() ? mOverlaps[entity] : none;
+    }
+
+
+    void PairCache::IncrementalUpdate(DynamicBBTree& tree)
+    {
+        // Sorted so events come out in the same order regardless of insertion order
+        std::vector<Entity> moved = tree.GetMoveBuffer();
+        std::sort(moved.begin(), moved.end());
+
+        std::vector<Entity> found;
+        std::vector<Entity> previous;
+        std::vector<Entity> changed;
+
+        for (const Entity entity : moved)
+        {
+            if (entity >= mOverlaps.size())
+                mOverlaps.resize(static_cast<size_t>(entity) + 1);
+
+            // Removed entities simply find nothing, which ends all of their pairs
+            found.clear();
+            if (tree.Contains(entity))
+            {
+                tree.QueryAABB(tree.GetFatBoundingBox(entity), [entity, &found](const Entity other)
+                {
+                    if (other != entity) found.push_back(other);
+                });
+                std::sort(found.begin(), found.end());
+            }
+
+            // Copied because adding and removing pairs edits this entity's list
+            previous = mOverlaps[entity];
+
+            // If the other entity also moved, the pair is already correct by the time it is processed
+            changed.clear();
+            std::set_difference(found.begin(), found.end(), previous.begin(), previous.end(), std::back_inserter(changed));
+            for (const Entity other : changed)
+            {
+                AddPair(entity, other);
+                mBeginEvents.emplace_back(std::min(entity, other), std::max(entity, other));
+            }
+
+            changed.clear();
+            std::set_difference(previous.begin(), previous.end(), found.begin(), found.end(), std::back_inserter(changed));
+            for (const Entity other : changed)
+            {
+                RemovePair(entity, other);
+                mEndEvents.emplace_back(std::min(entity, other), std::max(entity, other));
+            }
+        }
+
+        std::sort(mBeginEvents.begin(), mBeginEvents.end());
+        std::sort(mEndEvents.begin(), mEndEvents.end());
+    }
+
+
+    void PairCache::FullUpdate(const std::vector<EntityPair>& pairs)
+    {
+        const std::vector<EntityPair> previous = GetPairs();
+
+        std::set_difference(pairs.begin(), pairs.end(), previous.begin(), previous.end(), std::back_inserter(mBeginEvents));
+        std::set_difference(previous.begin(), previous.end(), pairs.begin(), pairs.end(), std::back_inserter(mEndEvents));
+
+        for (auto& overlaps : mOverlaps)
+            overlaps.clear();
+        pairCount = 0;
+
+        // Pairs are sorted, so both entities' lists are filled in ascending order
+        for (const auto& [a, b] : pairs)
+        {
+            const Entity largest = std::max(a, b);
+            if (largest >= mOverlaps.size())
+                mOverlaps.resize(static_cast<size_t>(largest) + 1);
+
+            mOverlaps[a].push_back(b);
+            mOverlaps[b].push_back(a);
+            pairCount++;
+        }
+    }
+
+
+    void PairCache::AddPair(const Entity a, const Entity b)
+    {
+        if (b >= mOverlaps.size())
+            mOverlaps.resize(static_cast<size_t>(b) + 1);
+
+        auto& overlapsA = mOverlaps[a];
+        overlapsA.insert(std::lower_bound(overlapsA.begin(), overlapsA.end(), b), b);
+        auto& overlapsB = mOverlaps[b];
+        overlapsB.insert(std::lower_bound(overlapsB.begin(), overlapsB.end(), a), a);
+
+        pairCount++;
+    }
+
+
+    void PairCache::RemovePair(const Entity a, const Entity b)
+    {
+        auto& overlapsA = mOverlaps[a];
+        overlapsA.erase(std::lower_bound(overlapsA.begin(), overlapsA.end(), b));
+        auto& overlapsB = mOverlaps[b];
+        overlapsB.erase(std::lower_bound(overlapsB.begin(), overlapsB.end(), a));
+
+        pairCount--;
+    }
+
+
+    bool PairCache::ShouldFullUpdate(const DynamicBBTree& tree) const
+    {
+        const size_t leafCount = (tree.nodeCount + 1) / 2;
+        return tree.GetMoveBuffer().size() > fullUpdateRatio * static_cast<float>(leafCount);
+    }
+}
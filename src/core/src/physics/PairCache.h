@@ -0,0 +1,56 @@
+#pragma once
+#include "DynamicTree.h"
+
+
+namespace Physics
+{
+	// Keeps the set of overlapping leaf pairs of a DynamicBBTree between steps
+	// Only entities in the tree's move buffer are queried, so resting entities cost nothing
+	class PairCache
+	{
+	public:
+		// Above this fraction of moved entities a full tree traversal is cheaper than one query per entity
+		float fullUpdateRatio = 0.25f;
+
+		PairCache();
+
+		// Brings the cache up to date with the tree, consuming its move buffer
+		// Pass a scheduler to allow the full update to run in parallel
+		void Update(DynamicBBTree& tree);
+		void Update(DynamicBBTree& tree, Utils::TaskScheduler& scheduler);
+
+		// Drops every pair without reporting end events
+		void Clear();
+
+		// All currently overlapping pairs, sorted
+		std::vector<EntityPair> GetPairs() const;
+		// Entities currently overlapping the given entity, sorted
+		const std::vector<Entity>& GetOverlaps(Entity entity) const;
+
+		// Pairs that started or stopped overlapping in the last Update, sorted
+		const std::vector<EntityPair>& GetBeginEvents() const { return mBeginEvents; }
+		const std::vector<EntityPair>& GetEndEvents() const { return mEndEvents; }
+
+		size_t GetPairCount() const { return pairCount; }
+
+	private:
+		// Indexed by entity, sorted list of overlapping entities
+		std::vector<std::vector<Entity>> mOverlaps;
+
+		std::vector<EntityPair> mBeginEvents;
+		std::vector<EntityPair> mEndEvents;
+
+		size_t pairCount = 0;
+
+		// Re-queries only the moved entities
+		void IncrementalUpdate(DynamicBBTree& tree);
+		// Diffs a full pair list of the tree against the cache
+		void FullUpdate(const std::vector<EntityPair>& pairs);
+
+		void AddPair(Entity a, Entity b);
+		void RemovePair(Entity a, Entity b);
+
+		// Returns true if enough of the tree moved that a full update is the cheaper option
+		bool ShouldFullUpdate(const DynamicBBTree& tree) const;
+	};
+}
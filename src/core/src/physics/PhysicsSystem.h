@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DynamicTree.h"
+#include "PairCache.h"
 
 #include "../core/World.h"
 
@@ -14,6 +15,10 @@ class PhysicsSystem : public System
 {
 public:
     Physics::DynamicBBTree tree;
+    // Overlapping pairs of the tree's leaves, along with the pairs that began or ended this step
+    Physics::PairCache pairCache;
+    // The tree is rebuilt once its quality metric grows this far past the value measured after the last rebuild
+    float treeRebuildRatio = 1.1f;
 
     explicit PhysicsSystem();
 
@@ -24,6 +29,9 @@ public:
 	void AddToTree(Model& object);
 
     void Update(float dt);
+    // Rebuilds the tree if its quality has degraded, then updates the pair cache from the entities
+    // that moved in the tree since the last call
+    void UpdateOverlaps();
 
     void Clean() override;
 private:
@@ -45,13 +53,17 @@ private:
      */
     void ResolveCollisions();
 
+    // Tree quality right after the last rebuild, 0 if the tree has never been rebuilt
+    float rebuiltQuality = 0.0f;
+
 	// Iterates through all rigidbodies updating position and linearVelocity based on dt
 	void Integrate(float dt);
 };
 
 inline PhysicsSystem::PhysicsSystem()
 {
-    tree = Physics::DynamicBBTree{ 1 };
+    // Room for every entity's leaf and parent so the tree never grows mid-simulation
+    tree = Physics::DynamicBBTree{ 2 * MAX_ENTITIES };
 }
 
 inline void PhysicsSystem::AddRigidbody(Mesh& object)
@@ -87,6 +99,17 @@ inline void PhysicsSystem::AddToTree(Model& object)
 inline void PhysicsSystem::Update(float dt)
 {
 	Integrate(dt);
+	UpdateOverlaps();
+}
+
+inline void PhysicsSystem::UpdateOverlaps()
+{
+	if (rebuiltQuality == 0.0f || tree.GetQualityMetric() > rebuiltQuality * treeRebuildRatio)
+	{
+		tree.Rebuild();
+		rebuiltQuality = tree.GetQualityMetric();
+	}
+	pairCache.Update(tree, world.GetScheduler());
 }
 
 inline void PhysicsSystem::Clean()
@@ -96,7 +119,7 @@ inline void PhysicsSystem::Clean()
 
 inline void PhysicsSystem::ResolveCollisions()
 {
-	const auto broadCollisions = tree.ComputeCollisionPairs();
+	const auto broadCollisions = pairCache.GetPairs();
 }
 
 inline void PhysicsSystem::Integrate(float dt)
@@ -118,6 +141,11 @@ inline void PhysicsSystem::Integrate(float dt)
 
 		auto& transform = world.GetComponent<Components::Transform>(entity);
 		transform.worldPos = rb.position;
-		tree.UpdateEntity(entity, rb.position - posOld);
+
+		// Only re-inserts into the tree once the body leaves its fat box
+		const glm::vec3 displacement = rb.position - posOld;
+		BoundingBox box = tree.GetBoundingBox(entity);
+		box.Translate(displacement);
+		tree.UpdateEntity(entity, box, displacement);
 	}
 }
@@ -1,20 +1,50 @@
 #include "StaticTree.h"
+#include "TriangleIntersection.h"
+#include "math/SimdFloat.h"
 #include "utils/Logger.h"
 #include "utils/Timer.h"
+#include "utils/InlineStack.h"
 #include "../core/GlobalTypes.h"
 
+#include <cstring>
+#include <ostream>
+
 
 namespace Physics {
-    void StaticTree::CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices)
+    void StaticTree::CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices,
+	                                  const StaticTreeBuildOptions& options)
+	{
+		// A scheduler that was never started runs every task inside Wait
+		Utils::TaskScheduler scheduler;
+		CreateStaticTree(vertices, indices, scheduler, options);
+	}
+
+
+	void StaticTree::CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices,
+	                                  Utils::TaskScheduler& scheduler, const StaticTreeBuildOptions& options)
 	{
 		LOG(LOG_INFO) << "Creating static tree with " << indices.size() / 3 << " triangles.\n";
 		ClearData();
 
+		mOptions = options.Clamped();
+		// Refit rebuilds from its own copy
+		if (&indices != &mIndices) mIndices = indices;
+		mVertexCount = vertices.size();
+
 		size_t leafNodeAmount = indices.size() / 3;
 
-#ifdef DEBUG
+		// No triangles, no nodes: queries on an empty tree find nothing
+		if (leafNodeAmount == 0)
+		{
+			mCentroids.clear();
+			mTriIdx.clear();
+			mTriangles.clear();
+			mBuildCost = mCost = 0.0f;
+			LOG(LOG_WARNING) << "Static tree created without any triangles.\n";
+			return;
+		}
+
 		Utils::Timer t("StaticTree");
-#endif
 
 		// Includes leaf nodes and internal nodes
 		mNodes.resize(leafNodeAmount * 2 + 1);
@@ -40,67 +70,371 @@ namespace Physics {
 		root.triCount = leafNodeAmount;
 		mNodesUsed = 1;
 
-		mThreadPool.Start();
-		mThreadPool.QueueJob([this] { Subdivide(0); });
+		// Every other node gets its box from its parent's bins
+		// mTriIdx is still the identity, so GetTriangleBounds reads triangles in mesh order like the rest of the build
+		root.box = Utils::ParallelReduce(scheduler, 0, leafNodeAmount, BUILD_PARALLEL_GRAIN, BoundingBox(),
+			[this](const size_t first, const size_t end) { return GetTriangleBounds(first, end); },
+			[](const BoundingBox& a, const BoundingBox& b) { BoundingBox merged; merged.Merge(a, b); return merged; });
 
-		while (mThreadPool.Busy()) {}
-		mThreadPool.Clear();
+		if (mOptions.spatialSplits) BuildSpatial();
+		else Subdivide(0, scheduler);
 
+		ReorderTriangles(scheduler);
+		BuildWideNodes();
+		mBuildCost = mCost = ComputeCost();
 
-#ifdef DEBUG
-		LOG(LOG_INFO) << "Thread pool finished with " << mNodes.size() << " nodes used in " << std::to_string(t.GetElapsed()) << "s.\n";
-#else
-		LOG(LOG_INFO) << "Thread pool finished.\n";
-#endif
+		LOG(LOG_INFO) << "Static tree finished with " << mNodesUsed << " nodes used in " << std::to_string(t.GetElapsed()) << "s.\n";
 	}
 
 
-	std::vector<BoundingBox> StaticTree::QueryTree(const StaticTree& other)
+	bool StaticTree::Refit(const std::vector<MeshPt>& vertices)
 	{
-		std::vector<BoundingBox> output;
-		std::stack<std::pair<size_t, size_t>> stack;
+		Utils::TaskScheduler scheduler;
+		return Refit(vertices, scheduler);
+	}
 
-		stack.emplace(0, 0);
 
-		while (!stack.empty())
+	bool StaticTree::Refit(const std::vector<MeshPt>& vertices, Utils::TaskScheduler& scheduler)
+	{
+		if (mNodesUsed == 0)
 		{
-			auto mine = stack.top().first;
-			auto theirs = stack.top().second;
-			stack.pop();
+			LOG(LOG_WARNING) << "Can't refit a static tree that was never built.\n";
+			return false;
+		}
+		if (vertices.size() != mVertexCount)
+		{
+			LOG(LOG_ERROR) << "Static tree refit got " << vertices.size() << " vertices, the tree was built with " << mVertexCount << ".\n";
+			return false;
+		}
+
+		// One entry per leaf position, spatial splits may list a triangle more than once
+		Utils::ParallelFor(scheduler, 0, mTriIdx.size(), BUILD_PARALLEL_GRAIN, [this, &vertices](const size_t i)
+		{
+			const size_t first = mTriIdx[i] * 3;
+			Triangle& tri = mTriangles[i];
+			tri.v1 = vertices[mIndices[first]].position;
+			tri.v2 = vertices[mIndices[first + 1]].position;
+			tri.v3 = vertices[mIndices[first + 2]].position;
+		});
+
+		// Leaves hold nearly all the work, so they go in parallel
+		const size_t nodesUsed = mNodesUsed;
+		Utils::ParallelFor(scheduler, 0, nodesUsed, BUILD_PARALLEL_GRAIN / 4, [this](const size_t i)
+		{
+			BVHNode& node = mNodes[i];
+			if (node.triCount > 0) node.box = GetTriangleBounds(node.first, node.first + node.triCount);
+		});
+
+		// Children are always claimed after their parent, so walking backwards visits them first
+		for (size_t i = nodesUsed; i-- > 0;)
+		{
+			BVHNode& node = mNodes[i];
+			if (node.triCount == 0) node.box.Merge(mNodes[node.first].box, mNodes[node.first + 1].box);
+		}
+		BuildWideNodes();
+
+		mCost = ComputeCost();
+		if (mCost <= mBuildCost * mOptions.rebuildThreshold) return false;
+
+		LOG(LOG_INFO) << "Static tree cost grew from " << mBuildCost << " to " << mCost << ", rebuilding.\n";
+		CreateStaticTree(vertices, mIndices, scheduler, mOptions);
+		return true;
+	}
+
+
+	namespace
+	{
+		// Identifies compatible layouts, a cache written with other node sizes or SIMD width is rejected
+		struct SerializedHeader
+		{
+			uint32_t version;
+			uint32_t wideNodeWidth;
+			uint32_t nodeSize;
+			uint32_t wideNodeSize;
+		};
+
+		template<typename T>
+		void WriteArray(std::ostream& out, const T* items, const size_t count)
+		{
+			const uint64_t size = count;
+			out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+			out.write(reinterpret_cast<const char*>(items), static_cast<std::streamsize>(count * sizeof(T)));
+		}
+
+		template<typename T>
+		bool ReadValue(const char*& data, const char* end, T& value)
+		{
+			if (static_cast<size_t>(end - data) < sizeof(T)) return false;
+			std::memcpy(&value, data, sizeof(T));
+			data += sizeof(T);
+			return true;
+		}
+
+		template<typename T>
+		bool ReadArray(const char*& data, const char* end, std::vector<T>& items)
+		{
+			uint64_t count;
+			if (!ReadValue(data, end, count)) return false;
+			if (count > static_cast<size_t>(end - data) / sizeof(T)) return false;
+
+			items.resize(count);
+			std::memcpy(items.data(), data, count * sizeof(T));
+			data += count * sizeof(T);
+			return true;
+		}
+	}
+
+
+	void StaticTree::Serialize(std::ostream& out) const
+	{
+		const SerializedHeader header{ STATIC_TREE_FORMAT_VERSION, WIDE_NODE_WIDTH, sizeof(BVHNode), sizeof(WideNode) };
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(&mOptions), sizeof(mOptions));
+
+		const uint64_t vertexCount = mVertexCount;
+		out.write(reinterpret_cast<const char*>(&vertexCount), sizeof(vertexCount));
+		out.write(reinterpret_cast<const char*>(&mBuildCost), sizeof(mBuildCost));
+		out.write(reinterpret_cast<const char*>(&mCost), sizeof(mCost));
+
+		// Centroids are only needed while building and aren't stored
+		WriteArray(out, mNodes.data(), mNodesUsed);
+		WriteArray(out, mWideNodes.data(), mWideNodes.size());
+		WriteArray(out, mTriIdx.data(), mTriIdx.size());
+		WriteArray(out, mTriangles.data(), mTriangles.size());
+		WriteArray(out, mIndices.data(), mIndices.size());
+	}
+
+
+	bool StaticTree::Deserialize(const char*& data, const char* end)
+	{
+		ClearData();
+
+		SerializedHeader header{};
+		if (!ReadValue(data, end, header)) return false;
+		if (header.version != STATIC_TREE_FORMAT_VERSION || header.wideNodeWidth != WIDE_NODE_WIDTH ||
+		    header.nodeSize != sizeof(BVHNode) || header.wideNodeSize != sizeof(WideNode))
+		{
+			LOG(LOG_WARNING) << "Serialized static tree has an incompatible layout, ignoring it.\n";
+			return false;
+		}
+
+		uint64_t vertexCount;
+		const bool read = ReadValue(data, end, mOptions) && ReadValue(data, end, vertexCount) &&
+		                  ReadValue(data, end, mBuildCost) && ReadValue(data, end, mCost) &&
+		                  ReadArray(data, end, mNodes) && ReadArray(data, end, mWideNodes) && ReadArray(data, end, mTriIdx) &&
+		                  ReadArray(data, end, mTriangles) && ReadArray(data, end, mIndices);
+
+		mVertexCount = vertexCount;
+		if (!read || mNodes.empty() || mWideNodes.empty() || mTriIdx.size() != mTriangles.size() || mIndices.size() % 3 != 0 ||
+		    mTriIdx.size() < mIndices.size() / 3 || !IsConsistent())
+		{
+			LOG(LOG_WARNING) << "Serialized static tree is truncated or corrupt, ignoring it.\n";
+			ClearData();
+			return false;
+		}
+
+		mNodesUsed = mNodes.size();
+		return true;
+	}
 
-			if (mNodes[mine].box.IsColliding(other.mNodes[theirs].box))
+
+	bool StaticTree::QueryOverlap(const glm::mat4& modelMat, const StaticTree& other, const glm::mat4& otherModelMat,
+	                              std::vector<TriangleContact>& contacts, const OverlapOptions& options) const
+	{
+		if (mNodesUsed == 0 || other.mNodesUsed == 0) return false;
+
+		// Everything happens in this tree's object space, only the other tree's boxes and triangles get transformed
+		const OverlapTransform transform(glm::inverse(modelMat) * otherModelMat);
+
+		// Plane tolerance of the triangle test scales with triangle size, bounded here by the largest box involved
+		const glm::mat3 otherLinear(transform.otherToLocal);
+		const glm::mat3 absLinear(glm::abs(otherLinear[0]), glm::abs(otherLinear[1]), glm::abs(otherLinear[2]));
+		const glm::vec3 extent = glm::max(mNodes[0].box.max - mNodes[0].box.min, absLinear * (other.mNodes[0].box.max - other.mNodes[0].box.min));
+		const float planeEpsilon = 2.0f * Detail::TRIANGLE_PLANE_EPSILON * std::max({ extent.x, extent.y, extent.z });
+
+		const size_t contactsBefore = contacts.size();
+
+		// Both trees are descended together, always splitting the bigger of the two nodes
+		Utils::InlineStack<std::pair<size_t, size_t>, 128> stack;
+		stack.Push({ 0, 0 });
+		while (!stack.Empty())
+		{
+			const auto [mine, theirs] = stack.Pop();
+			const BVHNode& node = mNodes[mine];
+			const BVHNode& otherNode = other.mNodes[theirs];
+			if (!transform.IsColliding(node.box, otherNode.box)) continue;
+
+			const bool leaf = IsLeaf(mine);
+			const bool otherLeaf = other.IsLeaf(theirs);
+			if (leaf && otherLeaf)
 			{
-				if (IsInternal(mine) && other.IsInternal(theirs))
-				{
-					stack.emplace(mNodes[mine].first, other.mNodes[theirs].first);
-					stack.emplace(mNodes[mine].first + 1, other.mNodes[theirs].first);
-					stack.emplace(mNodes[mine].first, other.mNodes[theirs].first + 1);
-					stack.emplace(mNodes[mine].first + 1, other.mNodes[theirs].first + 1);
-				}
-				else if (IsLeaf(mine))
+				if (IntersectLeaves(mine, other, theirs, transform, modelMat, planeEpsilon, contacts, options)) return true;
+				continue;
+			}
+
+			if (otherLeaf || (!leaf && node.box.SurfaceArea() >= otherNode.box.SurfaceArea() * transform.areaScale))
+			{
+				stack.Push({ node.first + 1, theirs });
+				stack.Push({ node.first, theirs });
+			}
+			else
+			{
+				stack.Push({ mine, otherNode.first + 1 });
+				stack.Push({ mine, otherNode.first });
+			}
+		}
+		// Triangles referenced by several leaves can meet the same other triangle more than once
+		if (HasDuplicateReferences() || other.HasDuplicateReferences())
+		{
+			auto byPair = [](const TriangleContact& a, const TriangleContact& b)
+			{
+				return a.triangle != b.triangle ? a.triangle < b.triangle : a.otherTriangle < b.otherTriangle;
+			};
+			auto samePair = [](const TriangleContact& a, const TriangleContact& b)
+			{
+				return a.triangle == b.triangle && a.otherTriangle == b.otherTriangle;
+			};
+			std::sort(contacts.begin() + contactsBefore, contacts.end(), byPair);
+			contacts.erase(std::unique(contacts.begin() + contactsBefore, contacts.end(), samePair), contacts.end());
+		}
+		return contacts.size() > contactsBefore;
+	}
+
+
+	bool StaticTree::IntersectLeaves(const size_t nodeIndex, const StaticTree& other, const size_t otherNodeIndex,
+	                                 const OverlapTransform& transform, const glm::mat4& modelMat, const float planeEpsilon,
+	                                 std::vector<TriangleContact>& contacts, const OverlapOptions& options) const
+	{
+		using namespace Math;
+
+		const BVHNode& node = mNodes[nodeIndex];
+		const BVHNode& otherNode = other.mNodes[otherNodeIndex];
+
+		// The other leaf goes through in packets of SIMD_WIDTH triangles, corners stored per coordinate
+		for (size_t packet = otherNode.first; packet < otherNode.first + otherNode.triCount; packet += SIMD_WIDTH)
+		{
+			const size_t packetSize = std::min(SIMD_WIDTH, otherNode.first + otherNode.triCount - packet);
+
+			glm::vec3 corners[SIMD_WIDTH][3];
+			float lanes[9][SIMD_WIDTH] = {};
+			for (size_t lane = 0; lane < packetSize; lane++)
+			{
+				const Triangle& tri = other.GetTriangle(packet + lane);
+				corners[lane][0] = glm::vec3(transform.otherToLocal * glm::vec4(tri.v1, 1.0f));
+				corners[lane][1] = glm::vec3(transform.otherToLocal * glm::vec4(tri.v2, 1.0f));
+				corners[lane][2] = glm::vec3(transform.otherToLocal * glm::vec4(tri.v3, 1.0f));
+				for (int c = 0; c < 3; c++)
 				{
-					stack.emplace(mine, other.mNodes[theirs].first);
-					stack.emplace(mine, other.mNodes[theirs].first + 1);
+					lanes[c * 3 + 0][lane] = corners[lane][c].x;
+					lanes[c * 3 + 1][lane] = corners[lane][c].y;
+					lanes[c * 3 + 2][lane] = corners[lane][c].z;
 				}
-				else if (other.IsLeaf(theirs))
+			}
+			const int packetBits = (1 << packetSize) - 1;
+
+			for (size_t i = node.first; i < node.first + node.triCount; i++)
+			{
+				const Triangle& tri = GetTriangle(i);
+				const glm::vec3 normal = glm::cross(tri.v2 - tri.v1, tri.v3 - tri.v1);
+				const float epsilon = planeEpsilon * glm::length(normal);
+
+				// Only triangles with corners on both sides of this triangle's plane can cross it
+				const SimdFloat normalX = SimdSet(normal.x), normalY = SimdSet(normal.y), normalZ = SimdSet(normal.z);
+				const SimdFloat offset = SimdSet(glm::dot(normal, tri.v1));
+				SimdFloat minDistance = SimdSet(FLT_MAX);
+				SimdFloat maxDistance = SimdSet(-FLT_MAX);
+				for (int c = 0; c < 3; c++)
 				{
-					stack.emplace(mNodes[mine].first, theirs);
-					stack.emplace(mNodes[mine].first + 1, theirs);
+					const SimdFloat distance = normalX * SimdLoad(lanes[c * 3 + 0]) + normalY * SimdLoad(lanes[c * 3 + 1]) +
+					                           normalZ * SimdLoad(lanes[c * 3 + 2]) - offset;
+					minDistance = SimdMin(minDistance, distance);
+					maxDistance = SimdMax(maxDistance, distance);
 				}
-				else
+
+				int straddling = SimdBits((minDistance <= SimdSet(epsilon)) & (SimdSet(-epsilon) <= maxDistance)) & packetBits;
+				if (straddling == 0) continue;
+
+				const glm::vec3 triCorners[3] = { tri.v1, tri.v2, tri.v3 };
+				for (size_t lane = 0; straddling != 0; lane++, straddling >>= 1)
 				{
-					output.emplace_back(mNodes[mine].box);
-					output.emplace_back(other.mNodes[theirs].box);
+					if ((straddling & 1) == 0) continue;
+
+					glm::vec3 point;
+					if (!IntersectTriangles(triCorners, corners[lane], options.contactPoints ? &point : nullptr)) continue;
+
+					TriangleContact& contact = contacts.emplace_back();
+					contact.triangle = mTriIdx[i];
+					contact.otherTriangle = other.mTriIdx[packet + lane];
+					if (options.contactPoints) contact.point = glm::vec3(modelMat * glm::vec4(point, 1.0f));
+					if (options.anyHit) return true;
 				}
 			}
 		}
-		return output;
+		return false;
+	}
+
+
+	StaticTree::OverlapTransform::OverlapTransform(const glm::mat4& otherToLocal): otherToLocal(otherToLocal)
+	{
+		const glm::mat3 linear(otherToLocal);
+		const glm::vec3 edges[3] = { linear[0], linear[1], linear[2] };
+
+		auto addAxis = [this, &edges](const glm::vec3& axis)
+		{
+			// Parallel edges give no axis, the face axes already cover that direction
+			if (glm::dot(axis, axis) < 1e-12f) return;
+
+			axes[axisCount] = axis;
+			absAxes[axisCount] = glm::abs(axis);
+			otherProjections[axisCount] = glm::abs(glm::vec3(glm::dot(axis, edges[0]), glm::dot(axis, edges[1]), glm::dot(axis, edges[2])));
+			axisCount++;
+		};
+
+		// This tree's axes first, on their own they are the transformed box against box test and reject most pairs
+		for (int i = 0; i < 3; i++)
+		{
+			glm::vec3 axis(0.0f);
+			axis[i] = 1.0f;
+			addAxis(axis);
+		}
+		// The other box's face normals, which aren't its edges once it is sheared by non-uniform scale
+		for (int i = 0; i < 3; i++)
+			addAxis(glm::cross(edges[(i + 1) % 3], edges[(i + 2) % 3]));
+		for (int i = 0; i < 3; i++)
+		{
+			for (const glm::vec3& edge : edges)
+			{
+				glm::vec3 axis(0.0f);
+				axis[i] = 1.0f;
+				addAxis(glm::cross(axis, edge));
+			}
+		}
+
+		areaScale = std::pow(std::abs(glm::determinant(linear)), 2.0f / 3.0f);
+	}
+
+
+	bool StaticTree::OverlapTransform::IsColliding(const BoundingBox& box, const BoundingBox& otherBox) const
+	{
+		const glm::vec3 center = (box.min + box.max) * 0.5f;
+		const glm::vec3 extent = (box.max - box.min) * 0.5f;
+		const glm::vec3 otherCenter = glm::vec3(otherToLocal * glm::vec4((otherBox.min + otherBox.max) * 0.5f, 1.0f));
+		const glm::vec3 otherExtent = (otherBox.max - otherBox.min) * 0.5f;
+		const glm::vec3 offset = otherCenter - center;
+
+		for (size_t i = 0; i < axisCount; i++)
+		{
+			const float radius = glm::dot(absAxes[i], extent) + glm::dot(otherProjections[i], otherExtent);
+			if (std::abs(glm::dot(axes[i], offset)) > radius) return false;
+		}
+		return true;
 	}
 
 
 	std::vector<BoundingBox> StaticTree::QueryTree(const BoundingBox& box)
 	{
 		std::vector<BoundingBox> output;
+		if (mNodesUsed == 0) return output;
 		std::stack<size_t> stack;
 
 		stack.emplace(0);
@@ -127,9 +461,125 @@ namespace Physics {
 	}
 
 
+	bool StaticTree::QueryRay(const Ray& ray, TriangleHit& hit, const float maxT) const
+	{
+		using namespace Math;
+
+		float rootT;
+		if (mNodesUsed == 0 || !ray.IsColliding(mNodes[0].box, maxT, rootT)) return false;
+
+		float bestT = maxT;
+		size_t best = 0;
+		bool found = false;
+
+		const SimdFloat originX = SimdSet(ray.origin.x), originY = SimdSet(ray.origin.y), originZ = SimdSet(ray.origin.z);
+		const SimdFloat invDirX = SimdSet(ray.invdir.x), invDirY = SimdSet(ray.invdir.y), invDirZ = SimdSet(ray.invdir.z);
+		const SimdFloat zero = SimdSet(0.0f);
+
+		// Either a wide node or, with triCount above 0, a leaf's triangle range
+		struct Entry
+		{
+			uint32_t index;
+			uint32_t triCount;
+			float t;
+		};
+
+		// Front to back: nearest child popped first, anything entered past the best hit is skipped
+		Utils::InlineStack<Entry, 64> stack;
+		stack.Push({ 0, 0, rootT });
+		while (!stack.Empty())
+		{
+			const Entry entry = stack.Pop();
+			if (entry.t > bestT) continue;
+
+			if (entry.triCount > 0)
+			{
+				for (size_t i = entry.index; i < entry.index + entry.triCount; ++i)
+				{
+					float t, u, v;
+					if (!IntersectTriangle(ray, GetTriangle(i), bestT, t, u, v)) continue;
+
+					bestT = t;
+					best = i;
+					found = true;
+					hit.t = t;
+					hit.barycentric = glm::vec2(u, v);
+				}
+				continue;
+			}
+
+			// Slab test against every child at once, same as Ray::IsColliding(box, maxT, t)
+			const WideNode& node = mWideNodes[entry.index];
+			const SimdFloat t1X = (SimdLoad(node.minX) - originX) * invDirX;
+			const SimdFloat t2X = (SimdLoad(node.maxX) - originX) * invDirX;
+			const SimdFloat t1Y = (SimdLoad(node.minY) - originY) * invDirY;
+			const SimdFloat t2Y = (SimdLoad(node.maxY) - originY) * invDirY;
+			const SimdFloat t1Z = (SimdLoad(node.minZ) - originZ) * invDirZ;
+			const SimdFloat t2Z = (SimdLoad(node.maxZ) - originZ) * invDirZ;
+
+			const SimdFloat entries = SimdMax(SimdMax(SimdMin(t1X, t2X), SimdMin(t1Y, t2Y)), SimdMax(SimdMin(t1Z, t2Z), zero));
+			const SimdFloat exits = SimdMin(SimdMin(SimdMax(t1X, t2X), SimdMax(t1Y, t2Y)), SimdMin(SimdMax(t1Z, t2Z), SimdSet(bestT)));
+
+			int hitChildren = SimdBits(entries <= exits) & ((1 << node.childCount) - 1);
+			if (hitChildren == 0) continue;
+
+			float childT[WIDE_NODE_WIDTH];
+			SimdStore(childT, entries);
+
+			// Sorted farthest first so the nearest child ends up on top of the stack
+			Entry hits[WIDE_NODE_WIDTH];
+			size_t hitCount = 0;
+			for (uint32_t lane = 0; hitChildren != 0; lane++, hitChildren >>= 1)
+			{
+				if (!(hitChildren & 1)) continue;
+
+				const Entry child{ node.child[lane], node.triCount[lane], childT[lane] };
+				size_t j = hitCount++;
+				for (; j > 0 && hits[j - 1].t < child.t; j--) hits[j] = hits[j - 1];
+				hits[j] = child;
+			}
+			for (size_t i = 0; i < hitCount; i++) stack.Push(hits[i]);
+		}
+
+		if (found)
+		{
+			const Triangle& tri = GetTriangle(best);
+			hit.triangle = mTriIdx[best];
+			hit.normal = glm::normalize(glm::cross(tri.v2 - tri.v1, tri.v3 - tri.v1));
+		}
+		return found;
+	}
+
+
+	bool StaticTree::IntersectTriangle(const Ray& ray, const Triangle& tri, const float maxT, float& t, float& u, float& v)
+	{
+		const glm::vec3 edge1 = tri.v2 - tri.v1;
+		const glm::vec3 edge2 = tri.v3 - tri.v1;
+
+		const glm::vec3 p = glm::cross(ray.direction, edge2);
+		const float det = glm::dot(edge1, p);
+		// Ray is parallel to the triangle's plane
+		// Back faces aren't culled, so det may be negative
+		if (std::abs(det) < 1e-12f) return false;
+
+		const float invDet = 1.0f / det;
+		const glm::vec3 s = ray.origin - tri.v1;
+		u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f) return false;
+
+		const glm::vec3 q = glm::cross(s, edge1);
+		v = glm::dot(ray.direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f) return false;
+
+		t = glm::dot(edge2, q) * invDet;
+		return t >= 0.0f && t <= maxT;
+	}
+
+
 	std::vector<BoundingBox> StaticTree::GetBoxes(const bool onlyLeaf) const
 	{
 		std::vector<BoundingBox> output;
+		if (mNodesUsed == 0) return output;
 		for (size_t i = 0; i < mNodesUsed - 1; ++i)
 		{
 			if (IsLeaf(i) || !onlyLeaf)
@@ -152,143 +602,330 @@ namespace Physics {
 	}
 
 
-	void StaticTree::Subdivide(size_t nodeIndex)
+	void StaticTree::Subdivide(const size_t nodeIndex, Utils::TaskScheduler& scheduler)
 	{
-		BVHNode& node = mNodes[nodeIndex];
-		UpdateNodeBoundingBox(nodeIndex);
+		// A task per node costs more than building small subtrees directly
+		if (mNodes[nodeIndex].triCount < BUILD_SERIAL_CUTOFF)
+		{
+			SubdivideSerial(nodeIndex);
+			return;
+		}
 
-		if (node.triCount <= TRI_LIMIT) return;
+		const bool parallelSplit = mNodes[nodeIndex].triCount >= BUILD_PARALLEL_SPLIT_MIN;
+		BinSet bins;
+		if (!SplitNode(nodeIndex, parallelSplit ? &scheduler : nullptr, bins)) return;
 
-		uint8_t axis = 4;
-		float splitPos;
+		const size_t leftChildIdx = mNodes[nodeIndex].first;
+		Utils::TaskGroup group(scheduler);
+		group.Run([this, leftChildIdx, &scheduler] { Subdivide(leftChildIdx, scheduler); });
+		Subdivide(leftChildIdx + 1, scheduler);
+		group.Wait();
+	}
 
-		// Find axis, split position, and split cost
-		float splitCost = FindBestSplitPlane(nodeIndex, axis, splitPos);
-		node.box.UpdateSurfaceArea();
-		if (splitCost >= node.box.surfaceArea * static_cast<float>(node.triCount)) return;
 
-		size_t beginIter = node.first;
-		size_t endIter = node.first + (node.triCount - 1);
-		while (beginIter <= endIter)
+	void StaticTree::SubdivideSerial(const size_t nodeIndex)
+	{
+		BinSet bins;
+		Utils::InlineStack<size_t, 64> stack;
+		stack.Push(nodeIndex);
+		while (!stack.Empty())
 		{
-			if (GetCentroid(beginIter)[axis] <= splitPos)
-				++beginIter;
-			else
-				std::swap(mTriIdx[beginIter], mTriIdx[endIter--]);
+			const size_t current = stack.Pop();
+			if (!SplitNode(current, nullptr, bins)) continue;
+
+			stack.Push(mNodes[current].first + 1);
+			stack.Push(mNodes[current].first);
 		}
+	}
 
-		// Stop split if one side is empty
-		size_t leftCount = beginIter - node.first;
-#ifdef DEBUG
-		assert(leftCount != 0 && leftCount != node.triCount);
-#endif
-		// if (leftCount == 0 || leftCount == node.triCount) return;
 
-		// create child nodes
-		size_t leftChildIdx;
-		size_t rightChildIdx;
+	bool StaticTree::SplitNode(const size_t nodeIndex, Utils::TaskScheduler* scheduler, BinSet& bins)
+	{
+		BVHNode& node = mNodes[nodeIndex];
+		if (node.triCount <= 1) return false;
+
+		const size_t first = node.first;
+		const size_t end = node.first + node.triCount;
+
+		BoundingBox centroidBox;
+		if (scheduler)
 		{
-			// Ensures left child index and right child index are 1 apart
-			// Also prevents data racing
-			std::unique_lock<std::mutex> lock(nodesUsedMutex);
-			leftChildIdx = mNodesUsed++;
-			rightChildIdx = mNodesUsed++;
+			centroidBox = Utils::ParallelReduce(*scheduler, first, end, BUILD_PARALLEL_GRAIN, BoundingBox(),
+				[this](const size_t rangeFirst, const size_t rangeEnd) { return GetCentroidBounds(rangeFirst, rangeEnd); },
+				[](const BoundingBox& a, const BoundingBox& b) { BoundingBox merged; merged.Merge(a, b); return merged; });
+
+			bins = Utils::ParallelReduce(*scheduler, first, end, BUILD_PARALLEL_GRAIN, BinSet(),
+				[this, &centroidBox](const size_t rangeFirst, const size_t rangeEnd)
+				{
+					BinSet rangeBins;
+					FillBins(rangeFirst, rangeEnd, centroidBox, rangeBins);
+					return rangeBins;
+				},
+				[](BinSet a, const BinSet& b) { a.Merge(b); return a; });
 		}
+		else
+		{
+			centroidBox = GetCentroidBounds(first, end);
+			FillBins(first, end, centroidBox, bins);
+		}
+
+		SplitPlane plane;
+		BoundingBox leftBox, rightBox;
+		const float splitCost = FindBestSplitPlane(bins, centroidBox, node.box.SurfaceArea(), plane, leftBox, rightBox);
+		if (splitCost == FLT_MAX) return false;
+
+		const float leafCost = static_cast<float>(node.triCount) * mOptions.intersectionCost;
+		if (node.triCount <= mOptions.maxLeafSize && splitCost >= leafCost) return false;
 
-		mNodes[leftChildIdx].first = node.first;
-		mNodes[leftChildIdx].triCount = leftCount;
+		const size_t splitIndex = scheduler ? ParallelPartition(*scheduler, first, end, plane) : Partition(first, end, plane);
 
-		mNodes[rightChildIdx].first = beginIter;
-		mNodes[rightChildIdx].triCount = node.triCount - leftCount;
+		// Claims both children at once so they are always adjacent
+		const size_t leftChildIdx = mNodesUsed.fetch_add(2, std::memory_order_relaxed);
+		const size_t rightChildIdx = leftChildIdx + 1;
+
+		mNodes[leftChildIdx].box = leftBox;
+		mNodes[leftChildIdx].first = first;
+		mNodes[leftChildIdx].triCount = splitIndex - first;
+
+		mNodes[rightChildIdx].box = rightBox;
+		mNodes[rightChildIdx].first = splitIndex;
+		mNodes[rightChildIdx].triCount = end - splitIndex;
 
 		node.first = leftChildIdx;
 		node.triCount = 0;
-
-		// recurse
-		mThreadPool.QueueJob([this, leftChildIdx] { Subdivide(leftChildIdx); });
-		mThreadPool.QueueJob([this, rightChildIdx] { Subdivide(rightChildIdx); });
+		return true;
 	}
 
 
-	float StaticTree::FindBestSplitPlane(size_t nodeIndex, uint8_t& axis, float& splitPos)
+	float StaticTree::FindBestSplitPlane(const BinSet& bins, const BoundingBox& centroidBox, const float nodeArea, SplitPlane& plane,
+	                                     BoundingBox& leftBox, BoundingBox& rightBox) const
 	{
-		BVHNode& node = mNodes[nodeIndex];
-
-		BoundingBox centroidBox;
-		centroidBox.SetToLimit();
-
-		// Have box include all centroids
-		for (size_t t = node.first; t < node.first + node.triCount; ++t)
-		{
-			centroidBox.IncludePoint(GetCentroid(t));
-		}
+		const uint32_t binCount = mOptions.binCount;
+		// Flat nodes have no area to compare against, every split is as good as any other then
+		const float invNodeArea = nodeArea > 0.0f ? 1.0f / nodeArea : 0.0f;
 
 		float bestCost = FLT_MAX;
 		for (uint8_t currentAxis = 0; currentAxis < 3; ++currentAxis)
 		{
-			Bin bins[BINS_AMT] = {};
+			const float extent = centroidBox.max[currentAxis] - centroidBox.min[currentAxis];
+			// Every centroid sits on the same plane, so this axis can't separate them
+			if (!(extent > 0.0f)) continue;
 
-			float scale = static_cast<float>(BINS_AMT) / (centroidBox.max[currentAxis] - centroidBox.min[currentAxis]);
+			const Bin* axisBins = bins.bins[currentAxis];
 
-			// Update bins based on triangles in the node
-			for (size_t i = node.first; i < node.first + node.triCount; ++i)
-			{
-				// Determine which bin based on triangle centroid position
-				unsigned binIdx = std::min(static_cast<unsigned>(BINS_AMT - 1),
-				                           static_cast<unsigned>((GetCentroid(i)[currentAxis] - centroidBox.min[
-					                           currentAxis]) * scale));
-
-				++bins[binIdx].triCount;
-
-				// Expand bin bounding box based on triangle vertices
-				const Triangle& tri = GetTriangle(i);
-				bins[binIdx].bounds.IncludePoint(tri.v1);
-				bins[binIdx].bounds.IncludePoint(tri.v2);
-				bins[binIdx].bounds.IncludePoint(tri.v3);
-			}
-
-			// Keeps track of each split plane candidate's bounding box area and triangle count
-			float leftArea[BINS_AMT - 1], rightArea[BINS_AMT - 1];
-			size_t leftCount[BINS_AMT - 1], rightCount[BINS_AMT - 1];
+			// Keeps track of each split plane candidate's bounding box and triangle count
+			BoundingBox leftBoxes[MAX_BUILD_BINS - 1], rightBoxes[MAX_BUILD_BINS - 1];
+			size_t leftCount[MAX_BUILD_BINS - 1], rightCount[MAX_BUILD_BINS - 1];
 			size_t leftSum = 0, rightSum = 0;
 
-			BoundingBox leftBox, rightBox;
+			BoundingBox leftAccum, rightAccum;
 
-			for (size_t i = 0; i < BINS_AMT - 1; ++i)
+			for (size_t i = 0; i < binCount - 1; ++i)
 			{
-				leftSum += bins[i].triCount;
+				leftSum += axisBins[i].triCount;
 				leftCount[i] = leftSum;
-				if (bins[i].triCount > 0)
-					leftBox.Merge(bins[i].bounds);
-				leftArea[i] = leftBox.surfaceArea;
-
-
-				rightSum += bins[BINS_AMT - i - 2].triCount;
-				rightCount[BINS_AMT - i - 2] = rightSum;
-				if (bins[BINS_AMT - i - 2].triCount > 0)
-					rightBox.Merge(bins[BINS_AMT - i - 2].bounds);
-				rightArea[BINS_AMT - i - 2] = rightBox.surfaceArea;
+				if (axisBins[i].triCount > 0)
+					leftAccum.Merge(axisBins[i].bounds);
+				leftBoxes[i] = leftAccum;
+
+				rightSum += axisBins[binCount - i - 1].triCount;
+				rightCount[binCount - i - 2] = rightSum;
+				if (axisBins[binCount - i - 1].triCount > 0)
+					rightAccum.Merge(axisBins[binCount - i - 1].bounds);
+				rightBoxes[binCount - i - 2] = rightAccum;
 			}
 
 			// calculate SAH cost for each split plane candidate
-			scale = (centroidBox.max[currentAxis] - centroidBox.min[currentAxis]) / BINS_AMT;
-			for (int i = 0; i < BINS_AMT - 1; i++)
+			for (size_t i = 0; i < binCount - 1; i++)
 			{
-				const float planeCost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (leftCount[i] == 0 || rightCount[i] == 0) continue;
 
-				if (planeCost < bestCost && leftCount[i] != 0 && rightCount[i] != 0)
+				const float planeCost = mOptions.traversalCost + mOptions.intersectionCost * invNodeArea *
+					(static_cast<float>(leftCount[i]) * leftBoxes[i].SurfaceArea() +
+					 static_cast<float>(rightCount[i]) * rightBoxes[i].SurfaceArea());
+				if (planeCost < bestCost)
 				{
 					bestCost = planeCost;
 
 					// Update parameters
-					axis = currentAxis;
-					splitPos = centroidBox.min[currentAxis] + scale * (static_cast<float>(i) + 1.0f);
+					plane.axis = currentAxis;
+					plane.bin = i;
+					plane.min = centroidBox.min[currentAxis];
+					plane.scale = static_cast<float>(binCount) / extent;
+					leftBox = leftBoxes[i];
+					rightBox = rightBoxes[i];
 				}
 			}
 		}
 		return bestCost;
 	}
 
+
+	size_t StaticTree::GetBinIndex(const float centroid, const float min, const float scale) const
+	{
+		return std::min(static_cast<size_t>(mOptions.binCount - 1), static_cast<size_t>((centroid - min) * scale));
+	}
+
+
+	BoundingBox StaticTree::GetTriangleBounds(const size_t first, const size_t end) const
+	{
+		BoundingBox box;
+		for (size_t i = first; i < end; ++i)
+		{
+			const Triangle& tri = GetTriangle(i);
+			box.IncludePoint(tri.v1);
+			box.IncludePoint(tri.v2);
+			box.IncludePoint(tri.v3);
+		}
+		return box;
+	}
+
+
+	BoundingBox StaticTree::GetCentroidBounds(const size_t first, const size_t end) const
+	{
+		BoundingBox box;
+		for (size_t i = first; i < end; ++i)
+			box.IncludePoint(GetCentroid(i));
+		return box;
+	}
+
+
+	void StaticTree::FillBins(const size_t first, const size_t end, const BoundingBox& centroidBox, BinSet& bins) const
+	{
+		glm::vec3 scale;
+		for (uint8_t axis = 0; axis < 3; ++axis)
+		{
+			const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+			// Flat axes put everything in the first bin and never produce a split
+			scale[axis] = extent > 0.0f ? static_cast<float>(mOptions.binCount) / extent : 0.0f;
+		}
+
+		for (uint8_t axis = 0; axis < 3; ++axis)
+		{
+			for (uint32_t i = 0; i < mOptions.binCount; ++i)
+				bins.bins[axis][i] = Bin{};
+		}
+
+		// The triangle's box is computed once and shared by all three axes
+		for (size_t i = first; i < end; ++i)
+		{
+			// Triangles are still in mesh order while building
+			const Triangle& tri = mTriangles[mTriIdx[i]];
+			BoundingBox triBox;
+			triBox.IncludePoint(tri.v1);
+			triBox.IncludePoint(tri.v2);
+			triBox.IncludePoint(tri.v3);
+
+			const glm::vec3 centroid = GetCentroid(i);
+			for (uint8_t axis = 0; axis < 3; ++axis)
+			{
+				Bin& bin = bins.bins[axis][GetBinIndex(centroid[axis], centroidBox.min[axis], scale[axis])];
+				++bin.triCount;
+				bin.bounds.Merge(triBox);
+			}
+		}
+	}
+
+
+	size_t StaticTree::Partition(const size_t first, const size_t end, const SplitPlane& plane)
+	{
+		size_t beginIter = first;
+		size_t endIter = end;
+		while (beginIter < endIter)
+		{
+			if (IsLeft(beginIter, plane))
+				++beginIter;
+			else
+				std::swap(mTriIdx[beginIter], mTriIdx[--endIter]);
+		}
+		return beginIter;
+	}
+
+
+	size_t StaticTree::ParallelPartition(Utils::TaskScheduler& scheduler, const size_t first, const size_t end, const SplitPlane& plane)
+	{
+		// Partition fixed size blocks independently, each block ends up as [left..., right...]
+		const size_t blockCount = (end - first + BUILD_PARALLEL_GRAIN - 1) / BUILD_PARALLEL_GRAIN;
+		std::vector<size_t> blockSplits(blockCount);
+		Utils::ParallelFor(scheduler, 0, blockCount, 1, [this, first, end, &plane, &blockSplits](const size_t block)
+		{
+			const size_t blockFirst = first + block * BUILD_PARALLEL_GRAIN;
+			blockSplits[block] = Partition(blockFirst, std::min(blockFirst + BUILD_PARALLEL_GRAIN, end), plane);
+		});
+
+		size_t splitIndex = first;
+		for (size_t block = 0; block < blockCount; block++)
+			splitIndex += blockSplits[block] - (first + block * BUILD_PARALLEL_GRAIN);
+
+		// Right triangles in front of the split and left triangles behind it are equally many, swap them pairwise
+		// Each misplaced run is stored with the amount of misplaced triangles before it
+		struct Run { size_t start, length, offset; };
+		std::vector<Run> misplacedRight, misplacedLeft;
+		size_t rightTotal = 0, leftTotal = 0;
+		for (size_t block = 0; block < blockCount; block++)
+		{
+			const size_t blockFirst = first + block * BUILD_PARALLEL_GRAIN;
+			const size_t blockEnd = std::min(blockFirst + BUILD_PARALLEL_GRAIN, end);
+			const size_t blockSplit = blockSplits[block];
+
+			const size_t rightEnd = std::min(blockEnd, splitIndex);
+			if (blockSplit < rightEnd)
+			{
+				misplacedRight.push_back({ blockSplit, rightEnd - blockSplit, rightTotal });
+				rightTotal += rightEnd - blockSplit;
+			}
+
+			const size_t leftStart = std::max(blockFirst, splitIndex);
+			if (leftStart < blockSplit)
+			{
+				misplacedLeft.push_back({ leftStart, blockSplit - leftStart, leftTotal });
+				leftTotal += blockSplit - leftStart;
+			}
+		}
+		assert(rightTotal == leftTotal);
+
+		// Finds the position of the k-th misplaced triangle
+		auto locate = [](const std::vector<Run>& runs, const size_t k)
+		{
+			const auto run = std::upper_bound(runs.begin(), runs.end(), k,
+				[](const size_t value, const Run& r) { return value < r.offset; }) - 1;
+			return run->start + (k - run->offset);
+		};
+
+		const size_t swapCount = rightTotal;
+		const size_t chunkCount = (swapCount + BUILD_PARALLEL_GRAIN - 1) / BUILD_PARALLEL_GRAIN;
+		Utils::ParallelFor(scheduler, 0, chunkCount, 1, [this, swapCount, &misplacedRight, &misplacedLeft, &locate](const size_t chunk)
+		{
+			const size_t chunkFirst = chunk * BUILD_PARALLEL_GRAIN;
+			const size_t chunkEnd = std::min(chunkFirst + BUILD_PARALLEL_GRAIN, swapCount);
+			for (size_t k = chunkFirst; k < chunkEnd; k++)
+				std::swap(mTriIdx[locate(misplacedRight, k)], mTriIdx[locate(misplacedLeft, k)]);
+		});
+
+		return splitIndex;
+	}
+
+
+	bool StaticTree::IsLeft(const size_t index, const SplitPlane& plane) const
+	{
+		return GetBinIndex(GetCentroid(index)[plane.axis], plane.min, plane.scale) <= plane.bin;
+	}
+
+
+	void StaticTree::BinSet::Merge(const BinSet& other)
+	{
+		for (uint8_t axis = 0; axis < 3; ++axis)
+		{
+			for (size_t i = 0; i < MAX_BUILD_BINS; ++i)
+			{
+				if (other.bins[axis][i].triCount == 0) continue;
+				bins[axis][i].triCount += other.bins[axis][i].triCount;
+				bins[axis][i].bounds.Merge(other.bins[axis][i].bounds);
+			}
+		}
+	}
+
+
 	glm::vec3 StaticTree::GetCentroid(const size_t index) const
 	{
 		return mCentroids[mTriIdx[index]];
@@ -296,28 +933,151 @@ namespace Physics {
 
 	const StaticTree::Triangle& StaticTree::GetTriangle(const size_t index) const
 	{
-		return mTriangles[mTriIdx[index]];
+		return mTriangles[index];
 	}
 
-	void StaticTree::UpdateNodeBoundingBox(size_t nodeIndex)
+	float StaticTree::ComputeCost() const
 	{
-		BVHNode& node = mNodes[nodeIndex];
-		node.box.SetToLimit();
+		if (mNodesUsed == 0) return 0.0f;
+		const float rootArea = mNodes[0].box.SurfaceArea();
+		if (rootArea <= 0.0f) return 0.0f;
 
-		// Update bounds
-		for (size_t t = node.first; t < node.first + node.triCount; ++t)
+		float cost = 0.0f;
+		for (size_t i = 0; i < mNodesUsed; i++)
 		{
-			const Triangle& tri = GetTriangle(t);
-			node.box.IncludePoint(tri.v1);
-			node.box.IncludePoint(tri.v2);
-			node.box.IncludePoint(tri.v3);
+			const BVHNode& node = mNodes[i];
+			cost += node.box.SurfaceArea() * (node.triCount > 0 ? node.triCount * mOptions.intersectionCost : mOptions.traversalCost);
+		}
+		return cost / rootArea;
+	}
+
+
+	void StaticTree::ReorderTriangles(Utils::TaskScheduler& scheduler)
+	{
+		std::vector<Triangle> ordered(mTriIdx.size());
+		Utils::ParallelFor(scheduler, 0, ordered.size(), BUILD_PARALLEL_GRAIN, [this, &ordered](const size_t i)
+		{
+			ordered[i] = mTriangles[mTriIdx[i]];
+		});
+		mTriangles.swap(ordered);
+	}
+
+
+	void StaticTree::BuildWideNodes()
+	{
+		mWideNodes.clear();
+		mWideNodes.reserve(mNodesUsed / 2 + 1);
+
+		if (IsInternal(0))
+		{
+			CollapseNode(0);
+			return;
+		}
+
+		// A tree that is a single leaf still needs a node above it
+		WideNode& root = mWideNodes.emplace_back();
+		const BVHNode& leaf = mNodes[0];
+		root.minX[0] = leaf.box.min.x; root.minY[0] = leaf.box.min.y; root.minZ[0] = leaf.box.min.z;
+		root.maxX[0] = leaf.box.max.x; root.maxY[0] = leaf.box.max.y; root.maxZ[0] = leaf.box.max.z;
+		root.child[0] = static_cast<uint32_t>(leaf.first);
+		root.triCount[0] = static_cast<uint32_t>(leaf.triCount);
+		root.childCount = 1;
+	}
+
+
+	uint32_t StaticTree::CollapseNode(const size_t nodeIndex)
+	{
+		// Start from the two children and keep replacing the largest internal one by its own children
+		size_t children[WIDE_NODE_WIDTH] = { mNodes[nodeIndex].first, mNodes[nodeIndex].first + 1 };
+		size_t childCount = 2;
+		while (childCount < WIDE_NODE_WIDTH)
+		{
+			size_t largest = WIDE_NODE_WIDTH;
+			float largestArea = -1.0f;
+			for (size_t i = 0; i < childCount; i++)
+			{
+				if (IsLeaf(children[i])) continue;
+
+				const float area = mNodes[children[i]].box.SurfaceArea();
+				if (area > largestArea)
+				{
+					largest = i;
+					largestArea = area;
+				}
+			}
+			if (largest == WIDE_NODE_WIDTH) break;
+
+			const size_t opened = children[largest];
+			children[largest] = mNodes[opened].first;
+			children[childCount++] = mNodes[opened].first + 1;
+		}
+
+		// Parents come before their children, and the vector may grow during the recursion so it is indexed every time
+		const uint32_t wideIndex = static_cast<uint32_t>(mWideNodes.size());
+		mWideNodes.emplace_back();
+		mWideNodes[wideIndex] = WideNode{};
+		mWideNodes[wideIndex].childCount = static_cast<uint32_t>(childCount);
+
+		for (size_t i = 0; i < childCount; i++)
+		{
+			const BVHNode& child = mNodes[children[i]];
+			const uint32_t childIndex = IsLeaf(children[i]) ? static_cast<uint32_t>(child.first) : CollapseNode(children[i]);
+
+			WideNode& node = mWideNodes[wideIndex];
+			node.minX[i] = child.box.min.x; node.minY[i] = child.box.min.y; node.minZ[i] = child.box.min.z;
+			node.maxX[i] = child.box.max.x; node.maxY[i] = child.box.max.y; node.maxZ[i] = child.box.max.z;
+			node.child[i] = childIndex;
+			node.triCount[i] = static_cast<uint32_t>(child.triCount);
+		}
+		return wideIndex;
+	}
+
+
+	bool StaticTree::IsConsistent() const
+	{
+		const size_t triangleCount = mIndices.size() / 3;
+		for (const unsigned index : mIndices)
+			if (index >= mVertexCount) return false;
+		for (const size_t triangle : mTriIdx)
+			if (triangle >= triangleCount) return false;
+
+		auto inTriangles = [size = mTriangles.size()](const size_t first, const size_t count)
+		{
+			return first <= size && count <= size - first;
+		};
+
+		for (size_t i = 0; i < mNodes.size(); i++)
+		{
+			const BVHNode& node = mNodes[i];
+			if (node.triCount > 0)
+			{
+				if (!inTriangles(node.first, node.triCount)) return false;
+			}
+			else if (node.first <= i || node.first + 1 >= mNodes.size()) return false;
+		}
+
+		for (size_t i = 0; i < mWideNodes.size(); i++)
+		{
+			const WideNode& node = mWideNodes[i];
+			if (node.childCount == 0 || node.childCount > WIDE_NODE_WIDTH) return false;
+			for (size_t lane = 0; lane < node.childCount; lane++)
+			{
+				if (node.triCount[lane] > 0)
+				{
+					if (!inTriangles(node.child[lane], node.triCount[lane])) return false;
+				}
+				else if (node.child[lane] <= i || node.child[lane] >= mWideNodes.size()) return false;
+			}
 		}
+		return true;
 	}
 
 
 	void StaticTree::ClearData()
 	{
 		mNodes.clear();
+		mWideNodes.clear();
+		mNodesUsed = 0;
 	}
 
 
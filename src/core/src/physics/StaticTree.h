@@ -1,17 +1,130 @@
 #pragma once
-#define BINS_AMT 8
-#define TRI_LIMIT 1
-#define DEBUG 1
-
 #include "BoundingBox.h"
 #include "core/GlobalTypes.h"
-#include "../utils/ThreadPool.h"
+#include "math/Ray.h"
+#include "math/SimdFloat.h"
+#include "../utils/TaskScheduler.h"
+
+#include <algorithm>
+#include <iosfwd>
 
 // Adapted from: https://github.com/jbikker/bvh_article/blob/main/quickbuild.cpp
 // Full article explanation: https://jacco.ompf2.com/2022/04/21/how-to-build-a-bvh-part-3-quick-builds/
-// TODO: Make all models load at the same time
 namespace Physics
 {
+	// Subtrees with fewer triangles are built serially by the task that reaches them
+	constexpr size_t BUILD_SERIAL_CUTOFF = 4096;
+	// Nodes with at least this many triangles also bin and partition their triangles in parallel
+	constexpr size_t BUILD_PARALLEL_SPLIT_MIN = 65536;
+	// Triangles per piece of a parallel binning or partition step
+	constexpr size_t BUILD_PARALLEL_GRAIN = 16384;
+	// Upper limit for StaticTreeBuildOptions::binCount, sizes the bin arrays
+	constexpr uint32_t MAX_BUILD_BINS = 32;
+	// Children per node of the collapsed tree used by queries, one SIMD register of boxes
+	constexpr size_t WIDE_NODE_WIDTH = Math::SIMD_WIDTH;
+	// Bumped whenever the layout written by StaticTree::Serialize changes
+	constexpr uint32_t STATIC_TREE_FORMAT_VERSION = 2;
+
+	// How a StaticTree trades build time against query speed
+	// Costs follow the surface area heuristic: a node is split if
+	//   traversalCost + (area(left) * triangles(left) + area(right) * triangles(right)) / area(node)
+	// is lower than the cost of keeping it a leaf, triangles(node) * intersectionCost
+	struct StaticTreeBuildOptions
+	{
+		// Candidate split planes per axis are binCount - 1, clamped to [2, MAX_BUILD_BINS]
+		uint32_t binCount = 8;
+		// Nodes with more triangles are always split if any plane separates them, smaller ones only if the SAH says so
+		size_t maxLeafSize = 4;
+		// Cost of visiting a node and of testing one triangle, only their ratio matters
+		float traversalCost = 1.0f;
+		float intersectionCost = 1.0f;
+		// Refit rebuilds the tree once its SAH cost exceeds this multiple of the cost right after the last build
+		float rebuildThreshold = 1.3f;
+
+		// Spatial split build (SBVH, Stich et al. 2009): nodes may also be split by a plane that clips the triangles
+		// crossing it, which then end up in both children. Much tighter boxes on meshes with long, thin triangles,
+		// but the build is slower and runs on the calling thread only
+		bool spatialSplits = false;
+		// Spatial splits are only searched where the best object split's children overlap by more than this
+		// fraction of the root's surface area
+		float spatialSplitAlpha = 1e-5f;
+		// Triangle references the spatial splits may add, as a fraction of the triangle count
+		float duplicationBudget = 0.25f;
+
+		// Few bins and big leaves, for meshes that are rebuilt often or queried rarely
+		static StaticTreeBuildOptions FastBuild();
+		// Many bins, for static meshes that take a lot of queries
+		static StaticTreeBuildOptions HighQuality();
+
+		// The options a build actually uses, the only place out of range values are brought in range
+		StaticTreeBuildOptions Clamped() const;
+
+		bool operator==(const StaticTreeBuildOptions& other) const;
+		bool operator!=(const StaticTreeBuildOptions& other) const { return !(*this == other); }
+	};
+
+	inline StaticTreeBuildOptions StaticTreeBuildOptions::FastBuild()
+	{
+		StaticTreeBuildOptions options;
+		options.binCount = 4;
+		options.maxLeafSize = 8;
+		options.traversalCost = 2.0f;
+		return options;
+	}
+
+	inline StaticTreeBuildOptions StaticTreeBuildOptions::HighQuality()
+	{
+		StaticTreeBuildOptions options;
+		options.binCount = 32;
+		options.maxLeafSize = 8;
+		options.traversalCost = 2.0f;
+		return options;
+	}
+
+	inline StaticTreeBuildOptions StaticTreeBuildOptions::Clamped() const
+	{
+		StaticTreeBuildOptions options = *this;
+		options.binCount = std::clamp(binCount, 2u, MAX_BUILD_BINS);
+		return options;
+	}
+
+	inline bool StaticTreeBuildOptions::operator==(const StaticTreeBuildOptions& other) const
+	{
+		return binCount == other.binCount && maxLeafSize == other.maxLeafSize && traversalCost == other.traversalCost &&
+		       intersectionCost == other.intersectionCost && rebuildThreshold == other.rebuildThreshold &&
+		       spatialSplits == other.spatialSplits && spatialSplitAlpha == other.spatialSplitAlpha &&
+		       duplicationBudget == other.duplicationBudget;
+	}
+
+	// Closest triangle hit by a ray, everything in the tree's (object) space
+	struct TriangleHit
+	{
+		// Index of the triangle in the mesh's index buffer, its corners are indices[3 * triangle + 0..2]
+		size_t triangle = 0;
+		float t = FLT_MAX;
+		// Weights of the second and third corners, the first one is 1 - u - v
+		glm::vec2 barycentric = glm::vec2(0.0f);
+		// Unit geometric normal, following the triangle's winding
+		glm::vec3 normal = glm::vec3(0.0f);
+	};
+
+	// Pair of intersecting triangles found by StaticTree::QueryOverlap
+	struct TriangleContact
+	{
+		// Triangle of the queried tree and of the other one, indexed like TriangleHit::triangle
+		size_t triangle = 0;
+		size_t otherTriangle = 0;
+		// World space point where the triangles cross, only filled in if OverlapOptions::contactPoints is set
+		glm::vec3 point = glm::vec3(0.0f);
+	};
+
+	struct OverlapOptions
+	{
+		// Stop at the first intersecting pair, enough to know whether two meshes touch
+		bool anyHit = false;
+		bool contactPoints = false;
+	};
+
 	class StaticTree
 	{
 		struct BVHNode
@@ -29,51 +142,198 @@ namespace Physics
 			size_t triCount{};
 		};
 
+		// Bins of all three axes, filled in one pass over the triangles
+		struct BinSet
+		{
+			Bin bins[3][MAX_BUILD_BINS];
+
+			void Merge(const BinSet& other);
+		};
+
+		// Triangles whose centroid falls in bin or below go to the left child
+		// Partitioning by bin index rather than a position keeps the children exactly as the bins saw them
+		struct SplitPlane
+		{
+			uint8_t axis = 0;
+			size_t bin = 0;
+			float min = 0.0f;
+			float scale = 0.0f;
+		};
+
 		struct Triangle
 		{
 			glm::vec3 v1, v2, v3;
 		};
 
+		// Part of a triangle owned by a node of the spatial split build
+		// A triangle crossing a spatial split has a reference on both sides, each bounding only its own piece
+		struct Reference
+		{
+			BoundingBox box;
+			size_t triangle = 0;
+		};
+
+		// Node of the collapsed tree, child boxes stored per coordinate so one SIMD test covers all of them
+		// Children are packed at the front, slots past childCount are unused
+		struct alignas(64) WideNode
+		{
+			float minX[WIDE_NODE_WIDTH], minY[WIDE_NODE_WIDTH], minZ[WIDE_NODE_WIDTH];
+			float maxX[WIDE_NODE_WIDTH], maxY[WIDE_NODE_WIDTH], maxZ[WIDE_NODE_WIDTH];
+			// Wide node index for internal children, first triangle for leaves
+			uint32_t child[WIDE_NODE_WIDTH];
+			// 0 for internal children
+			uint32_t triCount[WIDE_NODE_WIDTH];
+			uint32_t childCount;
+		};
+
+		// Other tree's nodes seen from this tree's object space, as parallelepipeds
+		// Holds the 15 separating axis candidates: this tree's box axes, the other box's face normals and
+		// the cross products of their edges. Axes are unnormalized, only the sign of the comparison matters
+		struct OverlapTransform
+		{
+			glm::mat4 otherToLocal{};
+			size_t axisCount = 0;
+			glm::vec3 axes[15];
+			glm::vec3 absAxes[15];
+			// |dot(axis, edge)| for the other box's three edge directions, multiplied with its extents gives its radius
+			glm::vec3 otherProjections[15];
+			// Surface areas of the other tree's boxes grow by this factor when transformed
+			float areaScale = 1.0f;
+
+			explicit OverlapTransform(const glm::mat4& otherToLocal);
+			bool IsColliding(const BoundingBox& box, const BoundingBox& otherBox) const;
+		};
+
 		// Index positions of triangles, eventually sorted by centroids depending on node
+		// With spatial splits a triangle can appear more than once, so this may be longer than the triangle count
 		std::vector<size_t> mTriIdx;
 		// Vector of all triangle centroids
 		std::vector<glm::vec3> mCentroids;
 
-		// Keeps index position of next free node
-		size_t mNodesUsed = 0;
-		// Prevents data racing
-		// Using this instead of atomic var because left child idx and right child idx should be next to each other
-		std::mutex nodesUsedMutex;
+		// Keeps index position of next free node, siblings are claimed two at a time so they stay adjacent
+		std::atomic<size_t> mNodesUsed{ 0 };
 
-		// Triangle data
+		// Triangle data, stored in leaf order once the build is done so leaves read a contiguous range
 		std::vector<Triangle> mTriangles;
 
-		// Thread pool for quick computation
-		Utils::ThreadPool mThreadPool;
+		// Built from mNodes after every build and refit, queries that only read the tree go through these
+		std::vector<WideNode> mWideNodes;
+
+		// Options of the build in progress, binCount already clamped
+		StaticTreeBuildOptions mOptions;
+
+		// Topology kept for Refit, which only receives new vertex positions
+		std::vector<unsigned> mIndices;
+		size_t mVertexCount = 0;
+		// SAH cost right after the last build and after the last refit
+		float mBuildCost = 0.0f;
+		float mCost = 0.0f;
 	public:
 		std::vector<BVHNode> mNodes;
 
 		StaticTree() = default;
 
-		void CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices);
+		// Builds on the scheduler's workers, the calling thread helps until the tree is done
+		void CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices, Utils::TaskScheduler& scheduler,
+		                      const StaticTreeBuildOptions& options = {});
+		// Builds on the calling thread only
+		void CreateStaticTree(const std::vector<MeshPt>& vertices, const std::vector<unsigned>& indices,
+		                      const StaticTreeBuildOptions& options = {});
+
+		// Moves the tree onto new positions of the same vertices, keeping its topology and only updating node boxes
+		// Falls back to a full rebuild if the boxes degraded past StaticTreeBuildOptions::rebuildThreshold
+		// Returns true if it rebuilt
+		bool Refit(const std::vector<MeshPt>& vertices, Utils::TaskScheduler& scheduler);
+		bool Refit(const std::vector<MeshPt>& vertices);
+		// Expected cost of a query relative to testing one triangle, as estimated by the SAH
+		float GetCost() const { return mCost; }
+		// Options of the last build, binCount clamped to what was actually used
+		const StaticTreeBuildOptions& GetOptions() const { return mOptions; }
+		// Whether building with options would give this tree, lets loaders reject trees stored with other settings
+		bool WasBuiltWith(const StaticTreeBuildOptions& options) const { return mOptions == options.Clamped(); }
 
-		std::vector<BoundingBox> QueryTree(const StaticTree& other);
+		// Writes the built tree in a binary layout that Deserialize can load without building
+		// The layout depends on the platform and on WIDE_NODE_WIDTH, it is meant for local caches, not for shipping
+		void Serialize(std::ostream& out) const;
+		// Reads a tree written by Serialize starting at data, which is moved past it
+		// Returns false, leaving the tree empty, if the data is truncated or was written by an incompatible build
+		bool Deserialize(const char*& data, const char* end);
+
+		// Finds the intersecting triangle pairs of two transformed trees and appends them to contacts
+		// Returns true if there was at least one, with anyHit set contacts receives only that one
+		bool QueryOverlap(const glm::mat4& modelMat, const StaticTree& other, const glm::mat4& otherModelMat,
+		                  std::vector<TriangleContact>& contacts, const OverlapOptions& options = {}) const;
 		std::vector<BoundingBox> QueryTree(const BoundingBox& box);
+		// Finds the closest triangle hit within [0, maxT], returns false if there is none
+		// The ray's direction doesn't need to be normalized, t is measured in multiples of it
+		bool QueryRay(const Ray& ray, TriangleHit& hit, float maxT = FLT_MAX) const;
 
 		std::vector<BoundingBox> GetBoxes(bool onlyLeaf = true) const;
 		std::vector<BoundingBox> GetBoxes(const glm::mat4& modelMat, bool onlyLeaf = true) const;
 
 	private:
 		
-		void Subdivide(size_t nodeIndex);
+		// Fork-join build: the left child is forked, the right one continues on this thread
+		void Subdivide(size_t nodeIndex, Utils::TaskScheduler& scheduler);
+		void SubdivideSerial(size_t nodeIndex);
+		// Splits a node into two children with known boxes, returns false if it should stay a leaf
+		// Passing a scheduler runs the binning and partition themselves in parallel
+		// bins is scratch space, reused between nodes because a full BinSet is too big to set up per node
+		bool SplitNode(size_t nodeIndex, Utils::TaskScheduler* scheduler, BinSet& bins);
+
+		// Spatial split build, defined in StaticTreeSpatialSplits.cpp
+		// Splits nodes depth first, leaves append their references to mTriIdx
+		void BuildSpatial();
+		// Returns the SAH cost like FindBestSplitPlane, position is where the plane cuts axis
+		float FindBestSpatialSplit(const std::vector<Reference>& references, const BoundingBox& nodeBox, float nodeArea,
+		                           uint8_t& axis, float& position) const;
+		// Moves every reference to the side of the plane it lies on, clipping the ones that cross it unless keeping
+		// them whole on one side is cheaper. Returns false if either side ended up empty
+		bool SpatialPartition(std::vector<Reference>& references, uint8_t axis, float position, size_t& budget,
+		                      std::vector<Reference>& left, std::vector<Reference>& right) const;
+		void SplitReference(const Reference& reference, uint8_t axis, float position, Reference& left, Reference& right) const;
+		bool HasDuplicateReferences() const { return mTriIdx.size() * 3 != mIndices.size(); }
+
+		// Returns the SAH cost of the best plane relative to the node's area, FLT_MAX if no plane separates the triangles
+		float FindBestSplitPlane(const BinSet& bins, const BoundingBox& centroidBox, float nodeArea, SplitPlane& plane,
+		                         BoundingBox& leftBox, BoundingBox& rightBox) const;
+		size_t GetBinIndex(float centroid, float min, float scale) const;
+
+		// Everything below works on the range [first, end) of mTriIdx
+		BoundingBox GetTriangleBounds(size_t first, size_t end) const;
+		BoundingBox GetCentroidBounds(size_t first, size_t end) const;
+		// Resets the first binCount bins of every axis before filling them
+		void FillBins(size_t first, size_t end, const BoundingBox& centroidBox, BinSet& bins) const;
+		// Returns the index of the first triangle that went right
+		size_t Partition(size_t first, size_t end, const SplitPlane& plane);
+		size_t ParallelPartition(Utils::TaskScheduler& scheduler, size_t first, size_t end, const SplitPlane& plane);
+		bool IsLeft(size_t index, const SplitPlane& plane) const;
+
+		// Sums the SAH cost over every node, relative to the root's area
+		float ComputeCost() const;
+
+		// Puts mTriangles in leaf order, after which mTriIdx maps positions back to triangle indices
+		void ReorderTriangles(Utils::TaskScheduler& scheduler);
+		// Collapses mNodes into mWideNodes, always opening the largest child until a node has WIDE_NODE_WIDTH children
+		void BuildWideNodes();
+		uint32_t CollapseNode(size_t nodeIndex);
 
-		float FindBestSplitPlane(size_t nodeIndex, uint8_t& axis, float& splitPos);
+		// Moller-Trumbore ray-triangle test, t must lie within [0, maxT]
+		static bool IntersectTriangle(const Ray& ray, const Triangle& tri, float maxT, float& t, float& u, float& v);
+		// Tests every triangle pair of two leaves, the other leaf's triangles already in this tree's space
+		// Returns true once anyHit is satisfied
+		bool IntersectLeaves(size_t nodeIndex, const StaticTree& other, size_t otherNodeIndex, const OverlapTransform& transform,
+		                     const glm::mat4& modelMat, float planeEpsilon, std::vector<TriangleContact>& contacts,
+		                     const OverlapOptions& options) const;
 
 		glm::vec3 GetCentroid(size_t index) const;
+		// Triangle at position index of the leaf order, only valid once the build finished
 		const Triangle& GetTriangle(size_t index) const;
 
-		void UpdateNodeBoundingBox(size_t nodeIndex);
 		void ClearData();
+		// Checks that every index in a deserialized tree points into the array it refers to, and that children come
+		// after their parents so traversals can't loop
+		bool IsConsistent() const;
 
 		bool IsLeaf(size_t nodeIndex) const;
 		bool IsInternal(size_t nodeIndex) const;
@@ -0,0 +1,342 @@
+#include "StaticTree.h"
+#include "utils/Logger.h"
+
+// Spatial split build after Stich, Friedrich and Dietrich, "Spatial Splits in Bounding Volume Hierarchies" (2009)
+// https://www.nvidia.com/docs/IO/77714/sbvh.pdf
+// Object splits come from the same bins and FindBestSplitPlane as the regular build. Where their children overlap,
+// planes that chop triangles in two are tried as well, within a budget of extra references.
+namespace Physics
+{
+	namespace
+	{
+		// Disjoint boxes give an empty box, SurfaceArea only looks at x to tell
+		BoundingBox Intersect(const BoundingBox& a, const BoundingBox& b)
+		{
+			const BoundingBox overlap(glm::max(a.min, b.min), glm::min(a.max, b.max));
+			if (overlap.min.x > overlap.max.x || overlap.min.y > overlap.max.y || overlap.min.z > overlap.max.z) return {};
+			return overlap;
+		}
+
+		BoundingBox Union(const BoundingBox& a, const BoundingBox& b)
+		{
+			BoundingBox merged;
+			merged.Merge(a, b);
+			return merged;
+		}
+
+		// Per bin bounds of the triangle pieces, and how many references start and end in it
+		struct SpatialBin
+		{
+			BoundingBox bounds;
+			size_t entries = 0;
+			size_t exits = 0;
+		};
+	}
+
+
+	void StaticTree::BuildSpatial()
+	{
+		const size_t triangleCount = mTriangles.size();
+		size_t budget = static_cast<size_t>(static_cast<float>(triangleCount) * std::max(mOptions.duplicationBudget, 0.0f));
+		const float rootArea = mNodes[0].box.SurfaceArea();
+
+		std::vector<Reference> rootReferences(triangleCount);
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			const Triangle& tri = mTriangles[i];
+			Reference& reference = rootReferences[i];
+			reference.triangle = i;
+			reference.box.IncludePoint(tri.v1);
+			reference.box.IncludePoint(tri.v2);
+			reference.box.IncludePoint(tri.v3);
+		}
+
+		// References live in the work list until their node becomes a leaf, so leaves fill mTriIdx one after another
+		mNodes.assign(1, mNodes[0]);
+		mTriIdx.clear();
+		mTriIdx.reserve(triangleCount + budget);
+
+		std::vector<std::pair<size_t, std::vector<Reference>>> work;
+		work.emplace_back(0, std::move(rootReferences));
+
+		BinSet bins;
+		while (!work.empty())
+		{
+			auto [nodeIndex, references] = std::move(work.back());
+			work.pop_back();
+
+			const BoundingBox nodeBox = mNodes[nodeIndex].box;
+			const float nodeArea = nodeBox.SurfaceArea();
+			const size_t count = references.size();
+
+			SplitPlane plane;
+			BoundingBox leftBox, rightBox;
+			float objectCost = FLT_MAX;
+			if (count > 1)
+			{
+				BoundingBox centroidBox;
+				for (const Reference& reference : references)
+					centroidBox.IncludePoint((reference.box.min + reference.box.max) * 0.5f);
+
+				glm::vec3 scale;
+				for (uint8_t axis = 0; axis < 3; ++axis)
+				{
+					const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+					scale[axis] = extent > 0.0f ? static_cast<float>(mOptions.binCount) / extent : 0.0f;
+					for (uint32_t i = 0; i < mOptions.binCount; ++i)
+						bins.bins[axis][i] = Bin{};
+				}
+
+				for (const Reference& reference : references)
+				{
+					const glm::vec3 centroid = (reference.box.min + reference.box.max) * 0.5f;
+					for (uint8_t axis = 0; axis < 3; ++axis)
+					{
+						Bin& bin = bins.bins[axis][GetBinIndex(centroid[axis], centroidBox.min[axis], scale[axis])];
+						++bin.triCount;
+						bin.bounds.Merge(reference.box);
+					}
+				}
+				objectCost = FindBestSplitPlane(bins, centroidBox, nodeArea, plane, leftBox, rightBox);
+			}
+
+			// Only worth searching where the object split leaves the children overlapping
+			uint8_t spatialAxis = 0;
+			float spatialPosition = 0.0f;
+			float spatialCost = FLT_MAX;
+			if (count > 1 && budget > 0)
+			{
+				const float overlap = objectCost == FLT_MAX ? rootArea : Intersect(leftBox, rightBox).SurfaceArea();
+				if (overlap > mOptions.spatialSplitAlpha * rootArea)
+					spatialCost = FindBestSpatialSplit(references, nodeBox, nodeArea, spatialAxis, spatialPosition);
+			}
+
+			const float splitCost = std::min(objectCost, spatialCost);
+			const float leafCost = static_cast<float>(count) * mOptions.intersectionCost;
+			bool leaf = splitCost == FLT_MAX || (count <= mOptions.maxLeafSize && splitCost >= leafCost);
+
+			std::vector<Reference> left, right;
+			if (!leaf && spatialCost < objectCost)
+			{
+				// Unsplitting can leave a side empty, the object split is the fallback then
+				if (!SpatialPartition(references, spatialAxis, spatialPosition, budget, left, right))
+				{
+					left.clear();
+					right.clear();
+					leaf = objectCost == FLT_MAX;
+				}
+			}
+			if (!leaf && left.empty())
+			{
+				for (const Reference& reference : references)
+				{
+					const glm::vec3 centroid = (reference.box.min + reference.box.max) * 0.5f;
+					const size_t bin = GetBinIndex(centroid[plane.axis], plane.min, plane.scale);
+					(bin <= plane.bin ? left : right).push_back(reference);
+				}
+			}
+
+			if (leaf)
+			{
+				BVHNode& node = mNodes[nodeIndex];
+				node.first = mTriIdx.size();
+				node.triCount = count;
+				for (const Reference& reference : references)
+					mTriIdx.push_back(reference.triangle);
+				continue;
+			}
+
+			// Both children get their box from the references they ended up with, clipped pieces included
+			BoundingBox leftBounds, rightBounds;
+			for (const Reference& reference : left) leftBounds.Merge(reference.box);
+			for (const Reference& reference : right) rightBounds.Merge(reference.box);
+
+			const size_t leftChild = mNodes.size();
+			mNodes.resize(leftChild + 2);
+			mNodes[leftChild].box = leftBounds;
+			mNodes[leftChild + 1].box = rightBounds;
+
+			BVHNode& node = mNodes[nodeIndex];
+			node.first = leftChild;
+			node.triCount = 0;
+
+			references.clear();
+			references.shrink_to_fit();
+			work.emplace_back(leftChild + 1, std::move(right));
+			work.emplace_back(leftChild, std::move(left));
+		}
+
+		mNodesUsed = mNodes.size();
+		LOG(LOG_INFO) << "Spatial splits added " << mTriIdx.size() - triangleCount << " triangle references.\n";
+	}
+
+
+	float StaticTree::FindBestSpatialSplit(const std::vector<Reference>& references, const BoundingBox& nodeBox, const float nodeArea,
+	                                       uint8_t& axis, float& position) const
+	{
+		const uint32_t binCount = mOptions.binCount;
+		const float invNodeArea = nodeArea > 0.0f ? 1.0f / nodeArea : 0.0f;
+
+		float bestCost = FLT_MAX;
+		for (uint8_t currentAxis = 0; currentAxis < 3; ++currentAxis)
+		{
+			const float min = nodeBox.min[currentAxis];
+			const float extent = nodeBox.max[currentAxis] - min;
+			if (!(extent > 0.0f)) continue;
+
+			const float scale = static_cast<float>(binCount) / extent;
+			const float binSize = extent / static_cast<float>(binCount);
+			auto binOf = [&](const float value)
+			{
+				return GetBinIndex(std::max(value, min), min, scale);
+			};
+
+			SpatialBin bins[MAX_BUILD_BINS];
+			for (const Reference& reference : references)
+			{
+				const size_t firstBin = binOf(reference.box.min[currentAxis]);
+				const size_t lastBin = binOf(reference.box.max[currentAxis]);
+				bins[firstBin].entries++;
+				bins[lastBin].exits++;
+
+				// Chop the triangle at every bin boundary it crosses, each bin only gets its own piece
+				Reference piece = reference;
+				for (size_t bin = firstBin; bin < lastBin; bin++)
+				{
+					Reference below, above;
+					SplitReference(piece, currentAxis, min + binSize * static_cast<float>(bin + 1), below, above);
+					bins[bin].bounds.Merge(below.box);
+					piece = above;
+				}
+				bins[lastBin].bounds.Merge(piece.box);
+			}
+
+			BoundingBox rightBoxes[MAX_BUILD_BINS];
+			size_t rightCounts[MAX_BUILD_BINS];
+			BoundingBox rightAccum;
+			size_t rightSum = 0;
+			for (size_t i = binCount - 1; i > 0; i--)
+			{
+				rightAccum.Merge(bins[i].bounds);
+				rightSum += bins[i].exits;
+				rightBoxes[i] = rightAccum;
+				rightCounts[i] = rightSum;
+			}
+
+			// Plane i lies between bin i and bin i + 1
+			BoundingBox leftAccum;
+			size_t leftSum = 0;
+			for (size_t i = 0; i < binCount - 1; i++)
+			{
+				leftAccum.Merge(bins[i].bounds);
+				leftSum += bins[i].entries;
+				if (leftSum == 0 || rightCounts[i + 1] == 0) continue;
+
+				const float cost = mOptions.traversalCost + mOptions.intersectionCost * invNodeArea *
+					(static_cast<float>(leftSum) * leftAccum.SurfaceArea() +
+					 static_cast<float>(rightCounts[i + 1]) * rightBoxes[i + 1].SurfaceArea());
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					axis = currentAxis;
+					position = min + binSize * static_cast<float>(i + 1);
+				}
+			}
+		}
+		return bestCost;
+	}
+
+
+	bool StaticTree::SpatialPartition(std::vector<Reference>& references, const uint8_t axis, const float position, size_t& budget,
+	                                  std::vector<Reference>& left, std::vector<Reference>& right) const
+	{
+		// References entirely on one side go there, the boxes they form decide what happens to the rest
+		std::vector<Reference> straddling;
+		BoundingBox leftBox, rightBox;
+		for (const Reference& reference : references)
+		{
+			if (reference.box.max[axis] <= position)
+			{
+				left.push_back(reference);
+				leftBox.Merge(reference.box);
+			}
+			else if (reference.box.min[axis] >= position)
+			{
+				right.push_back(reference);
+				rightBox.Merge(reference.box);
+			}
+			else straddling.push_back(reference);
+		}
+
+		for (const Reference& reference : straddling)
+		{
+			Reference below, above;
+			SplitReference(reference, axis, position, below, above);
+
+			const auto leftCount = static_cast<float>(left.size());
+			const auto rightCount = static_cast<float>(right.size());
+
+			// Keeping the whole triangle on one side may cost less than duplicating it
+			const float splitCost = Union(leftBox, below.box).SurfaceArea() * (leftCount + 1.0f) +
+			                        Union(rightBox, above.box).SurfaceArea() * (rightCount + 1.0f);
+			const float leftCost = Union(leftBox, reference.box).SurfaceArea() * (leftCount + 1.0f) + rightBox.SurfaceArea() * rightCount;
+			const float rightCost = leftBox.SurfaceArea() * leftCount + Union(rightBox, reference.box).SurfaceArea() * (rightCount + 1.0f);
+
+			if (budget > 0 && splitCost < leftCost && splitCost < rightCost)
+			{
+				budget--;
+				left.push_back(below);
+				right.push_back(above);
+				leftBox.Merge(below.box);
+				rightBox.Merge(above.box);
+			}
+			else if (leftCost <= rightCost)
+			{
+				left.push_back(reference);
+				leftBox.Merge(reference.box);
+			}
+			else
+			{
+				right.push_back(reference);
+				rightBox.Merge(reference.box);
+			}
+		}
+
+		return !left.empty() && !right.empty();
+	}
+
+
+	void StaticTree::SplitReference(const Reference& reference, const uint8_t axis, const float position, Reference& left, Reference& right) const
+	{
+		const Triangle& tri = mTriangles[reference.triangle];
+		const glm::vec3 corners[3] = { tri.v1, tri.v2, tri.v3 };
+
+		// Corners go to their side, edges crossing the plane add the crossing point to both
+		BoundingBox leftBox, rightBox;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec3& from = corners[i];
+			const glm::vec3& to = corners[(i + 1) % 3];
+
+			if (from[axis] <= position) leftBox.IncludePoint(from);
+			if (from[axis] >= position) rightBox.IncludePoint(from);
+
+			if ((from[axis] < position && to[axis] > position) || (from[axis] > position && to[axis] < position))
+			{
+				glm::vec3 crossing = from + (to - from) * ((position - from[axis]) / (to[axis] - from[axis]));
+				crossing[axis] = position;
+				leftBox.IncludePoint(crossing);
+				rightBox.IncludePoint(crossing);
+			}
+		}
+
+		// Pieces never grow past the part of the triangle the reference already covered
+		leftBox.max[axis] = std::min(leftBox.max[axis], position);
+		rightBox.min[axis] = std::max(rightBox.min[axis], position);
+
+		left.triangle = reference.triangle;
+		right.triangle = reference.triangle;
+		left.box = Intersect(leftBox, reference.box);
+		right.box = Intersect(rightBox, reference.box);
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Triangle-triangle overlap after Moller, "A Fast Triangle-Triangle Intersection Test" (1997)
+// Each triangle is clipped against the other's plane, and the two resulting segments on the planes'
+// intersection line must overlap. Touching counts as intersecting.
+namespace Physics
+{
+	// Returns true if the triangles intersect. If point isn't null it receives the midpoint of the region where
+	// they cross: the shared segment, or for coplanar triangles the average of the overlap's corners
+	inline bool IntersectTriangles(const glm::vec3* a, const glm::vec3* b, glm::vec3* point = nullptr);
+
+	namespace Detail
+	{
+		// Distances below this fraction of the triangles' size count as lying on the plane
+		constexpr float TRIANGLE_PLANE_EPSILON = 1e-6f;
+
+		// Signed distances of the triangle's corners to a plane, snapped to 0 close to it
+		// Returns false if every corner is strictly on one side
+		inline bool PlaneDistances(const glm::vec3* tri, const glm::vec3& normal, const float offset, const float epsilon, float* distances)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				distances[i] = glm::dot(normal, tri[i]) - offset;
+				if (std::abs(distances[i]) <= epsilon) distances[i] = 0.0f;
+			}
+
+			return !((distances[0] > 0.0f && distances[1] > 0.0f && distances[2] > 0.0f) ||
+			         (distances[0] < 0.0f && distances[1] < 0.0f && distances[2] < 0.0f));
+		}
+
+		// Segment where a triangle that straddles a plane crosses it, as parameters along direction plus the points
+		inline void PlaneCrossing(const glm::vec3* tri, const float* distances, const glm::vec3& direction,
+		                          float& tMin, float& tMax, glm::vec3& pMin, glm::vec3& pMax)
+		{
+			tMin = FLT_MAX;
+			tMax = -FLT_MAX;
+
+			auto include = [&](const glm::vec3& p)
+			{
+				const float t = glm::dot(direction, p);
+				if (t < tMin) { tMin = t; pMin = p; }
+				if (t > tMax) { tMax = t; pMax = p; }
+			};
+
+			for (int i = 0; i < 3; i++)
+			{
+				const int j = (i + 1) % 3;
+				if (distances[i] == 0.0f) include(tri[i]);
+				if (distances[i] * distances[j] < 0.0f)
+					include(tri[i] + (tri[j] - tri[i]) * (distances[i] / (distances[i] - distances[j])));
+			}
+		}
+
+		inline float Cross2D(const glm::vec2& a, const glm::vec2& b)
+		{
+			return a.x * b.y - a.y * b.x;
+		}
+
+		inline bool PointInTriangle2D(const glm::vec2& p, const glm::vec2* tri)
+		{
+			const float d0 = Cross2D(tri[1] - tri[0], p - tri[0]);
+			const float d1 = Cross2D(tri[2] - tri[1], p - tri[1]);
+			const float d2 = Cross2D(tri[0] - tri[2], p - tri[2]);
+			return !((d0 < 0.0f || d1 < 0.0f || d2 < 0.0f) && (d0 > 0.0f || d1 > 0.0f || d2 > 0.0f));
+		}
+
+		// Both triangles lie on the plane with the given normal
+		// Projects them onto the plane's dominant axes and tests edges and corners in 2D
+		inline bool IntersectCoplanarTriangles(const glm::vec3* a, const glm::vec3* b, const glm::vec3& normal, glm::vec3* point)
+		{
+			const glm::vec3 n = glm::abs(normal);
+			int u = 0, v = 1;
+			if (n.x >= n.y && n.x >= n.z) { u = 1; v = 2; }
+			else if (n.y >= n.z) { u = 0; v = 2; }
+
+			glm::vec2 a2[3], b2[3];
+			for (int i = 0; i < 3; i++)
+			{
+				a2[i] = glm::vec2(a[i][u], a[i][v]);
+				b2[i] = glm::vec2(b[i][u], b[i][v]);
+			}
+
+			// Points of the overlap region found so far, averaged into the contact point
+			glm::vec3 sum(0.0f);
+			int found = 0;
+
+			for (int i = 0; i < 3; i++)
+			{
+				if (PointInTriangle2D(a2[i], b2)) { sum += a[i]; found++; }
+				if (PointInTriangle2D(b2[i], a2)) { sum += b[i]; found++; }
+			}
+
+			for (int i = 0; i < 3 && (point || found == 0); i++)
+			{
+				const glm::vec2 p = a2[i];
+				const glm::vec2 r = a2[(i + 1) % 3] - p;
+				for (int j = 0; j < 3; j++)
+				{
+					const glm::vec2 q = b2[j];
+					const glm::vec2 s = b2[(j + 1) % 3] - q;
+					const float denominator = Cross2D(r, s);
+					// Parallel edges, any overlap between them is already covered by the corner tests
+					if (denominator == 0.0f) continue;
+
+					const float t = Cross2D(q - p, s) / denominator;
+					const float w = Cross2D(q - p, r) / denominator;
+					if (t < 0.0f || t > 1.0f || w < 0.0f || w > 1.0f) continue;
+
+					sum += a[i] + (a[(i + 1) % 3] - a[i]) * t;
+					found++;
+				}
+			}
+
+			if (found == 0) return false;
+			if (point) *point = sum / static_cast<float>(found);
+			return true;
+		}
+	}
+
+	inline bool IntersectTriangles(const glm::vec3* a, const glm::vec3* b, glm::vec3* point)
+	{
+		const glm::vec3 normalA = glm::cross(a[1] - a[0], a[2] - a[0]);
+		const glm::vec3 normalB = glm::cross(b[1] - b[0], b[2] - b[0]);
+
+		// Tolerance scales with the triangles so the test behaves the same in any unit
+		const float size = std::max({ std::abs(a[1].x - a[0].x), std::abs(a[1].y - a[0].y), std::abs(a[1].z - a[0].z),
+		                              std::abs(b[1].x - b[0].x), std::abs(b[1].y - b[0].y), std::abs(b[1].z - b[0].z) });
+
+		float distancesA[3];
+		const float lengthB = glm::length(normalB);
+		if (!Detail::PlaneDistances(a, normalB, glm::dot(normalB, b[0]), Detail::TRIANGLE_PLANE_EPSILON * size * lengthB, distancesA))
+			return false;
+
+		float distancesB[3];
+		const float lengthA = glm::length(normalA);
+		if (!Detail::PlaneDistances(b, normalA, glm::dot(normalA, a[0]), Detail::TRIANGLE_PLANE_EPSILON * size * lengthA, distancesB))
+			return false;
+
+		if (distancesA[0] == 0.0f && distancesA[1] == 0.0f && distancesA[2] == 0.0f)
+			return Detail::IntersectCoplanarTriangles(a, b, normalB, point);
+
+		// Both triangles cross the line where the planes meet, their pieces of it have to overlap
+		const glm::vec3 direction = glm::cross(normalA, normalB);
+
+		float minA, maxA, minB, maxB;
+		glm::vec3 pointMinA, pointMaxA, pointMinB, pointMaxB;
+		Detail::PlaneCrossing(a, distancesA, direction, minA, maxA, pointMinA, pointMaxA);
+		Detail::PlaneCrossing(b, distancesB, direction, minB, maxB, pointMinB, pointMaxB);
+
+		if (maxA < minB || maxB < minA) return false;
+
+		if (point)
+		{
+			const glm::vec3 start = minA > minB ? pointMinA : pointMinB;
+			const glm::vec3 end = maxA < maxB ? pointMaxA : pointMaxB;
+			*point = (start + end) * 0.5f;
+		}
+		return true;
+	}
+}
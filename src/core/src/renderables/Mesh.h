@@ -5,8 +5,10 @@
 #include "../renderer/VBO.h"
 #include "../renderer/VAO.h"
 
+#include "../math/mesh/MeshCache.h"
 #include "../math/mesh/MeshImport.h"
-#include "../physics/StaticTree.h"
+#include "../math/mesh/PackedMesh.h"
+#include "../physics/MeshCollider.h"
 #include "../utils/Timer.h"
 #include "../utils/PathUtils.h"
 
@@ -18,19 +20,54 @@ public:
 	std::vector<MeshPt> vertices;
 	std::vector<unsigned int> indices;
 
-	Physics::StaticTree mTree{};
+	// Shared so entities created from the same mesh data can reuse one tree
+	std::shared_ptr<Physics::StaticTree> mTree;
+	// Set for meshes uploaded straight from a mapped file, vertices and indices stay empty then
+	std::shared_ptr<const Utils::PackedMesh> mPacked;
+	// Index ranges of the levels of detail in the EBO, levelCount stays 0 for meshes uploaded without them
+	Components::LODGroup mLODGroup;
+
+	// Fraction of the viewport height at which the full mesh has the triangle density every level is matched to
+	// Each level takes over from the one before where its density at that size equals the full mesh's here, so the
+	// switch from level i happens at this times sqrt(triangles of level i + 1 / triangles of the full mesh), about
+	// 0.35 for a level with half the triangles
+	static constexpr float LOD_FULL_DETAIL_SCREEN_SIZE = 0.5f;
 
 	// Initializes the object
 	Mesh(const char* filename, bool is_stl);
+	// Loads through the mesh cache and fills mTree as well, so neither parsing nor building happens once cached
+	Mesh(const char* filename, bool is_stl, const Physics::StaticTreeBuildOptions& treeOptions);
 	Mesh(std::vector<MeshPt> vertices, std::vector<unsigned int> indices);
 	explicit Mesh(const MeshData& data);
+	// Uploads every level into the same buffers, levels[0] is the full mesh that vertices and indices hold
+	// The other levels are only kept on the GPU, see Utils::BuildLODChain
+	explicit Mesh(const std::vector<MeshData>& levels);
+	// Uploads a mesh loaded by Utils::MeshLoader, has to run on the thread that owns the GL context
+	// The tree is shared, so every Mesh made from the same load uses one tree
+	explicit Mesh(const Utils::CachedMesh& mesh);
+	// Uploads from the mapped pages without copying them, and takes the file's tree if it has one
+	explicit Mesh(std::shared_ptr<const Utils::PackedMesh> packed);
+
+	// Vertices and indices, wherever they live
+	MeshView GetView() const;
 
 	BoundingBox CalcBoundingBox();
-	void InitTree();
+	void InitTree(const Physics::StaticTreeBuildOptions& options = {});
+	// Brings mTree up to date after vertices moved, much cheaper than InitTree as long as the topology is unchanged
+	void RefitTree();
+	// Attaches mTree to the entity as a MeshCollider, building it first if needed
+	void AddCollider(const Physics::StaticTreeBuildOptions& options = {});
+
+	bool HasLODs() const { return mLODGroup.levelCount > 1; }
+	// Attaches mLODGroup to the entity, so RenderSystem draws the level that fits its size on screen
+	void AddLODGroup();
 
 	void AddRigidbody();
 
 private:
+	// Levels below full detail waiting for InitVAO, dropped once uploaded
+	std::vector<MeshData> mLODData;
+
 	void InitVAO() override;
 	size_t GetSize() override;
 };
@@ -38,23 +75,48 @@ private:
 inline Mesh::Mesh(const char* filename, const bool is_stl)
 {
 	std::string filepath = Utils::GetResourcePath("/res/models/", filename);
-	MeshData data;
 
 	LOG(LOG_INFO) << "Loading mesh: " << filename << "\n";
+	// Packed files are mapped and uploaded in place, along with the levels MeshConverter wrote next to them
 	if (!is_stl)
-		data = Utils::ReadPackedSTL(filepath.c_str());
+	{
+		mPacked = std::make_shared<const Utils::PackedMesh>(filepath);
+		mLODData = Utils::ReadPackedLODs(filepath);
+	}
 	else
-		data = Utils::ReadSTL(filepath.c_str());
-	if (data.indices.size() == 0 || data.vertices.size() == 0)
+	{
+		MeshData data = Utils::ReadSTL(filepath.c_str(), world.GetScheduler());
+		vertices = std::move(data.vertices);
+		indices = std::move(data.indices);
+	}
+
+	const MeshView view = GetView();
+	if (view.Empty())
 	{
 		LOG(LOG_ERROR) << "Failed to load mesh: " << filename << "\n";
 	} else
 	{
-		LOG(LOG_INFO) << "Loaded mesh: " << filename << " with " << data.vertices.size() << " vertices and " << data.indices.size() << " indices\n";
+		LOG(LOG_INFO) << "Loaded mesh: " << filename << " with " << view.vertexCount << " vertices and " << view.indexCount << " indices\n";
+	}
+
+	Mesh::InitVAO();
+}
+
+inline Mesh::Mesh(const char* filename, const bool is_stl, const Physics::StaticTreeBuildOptions& treeOptions)
+{
+	const std::string filepath = Utils::GetResourcePath("/res/models/", filename);
+
+	LOG(LOG_INFO) << "Loading mesh: " << filename << "\n";
+	Utils::CachedMesh cached = Utils::LoadMeshCached(filepath, is_stl, world.GetScheduler(), treeOptions);
+	if (cached.data.indices.empty() || cached.data.vertices.empty())
+	{
+		LOG(LOG_ERROR) << "Failed to load mesh: " << filename << "\n";
 	}
 
-	vertices = std::vector(data.vertices);
-	indices = std::vector(data.indices);
+	vertices = std::move(cached.data.vertices);
+	indices = std::move(cached.data.indices);
+	mTree = std::move(cached.tree);
+	if (!is_stl) mLODData = Utils::ReadPackedLODs(filepath);
 
 	Mesh::InitVAO();
 }
@@ -70,17 +132,53 @@ inline Mesh::Mesh(const MeshData& data): vertices(data.vertices), indices(data.i
 	Mesh::InitVAO();
 }
 
+inline Mesh::Mesh(const std::vector<MeshData>& levels)
+{
+	if (levels.empty())
+	{
+		LOG(LOG_ERROR) << "Can't create a mesh without any levels of detail.\n";
+	} else
+	{
+		vertices = levels[0].vertices;
+		indices = levels[0].indices;
+		mLODData.assign(levels.begin() + 1, levels.end());
+	}
+	Mesh::InitVAO();
+}
+
+inline Mesh::Mesh(const Utils::CachedMesh& mesh): vertices(mesh.data.vertices), indices(mesh.data.indices), mTree(mesh.tree),
+	mLODData(mesh.lods)
+{
+	Mesh::InitVAO();
+}
+
+inline Mesh::Mesh(std::shared_ptr<const Utils::PackedMesh> packed): mPacked(std::move(packed))
+{
+	mTree = mPacked->LoadTree();
+	Mesh::InitVAO();
+}
+
+inline MeshView Mesh::GetView() const
+{
+	if (mPacked) return mPacked->GetView();
+	return MeshView(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
 inline BoundingBox Mesh::CalcBoundingBox()
 {
 	BoundingBox box;
 	transform.CalculateModelMat();
-	box.min = transform.modelMat * glm::vec4(vertices[0].position, 1.0f);
-	box.max = transform.modelMat * glm::vec4(vertices[0].position, 1.0f);
-	if (vertices.size() == 0)
-        LOG(LOG_ERROR) << "Can't calculate bounding box of an empty mesh.\n";
-	for (const auto& pt : vertices)
+	const MeshView view = GetView();
+	if (view.vertexCount == 0)
 	{
-		auto point = transform.modelMat * glm::vec4(pt.position, 1.0f);
+		LOG(LOG_ERROR) << "Can't calculate bounding box of an empty mesh.\n";
+		return box;
+	}
+	box.min = transform.modelMat * glm::vec4(view.vertices[0].position, 1.0f);
+	box.max = transform.modelMat * glm::vec4(view.vertices[0].position, 1.0f);
+	for (size_t v = 0; v < view.vertexCount; v++)
+	{
+		auto point = transform.modelMat * glm::vec4(view.vertices[v].position, 1.0f);
 		for (unsigned int i = 0; i < 3; i++)
 		{
 			box.max[i] = std::max(box.max[i], point[i]);
@@ -90,9 +188,48 @@ inline BoundingBox Mesh::CalcBoundingBox()
 	return box;
 }
 
-inline void Mesh::InitTree()
+inline void Mesh::InitTree(const Physics::StaticTreeBuildOptions& options)
 {
-	mTree.CreateStaticTree(vertices, indices);
+	mTree = std::make_shared<Physics::StaticTree>();
+	if (mPacked)
+	{
+		// The tree keeps its own copy of the indices anyway, the vertices are only read during the build
+		const MeshData data = mPacked->GetView().ToMeshData();
+		mTree->CreateStaticTree(data.vertices, data.indices, world.GetScheduler(), options);
+		return;
+	}
+	mTree->CreateStaticTree(vertices, indices, world.GetScheduler(), options);
+}
+
+inline void Mesh::RefitTree()
+{
+	if (!mTree)
+	{
+		InitTree();
+		return;
+	}
+	// Mapped vertices are read only, so the tree can't be out of date
+	if (mPacked) return;
+	mTree->Refit(vertices, world.GetScheduler());
+}
+
+inline void Mesh::AddCollider(const Physics::StaticTreeBuildOptions& options)
+{
+	if (!mTree) InitTree(options);
+
+	Components::MeshCollider collider{};
+	collider.tree = mTree;
+	world.AddComponent(mEntityID, collider);
+}
+
+inline void Mesh::AddLODGroup()
+{
+	if (!HasLODs())
+	{
+		LOG(LOG_WARNING) << "Mesh has no levels of detail to switch between.\n";
+		return;
+	}
+	world.AddComponent(mEntityID, mLODGroup);
 }
 
 
@@ -100,8 +237,51 @@ inline void Mesh::InitVAO()
 {
 	mVAO.Bind();
 
-	VBO VBO(vertices);
-	EBO EBO(indices);
+	MeshView upload = GetView();
+	std::vector<MeshPt> lodVertices;
+	std::vector<GLuint> lodIndices;
+	if (!mLODData.empty())
+	{
+		// The levels go behind the full mesh in the same buffers, their indices shifted past the vertices before them
+		const MeshView full = upload;
+		lodVertices.assign(full.vertices, full.vertices + full.vertexCount);
+		lodIndices.assign(full.indices, full.indices + full.indexCount);
+
+		// Each level takes over where its triangle density matches the full mesh at LOD_FULL_DETAIL_SCREEN_SIZE
+		const size_t levelCount = std::min(mLODData.size() + 1, Components::MAX_LOD_LEVELS);
+		mLODGroup = {};
+		mLODGroup.levelCount = levelCount;
+		mLODGroup.levels[0] = { 0, full.indexCount, 0.0f };
+		for (size_t level = 1; level < levelCount; level++)
+		{
+			const MeshData& data = mLODData[level - 1];
+			const auto base = static_cast<GLuint>(lodVertices.size());
+			mLODGroup.levels[level] = { lodIndices.size(), data.indices.size(), 0.0f };
+			mLODGroup.levels[level - 1].minScreenSize = LOD_FULL_DETAIL_SCREEN_SIZE *
+				std::sqrt(static_cast<float>(data.indices.size()) / static_cast<float>(std::max<size_t>(full.indexCount, 1)));
+
+			lodVertices.insert(lodVertices.end(), data.vertices.begin(), data.vertices.end());
+			for (const GLuint index : data.indices) lodIndices.push_back(base + index);
+		}
+
+		// Bounding sphere around the box of the full mesh, the simplified levels stay close to its surface
+		glm::vec3 min(0.0f), max(0.0f);
+		if (full.vertexCount > 0) min = max = full.vertices[0].position;
+		for (size_t v = 0; v < full.vertexCount; v++)
+		{
+			min = glm::min(min, full.vertices[v].position);
+			max = glm::max(max, full.vertices[v].position);
+		}
+		mLODGroup.center = (min + max) * 0.5f;
+		mLODGroup.radius = glm::length(max - min) * 0.5f;
+
+		upload = MeshView(lodVertices.data(), lodVertices.size(), lodIndices.data(), lodIndices.size());
+		mLODData.clear();
+		mLODData.shrink_to_fit();
+	}
+
+	VBO VBO(upload.vertices, upload.vertexCount);
+	EBO EBO(upload.indices, upload.indexCount);
 
 	mVAO.LinkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(MeshPt), nullptr);
 	mVAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(MeshPt), (void*)(3 * sizeof(float)));
@@ -113,5 +293,5 @@ inline void Mesh::InitVAO()
 
 inline size_t Mesh::GetSize()
 {
-	return indices.size();
+	return GetView().indexCount;
 }
@@ -129,6 +129,5 @@ inline BoundingBox Model::CalcBoundingBox(const glm::mat4& modelMat) const
 			box.min[i] = std::min(box.min[i], point[i]);
 		}
 	}
-	box.UpdateSurfaceArea();
 	return box;
 }
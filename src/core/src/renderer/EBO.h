@@ -12,6 +12,9 @@ public:
 
     template <typename T>
     explicit EBO(const std::vector<T>& indices);
+    // Uploads straight from memory the EBO doesn't own, such as a mapped mesh file
+    template <typename T>
+    EBO(const T* indices, size_t count);
 
     inline void PushData(const std::vector<GLuint>& indices);
     inline void AllocBuffer(GLint size, GLenum type);
@@ -23,12 +26,17 @@ public:
 };
 
 template <typename T>
-EBO::EBO(const std::vector<T>& indices)
+EBO::EBO(const std::vector<T>& indices): EBO(indices.data(), indices.size())
+{
+}
+
+template <typename T>
+EBO::EBO(const T* indices, const size_t count)
 {
     GL_FCHECK(glGenBuffers(1, &ID));
     GL_FCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID));
-    GL_FCHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(T), indices.data(), GL_STATIC_DRAW));
-    LOG(LOG_INFO) << "Created EBO buffer of size " << indices.size() << ".\n";
+    GL_FCHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(T), indices, GL_STATIC_DRAW));
+    LOG(LOG_INFO) << "Created EBO buffer of size " << count << ".\n";
 }
 
 inline void EBO::PushData(const std::vector<GLuint>& indices)
@@ -2,6 +2,25 @@
 
 extern World world;
 
+namespace
+{
+	// Fraction of the viewport height covered by the bounding sphere, large when the camera is inside it
+	float ProjectedScreenSize(const Components::LODGroup& lod, const glm::mat4& modelMat, const glm::mat4& cameraMatrix)
+	{
+		const glm::vec3 center = modelMat * glm::vec4(lod.center, 1.0f);
+		const float scale = std::max({ glm::length(glm::vec3(modelMat[0])), glm::length(glm::vec3(modelMat[1])),
+		                               glm::length(glm::vec3(modelMat[2])) });
+		const float radius = lod.radius * scale;
+
+		// w of a perspective projection is the distance along the view direction, and the rotation in the view matrix
+		// leaves the length of the second row at the projection's cot(fov / 2)
+		const float distance = (cameraMatrix * glm::vec4(center, 1.0f)).w;
+		if (distance <= radius) return std::numeric_limits<float>::max();
+		const float focal = glm::length(glm::vec3(cameraMatrix[0][1], cameraMatrix[1][1], cameraMatrix[2][1]));
+		return radius * focal / distance;
+	}
+}
+
 void RenderSystem::PreUpdate() const
 {
 	glClearColor(0.07f, 0.13f, 0.17f, 1.0f);
@@ -16,6 +35,7 @@ void RenderSystem::Update() const
 
 	auto diffuse = world.GetComponentType<Components::DiffuseTextureInfo>();
 	auto specular = world.GetComponentType<Components::SpecularTextureInfo>();
+	auto lodGroup = world.GetComponentType<Components::LODGroup>();
 
 	for (const auto& entity : mEntities)
 	{
@@ -62,6 +82,17 @@ void RenderSystem::Update() const
 			GL_FCHECK(glBindTexture(GL_TEXTURE_2D, specular_ID));
 		}
 
+		// Range of the EBO to draw, the whole buffer unless the entity has levels of detail
+		size_t indexOffset = 0;
+		size_t indexCount = renderInfo.size;
+		if (mCamera && entitySignature.test(lodGroup))
+		{
+			auto& lod = world.GetComponent<Components::LODGroup>(entity);
+			lod.currentLevel = lod.SelectLevel(ProjectedScreenSize(lod, transform.modelMat, mCamera->cameraMatrix));
+			indexOffset = lod.levels[lod.currentLevel].indexOffset;
+			indexCount = lod.levels[lod.currentLevel].indexCount;
+		}
+
 		// Draw VAO
 		if (renderInfo.primitive_type == GL_POINTS)
 		{
@@ -71,7 +102,8 @@ void RenderSystem::Update() const
 		{
 			/*if (primitive_type == GL_LINES)
 				glClear(GL_DEPTH_BUFFER_BIT);*/
-			GL_FCHECK(glDrawElements(renderInfo.primitive_type, renderInfo.size, GL_UNSIGNED_INT, nullptr));
+			GL_FCHECK(glDrawElements(renderInfo.primitive_type, indexCount, GL_UNSIGNED_INT,
+				reinterpret_cast<const void*>(indexOffset * sizeof(GLuint))));
 		}
 			
 	}
@@ -5,6 +5,7 @@
 #include "../components/RenderInfo.h"
 #include "../components/Transform.h"
 #include "../components/TextureInfo.h"
+#include "../components/LODGroup.h"
 
 #include "../core/World.h"
 #include "../core/ECS/System.h"
@@ -13,6 +14,8 @@
 class RenderSystem final : public System
 {
     GLFWwindow* mWindow;
+    // Needed to pick levels of detail, entities with a LODGroup draw their most detailed level without one
+    const Camera* mCamera = nullptr;
     unsigned long long frames = 0;
 public:
     explicit RenderSystem(): mWindow(nullptr){}
@@ -24,6 +27,7 @@ public:
     void PostUpdate();
 
     void SetWindow(GLFWwindow* window) { mWindow = window; }
+    void SetCamera(const Camera* camera) { mCamera = camera; }
 
     void Clean() override;
 };
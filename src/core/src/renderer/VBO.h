@@ -15,6 +15,9 @@ public:
 
 	template <typename T>
 	explicit VBO(const std::vector<T>& vertices);
+	// Uploads straight from memory the VBO doesn't own, such as a mapped mesh file
+	template <typename T>
+	VBO(const T* vertices, size_t count);
 
 	inline void PushData(const std::vector<glm::vec3>& vertices);
 	inline void AllocBuffer(GLint size, GLenum type);
@@ -26,11 +29,16 @@ public:
 };
 
 template <typename T>
-VBO::VBO(const std::vector<T>& vertices)
+VBO::VBO(const std::vector<T>& vertices): VBO(vertices.data(), vertices.size())
+{
+}
+
+template <typename T>
+VBO::VBO(const T* vertices, const size_t count)
 {
 	GL_FCHECK(glGenBuffers(1, &ID));
 	GL_FCHECK(glBindBuffer(GL_ARRAY_BUFFER, ID));
-	GL_FCHECK(glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(T), vertices.data(), GL_STATIC_DRAW));
+	GL_FCHECK(glBufferData(GL_ARRAY_BUFFER, count * sizeof(T), vertices, GL_STATIC_DRAW));
 }
 
 inline void VBO::PushData(const std::vector<glm::vec3>& vertices)
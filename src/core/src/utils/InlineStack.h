@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+
+// Stack for tree traversals that lives in the caller's stack frame
+// Only touches the heap if it grows past N entries, which a reasonably balanced tree never does
+namespace Utils
+{
+    template<typename T, size_t N>
+    class InlineStack
+    {
+    public:
+        void Push(const T& value);
+        T Pop();
+
+        bool Empty() const { return mSize == 0; }
+        size_t Size() const { return mSize; }
+
+    private:
+        T mData[N];
+        size_t mSize = 0;
+
+        // Entries past N, empty (and unallocated) unless the tree is very deep
+        std::vector<T> mOverflow;
+    };
+
+    template<typename T, size_t N>
+    void InlineStack<T, N>::Push(const T& value)
+    {
+        if (mSize < N) mData[mSize] = value;
+        else mOverflow.push_back(value);
+        ++mSize;
+    }
+
+    template<typename T, size_t N>
+    T InlineStack<T, N>::Pop()
+    {
+        --mSize;
+        if (mSize < N) return mData[mSize];
+
+        T value = mOverflow.back();
+        mOverflow.pop_back();
+        return value;
+    }
+}
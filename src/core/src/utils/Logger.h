@@ -6,6 +6,7 @@
 #include <fstream>
 #include <regex>
 #include <iomanip>
+#include <mutex>
 #include "ClassName.h"
 
 #ifdef LOG_CLASS_NAME
@@ -81,8 +82,11 @@ namespace Utils
         }
     };
 
+    // Safe to use from task scheduler workers. Every << is locked on its own, so lines logged from two threads at
+    // once can interleave, but the buffer never gets corrupted
     class Logger : public LogBuffer
     {
+        std::recursive_mutex mutex;
         std::ofstream logFile;
         std::string filename;
         LogLevel logLevel;
@@ -108,6 +112,7 @@ namespace Utils
 
         void WriteLogFile()
         {
+            std::lock_guard lock(mutex);
             OpenLogFile();
             logFile << logContents.str();
             CloseLogFile();
@@ -135,6 +140,7 @@ namespace Utils
         template <typename T>
         Logger& operator<<(const T& data)
         {
+            std::lock_guard lock(mutex);
             logContents << data;
             if (printToConsole)
             {
@@ -150,11 +156,12 @@ namespace Utils
             return *this;
         }
 
-        std::string GetLogContents() { return GetContents(); }
-        std::vector<LogLevel> GetLineLogLevels() { return GetLineLevels(); }
+        std::string GetLogContents() { std::lock_guard lock(mutex); return GetContents(); }
+        std::vector<LogLevel> GetLineLogLevels() { std::lock_guard lock(mutex); return GetLineLevels(); }
 
         std::string SetLogLevel(const LogLevel level)
         {
+            std::lock_guard lock(mutex);
             logLevel = level;
             lineLogLevels.push_back(logLevel);
             return LevelToString(level);
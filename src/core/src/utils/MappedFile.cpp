@@ -0,0 +1,109 @@
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#undef ERROR // Prevent Windows ERROR macro from conflicting with Logger::ERROR
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace Utils
+{
+    MappedFile::MappedFile(const std::string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view)
+        {
+            if (mapping) CloseHandle(mapping);
+            CloseHandle(file);
+            return;
+        }
+
+        mFile = file;
+        mMapping = mapping;
+        mData = static_cast<const char*>(view);
+        mSize = static_cast<size_t>(size.QuadPart);
+#else
+        const int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) return;
+
+        struct stat info{};
+        if (fstat(file, &info) != 0 || info.st_size == 0)
+        {
+            close(file);
+            return;
+        }
+
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        // The mapping keeps its own reference to the file
+        close(file);
+        if (view == MAP_FAILED) return;
+
+        mData = static_cast<const char*>(view);
+        mSize = static_cast<size_t>(info.st_size);
+#endif
+    }
+
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this == &other) return *this;
+        Close();
+
+        mData = std::exchange(other.mData, nullptr);
+        mSize = std::exchange(other.mSize, 0);
+#ifdef _WIN32
+        mFile = std::exchange(other.mFile, nullptr);
+        mMapping = std::exchange(other.mMapping, nullptr);
+#endif
+        return *this;
+    }
+
+
+    void MappedFile::Close()
+    {
+        if (!mData) return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(mData);
+        CloseHandle(mMapping);
+        CloseHandle(mFile);
+        mFile = nullptr;
+        mMapping = nullptr;
+#else
+        munmap(const_cast<char*>(mData), mSize);
+#endif
+        mData = nullptr;
+        mSize = 0;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file
+// Pages are loaded by the OS on first touch, so opening is cheap no matter the file size
+namespace Utils
+{
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        // Check IsOpen, a missing or empty file leaves the mapping closed
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool IsOpen() const { return mData != nullptr; }
+        const char* Data() const { return mData; }
+        size_t Size() const { return mSize; }
+
+        void Close();
+
+    private:
+        const char* mData = nullptr;
+        size_t mSize = 0;
+#ifdef _WIN32
+        void* mFile = nullptr;
+        void* mMapping = nullptr;
+#endif
+    };
+
+
+    // 64-bit FNV-1a, stable across runs and platforms so it can key files on disk. Not cryptographic
+    inline uint64_t HashBytes(const void* data, const size_t size)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable for the task scheduler
+// Unlike std::function, captures up to INLINE_SIZE bytes are stored in the task itself, so spawning
+// a typical lambda never allocates. Bigger callables fall back to the heap.
+namespace Utils
+{
+    class Task
+    {
+    public:
+        static constexpr size_t INLINE_SIZE = 64;
+
+        Task() = default;
+
+        template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+        Task(F&& callable);
+
+        Task(Task&& other) noexcept;
+        Task& operator=(Task&& other) noexcept;
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() { Reset(); }
+
+        void operator()() { mOps->invoke(mCallable); }
+        explicit operator bool() const { return mOps != nullptr; }
+
+        // Destroys the stored callable, leaving the task empty
+        void Reset();
+
+    private:
+        // One static table per callable type, the task only stores a pointer to it
+        struct Ops
+        {
+            void (*invoke)(void* callable);
+            // Move constructs into storage and destroys the source, only used for inline callables
+            void (*relocate)(void* from, void* to);
+            void (*destroy)(void* callable, bool onHeap);
+        };
+
+        template<typename F>
+        static constexpr bool FitsInline = sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t) &&
+                                           std::is_nothrow_move_constructible_v<F>;
+
+        template<typename F>
+        static const Ops* GetOps();
+
+        alignas(std::max_align_t) unsigned char mStorage[INLINE_SIZE];
+        // Points into mStorage or to a heap allocation
+        void* mCallable = nullptr;
+        const Ops* mOps = nullptr;
+
+        bool IsInline() const { return mCallable == static_cast<const void*>(mStorage); }
+    };
+
+    template<typename F, typename>
+    Task::Task(F&& callable)
+    {
+        using Callable = std::decay_t<F>;
+        if constexpr (FitsInline<Callable>)
+            mCallable = new (mStorage) Callable(std::forward<F>(callable));
+        else
+            mCallable = new Callable(std::forward<F>(callable));
+        mOps = GetOps<Callable>();
+    }
+
+    inline Task::Task(Task&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    inline Task& Task::operator=(Task&& other) noexcept
+    {
+        if (this == &other) return *this;
+        Reset();
+        if (!other.mOps) return *this;
+
+        mOps = other.mOps;
+        if (other.IsInline())
+        {
+            mOps->relocate(other.mCallable, mStorage);
+            mCallable = mStorage;
+        }
+        else
+        {
+            // Heap callables just change owner
+            mCallable = other.mCallable;
+        }
+        other.mCallable = nullptr;
+        other.mOps = nullptr;
+        return *this;
+    }
+
+    inline void Task::Reset()
+    {
+        if (!mOps) return;
+        mOps->destroy(mCallable, !IsInline());
+        mCallable = nullptr;
+        mOps = nullptr;
+    }
+
+    template<typename F>
+    const Task::Ops* Task::GetOps()
+    {
+        static const Ops ops{
+            [](void* callable) { (*static_cast<F*>(callable))(); },
+            [](void* from, void* to)
+            {
+                if constexpr (FitsInline<F>)
+                {
+                    new (to) F(std::move(*static_cast<F*>(from)));
+                    static_cast<F*>(from)->~F();
+                }
+            },
+            [](void* callable, const bool onHeap)
+            {
+                if (onHeap) delete static_cast<F*>(callable);
+                else static_cast<F*>(callable)->~F();
+            }
+        };
+        return &ops;
+    }
+}
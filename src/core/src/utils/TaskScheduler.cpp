@@ -0,0 +1,331 @@
+#include "TaskScheduler.h"
+
+#include "Logger.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#undef ERROR // Prevent Windows ERROR macro from conflicting with Logger::ERROR
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+
+namespace Utils
+{
+    namespace
+    {
+        // Scheduler and deque the current thread works for, set once when a worker thread starts
+        struct LocalWorker
+        {
+            const TaskScheduler* scheduler = nullptr;
+            size_t index = 0;
+            // xorshift state for picking steal victims
+            uint32_t random = 0;
+        };
+
+        LocalWorker& GetLocalWorker()
+        {
+            thread_local LocalWorker local;
+            return local;
+        }
+
+        uint32_t NextRandom(LocalWorker& local)
+        {
+            if (local.random == 0)
+                local.random = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1u;
+
+            local.random ^= local.random << 13;
+            local.random ^= local.random >> 17;
+            local.random ^= local.random << 5;
+            return local.random;
+        }
+
+        // Finished task objects kept for reuse by the thread that freed them
+        struct TaskCache
+        {
+            static constexpr size_t MAX_CACHED = 1024;
+
+            std::vector<Task*> tasks;
+
+            ~TaskCache()
+            {
+                for (const Task* task : tasks) delete task;
+            }
+        };
+
+        TaskCache& GetTaskCache()
+        {
+            thread_local TaskCache cache;
+            return cache;
+        }
+    }
+
+
+    TaskScheduler::~TaskScheduler()
+    {
+        Stop();
+    }
+
+
+    void TaskScheduler::Start(size_t threadCount, const bool pinThreads)
+    {
+        if (IsRunning())
+            throw std::logic_error("Task scheduler is already running");
+
+        const size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (threadCount == AUTO_THREAD_COUNT)
+            threadCount = hardwareThreads - 1;
+
+        LOG(LOG_INFO) << "Starting task scheduler with " << threadCount << " worker threads.\n";
+
+        mStopping = false;
+        mOwnerThread = std::this_thread::get_id();
+
+        // All deques exist before any thread starts stealing from them
+        mWorkers.reserve(threadCount + 1);
+        for (size_t i = 0; i <= threadCount; i++)
+            mWorkers.push_back(std::make_unique<Worker>());
+
+        bool pin = pinThreads;
+        for (size_t i = 1; i <= threadCount; i++)
+        {
+            mWorkers[i]->thread = std::thread(&TaskScheduler::WorkerLoop, this, i);
+            mThreadsCreated++;
+
+            if (pin && !PinThread(mWorkers[i]->thread, i % hardwareThreads))
+            {
+                LOG(LOG_WARNING) << "Failed to pin worker threads, continuing unpinned.\n";
+                pin = false;
+            }
+        }
+    }
+
+
+    void TaskScheduler::Stop()
+    {
+        {
+            std::lock_guard lock(mSleepMutex);
+            mStopping = true;
+        }
+        mWakeCondition.notify_all();
+
+        for (const auto& worker : mWorkers)
+        {
+            if (worker->thread.joinable())
+                worker->thread.join();
+        }
+
+        // Whatever is still queued runs here, dropping it would leave its group waiting forever. The deques are
+        // still there so tasks spawned along the way are found as well
+        while (RunOneTask())
+        {
+        }
+        mWorkers.clear();
+        mQueuedTasks = 0;
+    }
+
+
+    void TaskScheduler::Submit(Task&& task)
+    {
+        Task* allocated = AllocateTask(std::move(task));
+
+        const size_t workerIndex = GetLocalWorkerIndex();
+        if (workerIndex != NO_WORKER)
+        {
+            mWorkers[workerIndex]->deque.Push(allocated);
+        }
+        else
+        {
+            std::lock_guard lock(mInjectMutex);
+            mInjected.push_back(allocated);
+        }
+
+        mQueuedTasks.fetch_add(1, std::memory_order_seq_cst);
+        WakeWorker();
+    }
+
+
+    bool TaskScheduler::RunOneTask()
+    {
+        Task* task = FindTask(GetLocalWorkerIndex());
+        if (!task) return false;
+
+        (*task)();
+        FreeTask(task);
+        return true;
+    }
+
+
+    Task* TaskScheduler::FindTask(const size_t workerIndex)
+    {
+        Task* task = nullptr;
+
+        // Own work first, newest task is the one most likely still in cache
+        if (workerIndex != NO_WORKER && mWorkers[workerIndex]->deque.Pop(task))
+        {
+            mQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+
+        // Then steal the oldest (usually largest) task of another worker, starting from a random one
+        const size_t workerCount = mWorkers.size();
+        if (workerCount > 0)
+        {
+            const size_t start = NextRandom(GetLocalWorker()) % workerCount;
+            for (size_t i = 0; i < workerCount; i++)
+            {
+                const size_t victim = (start + i) % workerCount;
+                if (victim == workerIndex) continue;
+
+                if (mWorkers[victim]->deque.Steal(task))
+                {
+                    mQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+                    return task;
+                }
+            }
+        }
+
+        std::lock_guard lock(mInjectMutex);
+        if (mInjected.empty()) return nullptr;
+
+        task = mInjected.front();
+        mInjected.pop_front();
+        mQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+
+
+    void TaskScheduler::WorkerLoop(const size_t workerIndex)
+    {
+        LocalWorker& local = GetLocalWorker();
+        local.scheduler = this;
+        local.index = workerIndex;
+
+        int idleSpins = 0;
+        while (true)
+        {
+            if (Task* task = FindTask(workerIndex))
+            {
+                (*task)();
+                FreeTask(task);
+                idleSpins = 0;
+                continue;
+            }
+
+            if (++idleSpins < IDLE_SPINS)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            idleSpins = 0;
+
+            // Submit bumps mQueuedTasks before reading mSleepingWorkers, and sleeping bumps mSleepingWorkers before
+            // reading mQueuedTasks, so at least one side always sees the other and no wake up is lost
+            std::unique_lock lock(mSleepMutex);
+            mSleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+            mWakeCondition.wait(lock, [this]
+            {
+                return mStopping || mQueuedTasks.load(std::memory_order_seq_cst) > 0;
+            });
+            mSleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+
+            if (mStopping) break;
+        }
+
+        local.scheduler = nullptr;
+    }
+
+
+    void TaskScheduler::WakeWorker()
+    {
+        if (mSleepingWorkers.load(std::memory_order_seq_cst) == 0) return;
+
+        // Taking the lock makes sure the sleeper is either before its check or already waiting
+        {
+            std::lock_guard lock(mSleepMutex);
+        }
+        mWakeCondition.notify_one();
+    }
+
+
+    bool TaskScheduler::PinThread(std::thread& thread, const size_t hardwareThread)
+    {
+#ifdef _WIN32
+        return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << (hardwareThread % (sizeof(DWORD_PTR) * 8))) != 0;
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(hardwareThread, &set);
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)hardwareThread;
+        return false;
+#endif
+    }
+
+
+    size_t TaskScheduler::GetLocalWorkerIndex() const
+    {
+        const LocalWorker& local = GetLocalWorker();
+        if (local.scheduler == this) return local.index;
+        if (!mWorkers.empty() && std::this_thread::get_id() == mOwnerThread) return 0;
+        return NO_WORKER;
+    }
+
+
+    Task* TaskScheduler::AllocateTask(Task&& task)
+    {
+        auto& cache = GetTaskCache().tasks;
+        if (cache.empty()) return new Task(std::move(task));
+
+        Task* allocated = cache.back();
+        cache.pop_back();
+        *allocated = std::move(task);
+        return allocated;
+    }
+
+
+    void TaskScheduler::FreeTask(Task* task)
+    {
+        task->Reset();
+
+        auto& cache = GetTaskCache().tasks;
+        if (cache.size() < TaskCache::MAX_CACHED) cache.push_back(task);
+        else delete task;
+    }
+
+
+    TaskGroup::~TaskGroup()
+    {
+        try
+        {
+            Wait();
+        }
+        catch (...)
+        {
+        }
+    }
+
+
+    void TaskGroup::Wait()
+    {
+        // Help out instead of blocking, this is what makes nested waits inside tasks safe
+        while (mPending.load(std::memory_order_acquire) != 0)
+        {
+            if (!mScheduler.RunOneTask())
+                std::this_thread::yield();
+        }
+
+        std::lock_guard lock(mExceptionMutex);
+        if (mException)
+        {
+            std::exception_ptr exception = mException;
+            mException = nullptr;
+            std::rethrow_exception(exception);
+        }
+    }
+}
@@ -0,0 +1,208 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Task.h"
+#include "WorkStealingDeque.h"
+
+// Work stealing job system shared by BVH builds, physics and mesh processing
+// Every worker owns a deque: it pushes and pops its own tasks at the bottom without locking, idle workers
+// steal from the top of someone else's. The thread that calls Start is worker 0 and runs tasks while waiting.
+// Threads outside the scheduler submit through a small locked queue instead.
+namespace Utils
+{
+    // Thread count that leaves exactly one hardware thread for the thread calling Start
+    constexpr size_t AUTO_THREAD_COUNT = SIZE_MAX;
+
+    class TaskGroup;
+
+    class TaskScheduler
+    {
+    public:
+        TaskScheduler() = default;
+        ~TaskScheduler();
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        // threadCount doesn't include the calling thread. With 0 threads every task runs on threads that wait on it
+        // Pinning locks worker i to hardware thread i, leaving hardware thread 0 to the calling thread
+        void Start(size_t threadCount = AUTO_THREAD_COUNT, bool pinThreads = false);
+
+        // Joins every thread, then runs the tasks still queued on the calling thread
+        void Stop();
+
+        bool IsRunning() const { return !mWorkers.empty(); }
+        // Threads that execute tasks, including the thread that called Start
+        size_t GetWorkerCount() const { return mWorkers.empty() ? 1 : mWorkers.size(); }
+        // Threads created since construction, stays put no matter how many tasks run
+        size_t GetThreadsCreated() const { return mThreadsCreated; }
+
+    private:
+        friend class TaskGroup;
+
+        static constexpr size_t NO_WORKER = SIZE_MAX;
+        // Times an idle worker looks for work before going to sleep
+        static constexpr int IDLE_SPINS = 64;
+
+        struct Worker
+        {
+            WorkStealingDeque<Task*> deque;
+            std::thread thread;
+        };
+
+        // Index 0 belongs to the thread that called Start and has no std::thread of its own
+        std::vector<std::unique_ptr<Worker>> mWorkers;
+        std::thread::id mOwnerThread;
+        size_t mThreadsCreated = 0;
+
+        // Tasks from threads that aren't workers
+        std::mutex mInjectMutex;
+        std::deque<Task*> mInjected;
+
+        // Tasks pushed but not yet taken, lets sleeping workers know when to wake up
+        std::atomic<size_t> mQueuedTasks{ 0 };
+        std::atomic<size_t> mSleepingWorkers{ 0 };
+        std::mutex mSleepMutex;
+        std::condition_variable mWakeCondition;
+        bool mStopping = false;
+
+        void Submit(Task&& task);
+        // Runs one queued task if it can find any, returns false otherwise
+        bool RunOneTask();
+
+        Task* FindTask(size_t workerIndex);
+        void WorkerLoop(size_t workerIndex);
+        void WakeWorker();
+        // Returns false if the platform doesn't support it
+        static bool PinThread(std::thread& thread, size_t hardwareThread);
+
+        // Index of the calling thread's deque in this scheduler, NO_WORKER if it doesn't have one
+        size_t GetLocalWorkerIndex() const;
+
+        // Task objects are recycled per thread so spawning doesn't hit the allocator
+        static Task* AllocateTask(Task&& task);
+        static void FreeTask(Task* task);
+    };
+
+
+    // Set of tasks that can be waited on together
+    // Wait runs queued tasks instead of blocking, so tasks may safely spawn and wait on nested groups
+    class TaskGroup
+    {
+    public:
+        explicit TaskGroup(TaskScheduler& scheduler) : mScheduler(scheduler) {}
+        // Waits for outstanding tasks, an exception thrown by one of them is lost here
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        template<typename F>
+        void Run(F&& callable);
+
+        // Returns once every task run through this group has finished
+        // Rethrows the first exception thrown by any of them
+        void Wait();
+
+    private:
+        TaskScheduler& mScheduler;
+        std::atomic<size_t> mPending{ 0 };
+
+        std::mutex mExceptionMutex;
+        std::exception_ptr mException;
+    };
+
+    template<typename F>
+    void TaskGroup::Run(F&& callable)
+    {
+        mPending.fetch_add(1, std::memory_order_relaxed);
+        mScheduler.Submit(Task([this, callable = std::forward<F>(callable)]() mutable
+        {
+            try
+            {
+                callable();
+            }
+            catch (...)
+            {
+                std::lock_guard lock(mExceptionMutex);
+                if (!mException) mException = std::current_exception();
+            }
+            mPending.fetch_sub(1, std::memory_order_release);
+        }));
+    }
+
+
+    // Calls fn(i) for every i in [begin, end)
+    // The range is halved recursively until pieces hold at most grainSize indices, so idle workers steal large halves first
+    template<typename F>
+    void ParallelFor(TaskScheduler& scheduler, size_t begin, size_t end, size_t grainSize, const F& fn);
+
+    // Reduces [begin, end) by calling map(first, last) on pieces of at most grainSize indices and merging
+    // neighbouring results with combine(left, right). Pieces only depend on grainSize, so for a fixed grainSize
+    // the result is the same on any number of threads. Returns identity for an empty range
+    template<typename T, typename Map, typename Combine>
+    T ParallelReduce(TaskScheduler& scheduler, size_t begin, size_t end, size_t grainSize, T identity,
+                     const Map& map, const Combine& combine);
+
+    namespace Detail
+    {
+        template<typename F>
+        void ParallelForSplit(TaskGroup& group, const size_t begin, size_t end, const size_t grainSize, const F& fn)
+        {
+            // Hand off the upper halves and keep splitting the lower one
+            size_t first = begin;
+            while (end - first > grainSize)
+            {
+                const size_t mid = first + (end - first) / 2;
+                group.Run([&group, mid, end, grainSize, &fn] { ParallelForSplit(group, mid, end, grainSize, fn); });
+                end = mid;
+            }
+            for (size_t i = first; i < end; i++) fn(i);
+        }
+
+        template<typename T, typename Map, typename Combine>
+        T ParallelReduceSplit(TaskScheduler& scheduler, const size_t begin, const size_t end, const size_t grainSize,
+                              const Map& map, const Combine& combine)
+        {
+            if (end - begin <= grainSize) return map(begin, end);
+
+            const size_t mid = begin + (end - begin) / 2;
+            T right{};
+            TaskGroup group(scheduler);
+            group.Run([&scheduler, &right, mid, end, grainSize, &map, &combine]
+            {
+                right = ParallelReduceSplit<T>(scheduler, mid, end, grainSize, map, combine);
+            });
+            T left = ParallelReduceSplit<T>(scheduler, begin, mid, grainSize, map, combine);
+            group.Wait();
+            return combine(std::move(left), std::move(right));
+        }
+    }
+
+    template<typename F>
+    void ParallelFor(TaskScheduler& scheduler, const size_t begin, const size_t end, size_t grainSize, const F& fn)
+    {
+        if (begin >= end) return;
+        if (grainSize == 0) grainSize = 1;
+
+        TaskGroup group(scheduler);
+        Detail::ParallelForSplit(group, begin, end, grainSize, fn);
+        group.Wait();
+    }
+
+    template<typename T, typename Map, typename Combine>
+    T ParallelReduce(TaskScheduler& scheduler, const size_t begin, const size_t end, size_t grainSize, T identity,
+                     const Map& map, const Combine& combine)
+    {
+        if (begin >= end) return identity;
+        if (grainSize == 0) grainSize = 1;
+
+        return Detail::ParallelReduceSplit<T>(scheduler, begin, end, grainSize, map, combine);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Chase-Lev work stealing deque
+// The owning thread pushes and pops at the bottom without locking, any other thread may steal from the top.
+// Memory orderings follow "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013)
+// https://fzn.fr/readings/ppopp13.pdf
+namespace Utils
+{
+    // T has to be trivially copyable, in practice a pointer
+    template<typename T>
+    class WorkStealingDeque
+    {
+    public:
+        explicit WorkStealingDeque(size_t capacity = 256);
+
+        // Owner only
+        void Push(T item);
+        // Owner only, takes the most recently pushed item
+        bool Pop(T& item);
+        // Any thread, takes the oldest item. May fail spuriously when racing another thief or the owner
+        bool Steal(T& item);
+
+        // Only a hint while other threads are active
+        bool Empty() const;
+
+    private:
+        // Circular array, capacity is always a power of two
+        struct Buffer
+        {
+            explicit Buffer(const size_t capacity) : capacity(capacity), items(new std::atomic<T>[capacity]) {}
+
+            size_t capacity;
+            std::unique_ptr<std::atomic<T>[]> items;
+
+            T Get(const int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void Put(const int64_t i, const T item) { items[i & (capacity - 1)].store(item, std::memory_order_relaxed); }
+        };
+
+        std::atomic<int64_t> mTop{ 0 };
+        std::atomic<int64_t> mBottom{ 0 };
+        std::atomic<Buffer*> mBuffer;
+
+        // Every buffer ever used, thieves may still be reading an old one after the owner grew the deque
+        std::vector<std::unique_ptr<Buffer>> mBuffers;
+
+        Buffer* Grow(Buffer* buffer, int64_t top, int64_t bottom);
+    };
+
+    template<typename T>
+    WorkStealingDeque<T>::WorkStealingDeque(size_t capacity)
+    {
+        size_t powerOfTwo = 1;
+        while (powerOfTwo < capacity) powerOfTwo <<= 1;
+
+        mBuffers.push_back(std::make_unique<Buffer>(powerOfTwo));
+        mBuffer.store(mBuffers.back().get(), std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    void WorkStealingDeque<T>::Push(const T item)
+    {
+        const int64_t bottom = mBottom.load(std::memory_order_relaxed);
+        const int64_t top = mTop.load(std::memory_order_acquire);
+        Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+
+        if (bottom - top > static_cast<int64_t>(buffer->capacity) - 1)
+            buffer = Grow(buffer, top, bottom);
+
+        buffer->Put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    bool WorkStealingDeque<T>::Pop(T& item)
+    {
+        const int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = mTop.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            // Was already empty
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = buffer->Get(bottom);
+        if (top != bottom) return true;
+
+        // Last item, race thieves for it
+        const bool won = mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    template<typename T>
+    bool WorkStealingDeque<T>::Steal(T& item)
+    {
+        int64_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+        if (top >= bottom) return false;
+
+        const Buffer* buffer = mBuffer.load(std::memory_order_acquire);
+        item = buffer->Get(top);
+        return mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    bool WorkStealingDeque<T>::Empty() const
+    {
+        return mTop.load(std::memory_order_relaxed) >= mBottom.load(std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    typename WorkStealingDeque<T>::Buffer* WorkStealingDeque<T>::Grow(Buffer* buffer, const int64_t top, const int64_t bottom)
+    {
+        auto grown = std::make_unique<Buffer>(buffer->capacity * 2);
+        for (int64_t i = top; i < bottom; i++)
+            grown->Put(i, buffer->Get(i));
+
+        Buffer* result = grown.get();
+        mBuffers.push_back(std::move(grown));
+        mBuffer.store(result, std::memory_order_release);
+        return result;
+    }
+}
@@ -20,6 +20,7 @@ namespace Physics {
 
 namespace SceneImporterInternal {
     class SceneHelper;
+    class MeshFileHelper;
 }
 
 // Manages Lua state lifecycle and script callbacks
@@ -49,6 +50,9 @@ public:
     // Load minimal fallback scene on error
     bool LoadFallbackScene(std::string& outErrorMsg);
 
+    // Finishes mesh loads the scripts started but never waited on, call before the world stops its scheduler
+    void Shutdown();
+
     // Register debug renderables for Lua access
     void RegisterDebugLines(const std::string& name, Lines* lines);
     void RegisterDebugPoints(const std::string& name, Points* points);
@@ -62,6 +66,9 @@ public:
                      const LuaBindings::LuaCameraView& camera);
     void CallOnClick(const LuaBindings::LuaInput& input,
                     const LuaBindings::LuaCameraView& camera);
+    // Calls OnOverlapBegin(a, b) and OnOverlapEnd(a, b) once per pair
+    void CallOnOverlap(const std::vector<std::pair<Entity, Entity>>& begins,
+                      const std::vector<std::pair<Entity, Entity>>& ends);
 
     Entity GetLightEntity() const { return lightEntity; }
 
@@ -77,4 +84,5 @@ private:
     bool callbacksRegistered = false;
     World* worldPtr = nullptr;
     Physics::DynamicBBTree* treePtr = nullptr;
+    SceneImporterInternal::MeshFileHelper* meshFiles = nullptr;
 };
@@ -1,5 +1,7 @@
 #include <lua_engine/LuaBindings.h>
 #include <lua_engine/LuaLogger.h>
+#include "physics/MeshCollision.h"
+#include "physics/MeshRaycast.h"
 
 namespace LuaBindings {
 
@@ -143,18 +145,87 @@ void BindDynamicAPIs(sol::state& lua, World& world, Physics::DynamicBBTree& tree
 
     lua["Utils"] = utilsTable;
 
+    lua.new_usertype<Physics::RayHit>("RayHit",
+        sol::no_constructor,
+        "entity", sol::readonly(&Physics::RayHit::entity),
+        "t", sol::readonly(&Physics::RayHit::t),
+        "point", sol::readonly(&Physics::RayHit::point),
+        "hit", sol::readonly(&Physics::RayHit::hit)
+    );
+
+    lua.new_usertype<Physics::MeshRayHit>("MeshRayHit",
+        sol::no_constructor,
+        "entity", sol::readonly(&Physics::MeshRayHit::entity),
+        "triangle", sol::property([](const Physics::MeshRayHit& hit) -> sol::optional<size_t> {
+            if (hit.triangle == Physics::NO_TRIANGLE) return sol::nullopt;
+            return hit.triangle;
+        }),
+        "t", sol::readonly(&Physics::MeshRayHit::t),
+        "point", sol::readonly(&Physics::MeshRayHit::point),
+        "normal", sol::readonly(&Physics::MeshRayHit::normal),
+        "barycentric", sol::readonly(&Physics::MeshRayHit::barycentric),
+        "hit", sol::readonly(&Physics::MeshRayHit::hit)
+    );
+
+    lua.new_usertype<Physics::TriangleContact>("TriangleContact",
+        sol::no_constructor,
+        "triangle", sol::readonly(&Physics::TriangleContact::triangle),
+        "otherTriangle", sol::readonly(&Physics::TriangleContact::otherTriangle),
+        "point", sol::readonly(&Physics::TriangleContact::point)
+    );
+
     // DynamicBBTree methods - physics queries
     lua.new_usertype<Physics::DynamicBBTree>("DynamicBBTree",
         sol::no_constructor,
-        "QueryRay", [](Physics::DynamicBBTree& tree, const Ray& ray) -> std::tuple<Entity, bool> {
+        "QueryRay", [](Physics::DynamicBBTree& tree, const Ray& ray) -> std::tuple<Entity, bool, float, glm::vec3> {
             LOG(LOG_INFO) << "Query TREE!" << "\n";
-            auto [entity, hit] = tree.QueryRay(ray);
-            return std::make_tuple(entity, hit);
+            const Physics::RayHit hit = tree.QueryClosest(ray);
+            return std::make_tuple(hit.entity, hit.hit, hit.t, hit.point);
+        },
+        // Traces into the triangles of entities with a MeshCollider
+        "RayCastMeshes", [&world](Physics::DynamicBBTree& tree, const Ray& ray) -> Physics::MeshRayHit {
+            return Physics::RayCastMeshes(tree, world, ray);
+        },
+        // Takes a table of rays and returns a table of RayHits in the same order
+        "QueryRays", [](Physics::DynamicBBTree& tree, const sol::table& rayTable) -> std::vector<Physics::RayHit> {
+            std::vector<Ray> rays;
+            rays.reserve(rayTable.size());
+            for (size_t i = 1; i <= rayTable.size(); i++)
+                rays.push_back(rayTable.get<Ray>(i));
+
+            std::vector<Physics::RayHit> hits;
+            tree.QueryRays(rays, hits);
+            return hits;
         },
         "QueryRayCollisions", [](Physics::DynamicBBTree& tree, const Ray& ray) -> std::tuple<std::vector<BoundingBox>, bool> {
-            auto [boxes, hit] = tree.QueryRayCollisions(ray);
+            std::vector<BoundingBox> boxes;
+            bool hit = tree.QueryRayCollisions(ray, boxes);
             return std::make_tuple(boxes, hit);
         },
+        // fn(entity) may return false to stop the query
+        "QueryAABB", [](Physics::DynamicBBTree& tree, const BoundingBox& box, const sol::protected_function& fn) {
+            tree.QueryAABB(box, [&fn](Entity entity) -> bool {
+                sol::protected_function_result result = fn(entity);
+                if (!result.valid()) {
+                    sol::error err = result;
+                    throw std::runtime_error(std::string("QueryAABB callback failed: ") + err.what());
+                }
+                sol::optional<bool> keepGoing = result;
+                return keepGoing.value_or(true);
+            });
+        },
+        // fn(entity, t) may return a new maxT, 0 stops the query
+        "RayCast", [](Physics::DynamicBBTree& tree, const Ray& ray, float maxT, const sol::protected_function& fn) {
+            tree.RayCast(ray, [&fn, maxT](Entity entity, float t) -> float {
+                sol::protected_function_result result = fn(entity, t);
+                if (!result.valid()) {
+                    sol::error err = result;
+                    throw std::runtime_error(std::string("RayCast callback failed: ") + err.what());
+                }
+                sol::optional<float> newMaxT = result;
+                return newMaxT.value_or(maxT);
+            }, maxT);
+        },
         "GetBoundingBox", &Physics::DynamicBBTree::GetBoundingBox,
         "GetAllBoxes", [](Physics::DynamicBBTree& tree, bool onlyLeaf) -> std::vector<BoundingBox> {
             return tree.GetAllBoxes(onlyLeaf);
@@ -164,9 +235,17 @@ void BindDynamicAPIs(sol::state& lua, World& world, Physics::DynamicBBTree& tree
         "InsertEntity", &Physics::DynamicBBTree::InsertEntity,
         "RemoveEntity", &Physics::DynamicBBTree::RemoveEntity,
         "UpdateEntity", sol::overload(
-            static_cast<void(Physics::DynamicBBTree::*)(Entity, BoundingBox)>(&Physics::DynamicBBTree::UpdateEntity),
-            static_cast<void(Physics::DynamicBBTree::*)(Entity, glm::vec3)>(&Physics::DynamicBBTree::UpdateEntity)
+            [](Physics::DynamicBBTree& tree, Entity entity, BoundingBox box) -> bool {
+                return tree.UpdateEntity(entity, box);
+            },
+            static_cast<bool(Physics::DynamicBBTree::*)(Entity, glm::vec3)>(&Physics::DynamicBBTree::UpdateEntity)
         ),
+        "GetFatBoundingBox", &Physics::DynamicBBTree::GetFatBoundingBox,
+        "GetReinsertCount", &Physics::DynamicBBTree::GetReinsertCount,
+        "Rebuild", &Physics::DynamicBBTree::Rebuild,
+        "GetQualityMetric", &Physics::DynamicBBTree::GetQualityMetric,
+        "fatMargin", &Physics::DynamicBBTree::fatMargin,
+        "displacementMultiplier", &Physics::DynamicBBTree::displacementMultiplier,
         "AddToTree", [&physicsRegistry](Physics::DynamicBBTree& tree, Entity entity) {
             auto it = physicsRegistry.find(entity);
             if (it == physicsRegistry.end())
@@ -177,7 +256,18 @@ void BindDynamicAPIs(sol::state& lua, World& world, Physics::DynamicBBTree& tree
 
     // Expose tree via PhysicsSystem namespace
     lua["PhysicsSystem"] = lua.create_table_with(
-        "tree", std::ref(tree)
+        "tree", std::ref(tree),
+        // Intersecting triangle pairs of two entities with a MeshCollider, empty if they don't touch
+        "CollideMeshes", [&world](const Entity a, const Entity b, const sol::optional<bool> contactPoints,
+                                  const sol::optional<bool> anyHit) -> std::vector<Physics::TriangleContact> {
+            Physics::OverlapOptions options;
+            options.contactPoints = contactPoints.value_or(false);
+            options.anyHit = anyHit.value_or(false);
+
+            std::vector<Physics::TriangleContact> contacts;
+            Physics::CollideMeshes(world, a, b, contacts, options);
+            return contacts;
+        }
     );
 
     // Debug namespace - access registered renderables
@@ -7,6 +7,7 @@
 #include "scene/helpers/FloorHelper.h"
 #include "scene/helpers/SphereHelper.h"
 #include "scene/helpers/LinesHelper.h"
+#include "scene/helpers/MeshFileHelper.h"
 
 // Constructor and destructor must be defined in .cpp where SceneHelper is complete
 LuaRuntime::LuaRuntime() = default;
@@ -35,6 +36,10 @@ void LuaRuntime::Initialize(World& world, Physics::DynamicBBTree& tree,
     sceneHelpers.push_back(std::make_unique<SceneImporterInternal::SphereHelper>(*this));
     sceneHelpers.push_back(std::make_unique<SceneImporterInternal::LinesHelper>(*this));
 
+    auto meshFileHelper = std::make_unique<SceneImporterInternal::MeshFileHelper>(*this, world.GetScheduler());
+    meshFiles = meshFileHelper.get();
+    sceneHelpers.push_back(std::move(meshFileHelper));
+
     for (const auto& helper : sceneHelpers) {
         SceneImporterInternal::SceneHelper* helperPtr = helper.get();
         std::string helperName = helper->GetName();
@@ -50,6 +55,37 @@ void LuaRuntime::Initialize(World& world, Physics::DynamicBBTree& tree,
         LOG(LOG_INFO) << "Registered scene helper: " << helperName << "\n";
     }
 
+    // Mesh files load asynchronously: LoadMesh returns a handle right away, CreateMesh waits on it
+    // Without worker threads nothing runs the load in the background, so ready finishes it right there instead of
+    // leaving a script that polls it looping forever
+    Utils::TaskScheduler& scheduler = world.GetScheduler();
+    lua.new_usertype<Utils::MeshLoadHandle>("MeshLoad",
+        sol::no_constructor,
+        "ready", sol::property([&scheduler](const Utils::MeshLoadHandle& handle) {
+            if (!handle.IsReady() && scheduler.GetWorkerCount() == 1) handle.Wait();
+            return handle.IsReady();
+        }),
+        "filename", sol::property([](const Utils::MeshLoadHandle& handle) { return handle.GetFilename(); }),
+        "Wait", [](const Utils::MeshLoadHandle& handle) { handle.Wait(); }
+    );
+
+    lua.set_function("LoadMesh", [meshFiles = meshFiles](const std::string& filename, sol::optional<sol::table> cfg) {
+        Utils::MeshLoadOptions options;
+        options.isStl = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".stl") == 0;
+        options.buildTree = true;
+        if (cfg) {
+            options.isStl = cfg.value()["stl"].get_or(options.isStl);
+            options.buildTree = cfg.value()["collider"].get_or(options.buildTree);
+            options.treeOptions.spatialSplits = cfg.value()["spatialSplits"].get_or(false);
+            options.lodCount = std::max(0, cfg.value()["lods"].get_or(0));
+        }
+        return meshFiles->GetLoader().Load(filename, options);
+    });
+
+    lua.set_function("WaitForMeshes", [meshFiles = meshFiles]() {
+        meshFiles->GetLoader().WaitAll();
+    });
+
     callbacksRegistered = true;
     LOG(LOG_INFO) << "Lua runtime initialized successfully\n";
 }
@@ -198,6 +234,32 @@ void LuaRuntime::CallOnClick(const LuaBindings::LuaInput& input,
     }
 }
 
+void LuaRuntime::CallOnOverlap(const std::vector<std::pair<Entity, Entity>>& begins,
+                              const std::vector<std::pair<Entity, Entity>>& ends) {
+    auto callEach = [this](const char* name, const std::vector<std::pair<Entity, Entity>>& pairs) {
+        if (pairs.empty()) return;
+
+        sol::optional<sol::protected_function> callback = lua[name];
+        if (!callback) return;
+
+        try {
+            for (const auto& [a, b] : pairs) {
+                sol::protected_function_result result = callback.value()(a, b);
+                if (!result.valid()) {
+                    sol::error err = result;
+                    LOG(LOG_ERROR) << name << " error: " << err.what() << "\n";
+                    return;
+                }
+            }
+        } catch (const std::exception& e) {
+            LOG(LOG_ERROR) << name << " exception: " << e.what() << "\n";
+        }
+    };
+
+    callEach("OnOverlapEnd", ends);
+    callEach("OnOverlapBegin", begins);
+}
+
 bool LuaRuntime::LoadFallbackScene(std::string& outErrorMsg) {
     try {
         LOG(LOG_INFO) << "Loading fallback scene\n";
@@ -269,6 +331,14 @@ bool LuaRuntime::LoadFallbackScene(std::string& outErrorMsg) {
     }
 }
 
+void LuaRuntime::Shutdown() {
+    // Handles may still sit in Lua values and the loader, their groups must be settled while the scheduler runs
+    if (meshFiles && meshFiles->GetLoader().GetPendingCount() > 0) {
+        LOG(LOG_INFO) << "Waiting for " << meshFiles->GetLoader().GetPendingCount() << " mesh loads before shutting down\n";
+        meshFiles->GetLoader().WaitAll();
+    }
+}
+
 void LuaRuntime::TakeOwnership(std::unique_ptr<Lines> lines) {
     ownedLines.push_back(std::move(lines));
 }
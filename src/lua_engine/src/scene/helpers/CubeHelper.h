@@ -16,6 +16,11 @@ namespace SceneImporterInternal {
 
             ApplyCommonSettings(cube, cfg, shaders, "flat");
 
+            // Every cube has the same object space triangles, so they all share one tree
+            if (cubeTree) cube.mTree = cubeTree;
+            cube.AddCollider();
+            cubeTree = cube.mTree;
+
             luaRuntime.RegisterPhysics(cube.mEntityID, cube.CalcBoundingBox());
             return cube.mEntityID;
         }
@@ -24,5 +29,6 @@ namespace SceneImporterInternal {
 
     private:
         LuaRuntime& luaRuntime;
+        std::shared_ptr<Physics::StaticTree> cubeTree;
     };
 }
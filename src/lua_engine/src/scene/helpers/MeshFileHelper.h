@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../MeshHelper.h"
+#include "math/mesh/MeshLoader.h"
+
+class LuaRuntime;
+
+namespace SceneImporterInternal {
+    // Creates entities from meshes started with LoadMesh
+    // Scripts start every load first, then create the entities, so files load on the workers in parallel and only
+    // the GL upload happens here on the main thread
+    class MeshFileHelper : public MeshHelper {
+    public:
+        MeshFileHelper(LuaRuntime& runtime, Utils::TaskScheduler& scheduler) : luaRuntime(runtime), loader(scheduler) {}
+
+        Entity Create(sol::table cfg, World& /*world*/, const std::unordered_map<std::string, GLuint>& shaders) override {
+            sol::optional<Utils::MeshLoadHandle> handle = cfg["mesh"];
+            if (!handle || !handle->IsValid()) {
+                throw SceneException("CreateMesh requires a 'mesh' handle returned by LoadMesh");
+            }
+
+            // Waits only if this load hasn't finished yet, any other queued load may run in the meantime
+            const Utils::CachedMesh& loaded = handle->Wait();
+            if (loaded.data.indices.empty() || loaded.data.vertices.empty()) {
+                throw SceneException("Mesh '" + handle->GetFilename() + "' failed to load");
+            }
+
+            Mesh mesh(loaded);
+            ApplyCommonSettings(mesh, cfg, shaders, "flat");
+
+            if (mesh.mTree) mesh.AddCollider();
+            if (mesh.HasLODs()) mesh.AddLODGroup();
+
+            luaRuntime.RegisterPhysics(mesh.mEntityID, mesh.CalcBoundingBox());
+            return mesh.mEntityID;
+        }
+
+        std::string GetName() override { return "CreateMesh"; }
+
+        Utils::MeshLoader& GetLoader() { return loader; }
+
+    private:
+        LuaRuntime& luaRuntime;
+        Utils::MeshLoader loader;
+    };
+}
@@ -0,0 +1,198 @@
+// Checks that Utils::OptimizeMesh only reorders: the same triangles come out, with the same winding, and the
+// simulated vertex cache misses go down. Also checks that QuantizeMesh stays within its documented error bounds
+// Returns non-zero if any check fails
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+
+#include "math/mesh/MeshOptimize.h"
+#include "utils/Logger.h"
+
+namespace
+{
+	int failures = 0;
+
+	void Check(const bool condition, const std::string& what)
+	{
+		if (condition) return;
+		std::cerr << "FAILED: " << what << "\n";
+		failures++;
+	}
+
+	using Corner = std::tuple<float, float, float, float, float, float>;
+	using Triangle = std::array<Corner, 3>;
+
+	// Triangles by their corners, each rotated to start at its smallest corner so the winding is kept
+	std::vector<Triangle> TriangleMultiset(const MeshData& data)
+	{
+		std::vector<Triangle> triangles;
+		for (size_t i = 0; i + 2 < data.indices.size(); i += 3)
+		{
+			Triangle triangle;
+			for (size_t c = 0; c < 3; c++)
+			{
+				const MeshPt& vertex = data.vertices[data.indices[i + c]];
+				triangle[c] = { vertex.position.x, vertex.position.y, vertex.position.z,
+				                vertex.normal.x, vertex.normal.y, vertex.normal.z };
+			}
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// Rows of quads longer than the cache, in the order a naive exporter writes them
+	MeshData Grid(const unsigned size)
+	{
+		MeshData data;
+		for (unsigned y = 0; y <= size; y++)
+			for (unsigned x = 0; x <= size; x++)
+				data.vertices.push_back({ glm::vec3(x, y, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) });
+
+		for (unsigned y = 0; y < size; y++)
+			for (unsigned x = 0; x < size; x++)
+			{
+				const GLuint corner = y * (size + 1) + x;
+				data.indices.insert(data.indices.end(), { corner, corner + 1, corner + size + 1 });
+				data.indices.insert(data.indices.end(), { corner + 1, corner + size + 2, corner + size + 1 });
+			}
+		return data;
+	}
+
+	// Same triangles in a random order with the vertices renumbered at random, the worst case for the cache
+	MeshData Shuffled(const MeshData& input, const unsigned seed)
+	{
+		std::mt19937 random(seed);
+
+		std::vector<GLuint> remap(input.vertices.size());
+		std::iota(remap.begin(), remap.end(), 0);
+		std::shuffle(remap.begin(), remap.end(), random);
+
+		MeshData data;
+		data.vertices.resize(input.vertices.size());
+		for (size_t v = 0; v < input.vertices.size(); v++) data.vertices[remap[v]] = input.vertices[v];
+
+		std::vector<size_t> order(input.indices.size() / 3);
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), random);
+		for (const size_t t : order)
+			for (size_t c = 0; c < 3; c++) data.indices.push_back(remap[input.indices[t * 3 + c]]);
+		return data;
+	}
+
+	void CheckOptimize(const std::string& name, const MeshData& input)
+	{
+		MeshData output = input;
+		Utils::OptimizeMesh(output);
+
+		Check(output.vertices.size() == input.vertices.size(), name + ": vertex count changed");
+		Check(output.indices.size() == input.indices.size(), name + ": index count changed");
+		Check(std::all_of(output.indices.begin(), output.indices.end(), [&](const GLuint index) { return index < output.vertices.size(); }),
+		      name + ": index out of range");
+		Check(TriangleMultiset(output) == TriangleMultiset(input), name + ": triangles changed");
+
+		const float before = Utils::CalculateACMR(input.indices.data(), input.indices.size(), input.vertices.size());
+		const float after = Utils::CalculateACMR(output.indices.data(), output.indices.size(), output.vertices.size());
+		std::cout << name << ": ACMR " << before << " -> " << after << "\n";
+		Check(after < before, name + ": ACMR didn't drop");
+		// An open grid can't get below 0.5, Tipsify lands around 0.7 on it
+		Check(after < 0.9f, name + ": ACMR " + std::to_string(after) + " is far from what Tipsify reaches");
+	}
+
+	// Random positions in a box that is long on x, thin on y and flat on z, with random unit normals
+	MeshData RandomPoints(const size_t count, const unsigned seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		MeshData data;
+		for (size_t v = 0; v < count; v++)
+		{
+			glm::vec3 normal(unit(random), unit(random), unit(random));
+			if (glm::length(normal) < 1e-3f) normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			data.vertices.push_back({ glm::vec3(100.0f + 500.0f * unit(random), 0.01f * unit(random), -3.0f),
+			                          glm::normalize(normal) });
+		}
+		for (GLuint v = 0; v + 2 < count; v += 3) data.indices.insert(data.indices.end(), { v, v + 1, v + 2 });
+		return data;
+	}
+
+	void CheckQuantize(const std::string& name, const MeshData& input)
+	{
+		const Utils::QuantizedMesh quantized = Utils::QuantizeMesh(MeshView(input));
+		const MeshData output = quantized.ToMeshData();
+
+		Check(output.vertices.size() == input.vertices.size(), name + ": vertex count changed");
+		Check(output.indices == input.indices, name + ": indices changed");
+		if (output.vertices.size() != input.vertices.size()) return;
+
+		glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+		for (const MeshPt& vertex : input.vertices)
+		{
+			min = glm::min(min, vertex.position);
+			max = glm::max(max, vertex.position);
+		}
+
+		// Half a step of the 16 bit grid, plus the float rounding of offset + scale * quantized
+		const glm::vec3 extent = max - min;
+		const glm::vec3 magnitude = glm::max(glm::abs(min), glm::abs(max));
+		const glm::vec3 positionBound = extent / 131070.0f + 4.0f * FLT_EPSILON * magnitude;
+		// Half a step of the 10 bit signed components
+		const float normalBound = 1.0f / 1022.0f + 4.0f * FLT_EPSILON;
+
+		float worstPosition = 0.0f, worstNormal = 0.0f;
+		bool positionsInBound = true, normalsInBound = true;
+		for (size_t v = 0; v < input.vertices.size(); v++)
+		{
+			const glm::vec3 positionError = glm::abs(output.vertices[v].position - input.vertices[v].position);
+			const glm::vec3 normalError = glm::abs(output.vertices[v].normal - input.vertices[v].normal);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				positionsInBound &= positionError[axis] <= positionBound[axis];
+				normalsInBound &= normalError[axis] <= normalBound;
+				if (extent[axis] > 0.0f) worstPosition = std::max(worstPosition, positionError[axis] / extent[axis]);
+				worstNormal = std::max(worstNormal, normalError[axis]);
+			}
+		}
+		std::cout << name << ": worst position error " << worstPosition << " of the box, normal error " << worstNormal << "\n";
+		Check(positionsInBound, name + ": a position is off by more than half a 16 bit step");
+		Check(normalsInBound, name + ": a normal is off by more than half a 10 bit step");
+	}
+}
+
+int main()
+{
+	LOG_INIT("MeshOptimizeTest.log");
+
+	const MeshData grid = Grid(48);
+	CheckOptimize("grid", grid);
+	CheckOptimize("shuffled grid", Shuffled(grid, 1234));
+
+	Check(sizeof(Utils::QuantizedMeshPt) == 12, "quantized vertex isn't 12 bytes");
+	// GL_INT_2_10_10_10_REV: x in the low bits, two's complement, w left at 0
+	Check(Utils::PackNormal(glm::vec3(-1.0f, 0.0f, 1.0f)) == (0x201u | 0x1FFu << 20), "normal packing layout changed");
+	CheckQuantize("quantized grid", grid);
+	CheckQuantize("quantized random points", RandomPoints(3000, 42));
+
+	// Degenerate inputs must come through without crashing
+	MeshData empty;
+	Utils::OptimizeMesh(empty);
+	Check(empty.indices.empty(), "empty mesh gained indices");
+	Check(Utils::CalculateACMR(nullptr, 0, 0) == 0.0f, "ACMR of no triangles isn't 0");
+	Check(Utils::QuantizeMesh(MeshView(empty)).vertices.empty(), "quantizing an empty mesh gained vertices");
+
+	if (failures > 0)
+	{
+		std::cerr << failures << " check(s) failed\n";
+		return 1;
+	}
+	std::cout << "All mesh optimization checks passed\n";
+	return 0;
+}
@@ -0,0 +1,63 @@
+// Checks that TaskScheduler::Stop settles every queued task, so groups waited on or destroyed afterwards return
+// Returns non-zero if any check fails. A regression shows up as a hang, which ctest reports as a timeout
+#include <atomic>
+#include <iostream>
+#include <string>
+
+#include "utils/Logger.h"
+#include "utils/TaskScheduler.h"
+
+namespace
+{
+	int failures = 0;
+
+	void Check(const bool condition, const std::string& what)
+	{
+		if (condition) return;
+		std::cerr << "FAILED: " << what << "\n";
+		failures++;
+	}
+
+	// Queues tasks, one of which spawns more into the same group, and stops the scheduler before waiting
+	void CheckStopRunsQueued(const std::string& name, const bool start, const size_t threadCount)
+	{
+		Utils::TaskScheduler scheduler;
+		if (start) scheduler.Start(threadCount);
+
+		std::atomic<int> ran{ 0 };
+		{
+			Utils::TaskGroup group(scheduler);
+			for (int i = 0; i < 100; i++) group.Run([&ran] { ran++; });
+			group.Run([&group, &ran]
+			{
+				for (int i = 0; i < 10; i++) group.Run([&ran] { ran++; });
+			});
+
+			scheduler.Stop();
+			Check(ran == 110, name + ": " + std::to_string(ran) + " of 110 tasks ran before Stop returned");
+		}
+
+		// A stopped scheduler still runs tasks on the threads that wait for them
+		Utils::TaskGroup group(scheduler);
+		group.Run([&ran] { ran++; });
+		group.Wait();
+		Check(ran == 111, name + ": task submitted after Stop didn't run");
+	}
+}
+
+int main()
+{
+	LOG_INIT("TaskSchedulerTest.log");
+
+	CheckStopRunsQueued("not started", false, 0);
+	CheckStopRunsQueued("no worker threads", true, 0);
+	CheckStopRunsQueued("4 worker threads", true, 4);
+
+	if (failures > 0)
+	{
+		std::cerr << failures << " check(s) failed\n";
+		return 1;
+	}
+	std::cout << "All task scheduler checks passed\n";
+	return 0;
+}
@@ -0,0 +1,103 @@
+// Converts STL files, binary or ASCII, and old packed .dat files to the versioned packed mesh format
+// Usage: MeshConverter <input> <output.dat> [--tree] [--spatial-splits] [--fast | --quality] [--lods <count>]
+//   --tree            stores a static tree in the file, so loading skips the build
+//   --spatial-splits  builds that tree with spatial splits
+//   --fast/--quality  StaticTreeBuildOptions preset for the tree
+//   --lods <count>    also writes count simplified levels as output_lod1.dat and on, each with half the triangles
+//                     Loading output.dat picks them up as the mesh's levels of detail
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "math/mesh/MeshImport.h"
+#include "math/mesh/MeshSimplify.h"
+#include "math/mesh/PackedMesh.h"
+#include "physics/StaticTree.h"
+#include "utils/Logger.h"
+#include "utils/TaskScheduler.h"
+
+namespace
+{
+	bool EndsWith(const std::string& text, const std::string& suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	int PrintUsage()
+	{
+		std::cerr << "Usage: MeshConverter <input.stl|input.dat> <output.dat> [--tree] [--spatial-splits] [--fast | --quality] [--lods <count>]\n";
+		return 1;
+	}
+}
+
+int main(const int argc, char** argv)
+{
+	LOG_INIT("MeshConverter.log");
+	LOG_SET_PRINT_TO_CONSOLE(true);
+	if (argc < 3) return PrintUsage();
+
+	const std::string input = argv[1];
+	const std::string output = argv[2];
+	bool buildTree = false, spatialSplits = false, fast = false, quality = false;
+	int lodCount = 0;
+	for (int i = 3; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--tree") == 0) buildTree = true;
+		else if (std::strcmp(argv[i], "--spatial-splits") == 0) spatialSplits = true;
+		else if (std::strcmp(argv[i], "--fast") == 0) fast = true;
+		else if (std::strcmp(argv[i], "--quality") == 0) quality = true;
+		else if (std::strcmp(argv[i], "--lods") == 0 && i + 1 < argc) lodCount = std::max(0, std::atoi(argv[++i]));
+		else return PrintUsage();
+	}
+
+	Physics::StaticTreeBuildOptions options = quality ? Physics::StaticTreeBuildOptions::HighQuality() :
+	                                          fast ? Physics::StaticTreeBuildOptions::FastBuild() : Physics::StaticTreeBuildOptions();
+	options.spatialSplits = spatialSplits;
+
+	Utils::TaskScheduler scheduler;
+	scheduler.Start();
+
+	const bool isStl = EndsWith(input, ".stl") || EndsWith(input, ".STL");
+	MeshData data = isStl ? Utils::ReadSTL(input.c_str(), scheduler) : Utils::ReadPackedSTL(input.c_str());
+	if (data.vertices.empty() || data.indices.empty())
+	{
+		std::cerr << "Failed to read " << input << "\n";
+		return 1;
+	}
+	// ReadSTL already reorders for the vertex cache, old packed files are in whatever order they were written
+	if (!isStl) Utils::OptimizeMesh(data);
+
+	Physics::StaticTree tree;
+	if (buildTree) tree.CreateStaticTree(data.vertices, data.indices, scheduler, options);
+
+	if (!Utils::WritePackedMesh(output, MeshView(data), buildTree ? &tree : nullptr))
+	{
+		std::cerr << "Failed to write " << output << "\n";
+		return 1;
+	}
+
+	std::cout << "Wrote " << output << ": " << data.vertices.size() << " vertices, " << data.indices.size() / 3 <<
+		" triangles" << (buildTree ? " and a static tree" : "") << "\n";
+
+	// Level 0 is the mesh just written, the rest go next to it
+	std::vector<MeshData> lods = Utils::BuildLODChain(data, static_cast<size_t>(lodCount) + 1);
+	if (lods.size() < static_cast<size_t>(lodCount) + 1)
+		std::cout << "Only " << lods.size() - 1 << " of " << lodCount << " levels of detail could be built, the mesh " <<
+			"can't be reduced any further\n";
+	for (size_t level = 1; level < lods.size(); level++)
+	{
+		if (lods[level].indices.empty()) break;
+		const std::string lodPath = Utils::GetPackedLODPath(output, level);
+		Utils::OptimizeMesh(lods[level]);
+		Physics::StaticTree lodTree;
+		if (buildTree) lodTree.CreateStaticTree(lods[level].vertices, lods[level].indices, scheduler, options);
+		if (!Utils::WritePackedMesh(lodPath, MeshView(lods[level]), buildTree ? &lodTree : nullptr))
+		{
+			std::cerr << "Failed to write " << lodPath << "\n";
+			return 1;
+		}
+		std::cout << "Wrote " << lodPath << ": " << lods[level].vertices.size() << " vertices, " <<
+			lods[level].indices.size() / 3 << " triangles\n";
+	}
+	return 0;
+}